@@ -21,73 +21,5213 @@
  */
 
 #include <cassert>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
 #include <jni.h>
 #include "c.h"
 #include "org_voltdb_leveldb_NativeInterface.h"
 
 using namespace std;
 
-void error(JNIEnv *env, const char *msg) {
+/*
+ * Exception classes are resolved once in JNI_OnLoad and held as global
+ * references, so throwing does not look classes up on every failure.
+ * LevelDB status messages are mapped to a LevelDBException subclass by
+ * the prefix Status::ToString() gives them.
+ */
+struct StatusException {
+    const char *prefix;
+    const char *class_name;
+    jclass cls;
+};
+
+static StatusException status_exceptions[] = {
+    { "NotFound: ", "org/voltdb/leveldb/LevelDBException$NotFound", NULL },
+    { "Corruption: ", "org/voltdb/leveldb/LevelDBException$Corruption", NULL },
+    { "Not implemented: ", "org/voltdb/leveldb/LevelDBException$NotSupported", NULL },
+    { "Invalid argument: ", "org/voltdb/leveldb/LevelDBException$InvalidArgument", NULL },
+    { "IO error: ", "org/voltdb/leveldb/LevelDBException$IOError", NULL },
+    { "", "org/voltdb/leveldb/LevelDBException", NULL }
+};
+
+static const size_t status_exception_count = sizeof(status_exceptions) / sizeof(status_exceptions[0]);
+
+static jclass runtime_exception_class = NULL;
+
+static void throw_class(JNIEnv *env, jclass cached, const char *class_name, const char *msg) {
     env->ExceptionClear();
-    jclass newExcCls = env->FindClass("java/lang/RuntimeException");
+    if (cached != NULL) {
+        env->ThrowNew(cached, msg);
+        return;
+    }
+    jclass newExcCls = env->FindClass(class_name);
     if (newExcCls == NULL) {
         /* Unable to find the exception class, give up. */
         assert(false);
         return;
     }
-    env->ThrowNew(newExcCls, msg);
-    env->DeleteLocalRef(newExcCls);
+    env->ThrowNew(newExcCls, msg);
+    env->DeleteLocalRef(newExcCls);
+}
+
+void error(JNIEnv *env, const char *msg) {
+    throw_class(env, runtime_exception_class, "java/lang/RuntimeException", msg);
+}
+
+/* Throws the LevelDBException matching a status message from leveldb. */
+void status_error(JNIEnv *env, const char *errptr) {
+    for (size_t i = 0; i < status_exception_count; i++) {
+        const StatusException &e = status_exceptions[i];
+        if (strncmp(errptr, e.prefix, strlen(e.prefix)) == 0) {
+            throw_class(env, e.cls, e.class_name, errptr);
+            return;
+        }
+    }
+}
+
+/*
+ * Resolve the native address of a direct ByteBuffer and check that the
+ * region [offset, offset + length) lies within its capacity. Throws and
+ * returns NULL if the buffer is not direct or the region is out of range.
+ */
+static char* direct_address(JNIEnv *env, jobject buffer, jint offset, jint length) {
+    char *address = static_cast<char*>(env->GetDirectBufferAddress(buffer));
+    if (address == NULL) {
+        error(env, "LevelDB buffer is not a direct ByteBuffer");
+        return NULL;
+    }
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (offset < 0 || length < 0 || (jlong)offset + length > capacity) {
+        error(env, "LevelDB buffer region is out of bounds");
+        return NULL;
+    }
+    return address + offset;
+}
+
+/*
+ * Views are direct ByteBuffers that are re-pointed at native memory by
+ * rewriting the java.nio.Buffer fields, so a cursor can expose every row
+ * through the same two objects without allocating. These are private
+ * fields of the JDK (address, capacity, limit, position and mark), present
+ * in the OpenJDK and Sun JDKs this is built for; if any is missing, views
+ * are reported as unsupported rather than used.
+ */
+static jfieldID buffer_address_field = NULL;
+static jfieldID buffer_capacity_field = NULL;
+static jfieldID buffer_limit_field = NULL;
+static jfieldID buffer_position_field = NULL;
+static jfieldID buffer_mark_field = NULL;
+
+static bool init_view_fields(JNIEnv *env) {
+    if (buffer_address_field != NULL) {
+        return true;
+    }
+    jclass cls = env->FindClass("java/nio/Buffer");
+    if (cls == NULL) {
+        return false;
+    }
+    buffer_capacity_field = env->GetFieldID(cls, "capacity", "I");
+    buffer_limit_field = env->GetFieldID(cls, "limit", "I");
+    buffer_position_field = env->GetFieldID(cls, "position", "I");
+    buffer_mark_field = env->GetFieldID(cls, "mark", "I");
+    jfieldID address = env->GetFieldID(cls, "address", "J");
+    env->DeleteLocalRef(cls);
+    if (address == NULL || buffer_capacity_field == NULL || buffer_limit_field == NULL ||
+        buffer_position_field == NULL || buffer_mark_field == NULL) {
+        return false;
+    }
+    buffer_address_field = address;
+    return true;
+}
+
+static void point_view(JNIEnv *env, jobject view, const char *data, size_t length) {
+    env->SetLongField(view, buffer_address_field, reinterpret_cast<jlong>(data));
+    env->SetIntField(view, buffer_capacity_field, (jint)length);
+    env->SetIntField(view, buffer_limit_field, (jint)length);
+    env->SetIntField(view, buffer_position_field, 0);
+    env->SetIntField(view, buffer_mark_field, -1);
+}
+
+/*
+ * Marshalling of Java byte arrays. GetByteArrayElements may copy the array
+ * or pin it, and the copy leaks unless it is released, so it is only used
+ * when forced for benchmarking. Arrays up to SMALL_ARRAY_LIMIT bytes are
+ * copied with GetByteArrayRegion into a per-thread scratch buffer. Larger
+ * ones are read in place with GetPrimitiveArrayCritical, but only around
+ * work that is bounded and never blocks, such as appending to a write
+ * batch; anything that may wait on I/O or locks gets a copy instead. The strategy can be forced for
+ * benchmarking with leveldb_set_marshalling.
+ */
+static const int MARSHAL_AUTO = 0;
+static const int MARSHAL_COPY = 1;
+static const int MARSHAL_CRITICAL = 2;
+static const int MARSHAL_ELEMENTS = 3;
+
+static volatile int marshal_strategy = MARSHAL_AUTO;
+
+static const size_t SMALL_ARRAY_LIMIT = 8 * 1024;
+static const size_t SCRATCH_SIZE = 64 * 1024;
+
+/* True if arrays totalling length bytes should be read in place. */
+static bool use_critical(size_t length) {
+    int strategy = marshal_strategy;
+    return strategy == MARSHAL_CRITICAL ||
+        (strategy == MARSHAL_AUTO && length > SMALL_ARRAY_LIMIT);
+}
+
+struct Scratch {
+    char *data;
+    size_t used;
+};
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+static void free_scratch(void *ptr) {
+    Scratch *scratch = static_cast<Scratch*>(ptr);
+    free(scratch->data);
+    delete scratch;
+}
+
+static void create_scratch_key() {
+    pthread_key_create(&scratch_key, free_scratch);
+}
+
+/* The calling thread's scratch buffer, or NULL if it cannot be allocated. */
+static Scratch* thread_scratch() {
+    pthread_once(&scratch_once, create_scratch_key);
+    Scratch *scratch = static_cast<Scratch*>(pthread_getspecific(scratch_key));
+    if (scratch == NULL) {
+        char *data = static_cast<char*>(malloc(SCRATCH_SIZE));
+        if (data == NULL) {
+            return NULL;
+        }
+        scratch = new Scratch();
+        scratch->data = data;
+        scratch->used = 0;
+        pthread_setspecific(scratch_key, scratch);
+    }
+    return scratch;
+}
+
+/*
+ * A private copy of a Java byte array for the duration of a native call.
+ * It is taken from the thread's scratch buffer when there is room, so it
+ * must be released in reverse order of creation, which scoping guarantees.
+ * If the JVM cannot pin or copy the array for the elements or critical
+ * strategy, the OutOfMemoryError is cleared and the array is copied with
+ * GetByteArrayRegion, which needs no JVM memory. If no native memory can be
+ * had for the copy either, data() is NULL and an exception is pending.
+ */
+class ArrayCopy {
+  public:
+    ArrayCopy(JNIEnv *env, jbyteArray array)
+        : env(env), array(array), bytes(NULL), elements(NULL), scratch(NULL) {
+        length = env->GetArrayLength(array);
+        int strategy = marshal_strategy;
+        if (strategy == MARSHAL_ELEMENTS) {
+            elements = env->GetByteArrayElements(array, NULL);
+            if (elements != NULL) {
+                bytes = reinterpret_cast<char*>(elements);
+                return;
+            }
+            env->ExceptionClear();
+        }
+        Scratch *s = thread_scratch();
+        if (s != NULL && SCRATCH_SIZE - s->used >= length) {
+            scratch = s;
+            bytes = s->data + s->used;
+            s->used += length;
+        }
+        else {
+            bytes = static_cast<char*>(malloc(length > 0 ? length : 1));
+            if (bytes == NULL) {
+                error(env, "LevelDB could not allocate a copy of a byte array");
+                return;
+            }
+        }
+        if (length == 0) {
+            return;
+        }
+        if (strategy == MARSHAL_CRITICAL) {
+            void *src = env->GetPrimitiveArrayCritical(array, NULL);
+            if (src != NULL) {
+                memcpy(bytes, src, length);
+                env->ReleasePrimitiveArrayCritical(array, src, JNI_ABORT);
+                return;
+            }
+            env->ExceptionClear();
+        }
+        env->GetByteArrayRegion(array, 0, length, reinterpret_cast<jbyte*>(bytes));
+    }
+
+    ~ArrayCopy() {
+        if (elements != NULL) {
+            env->ReleaseByteArrayElements(array, elements, JNI_ABORT);
+        }
+        else if (scratch != NULL) {
+            scratch->used -= length;
+        }
+        else {
+            free(bytes);
+        }
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+  private:
+    ArrayCopy(const ArrayCopy&);
+    void operator=(const ArrayCopy&);
+
+    JNIEnv *env;
+    jbyteArray array;
+    size_t length;
+    char *bytes;
+    jbyte *elements;
+    Scratch *scratch;
+};
+
+/*
+ * A Java byte array read in place inside a JNI critical region. No other
+ * JNI calls may be made and nothing may block while one is alive, so the
+ * length is read by the caller beforehand, and a second array is only
+ * taken once the first one's data() is known to be non-NULL.
+ */
+class ArrayCritical {
+  public:
+    ArrayCritical(JNIEnv *env, jbyteArray array, size_t length)
+        : env(env), array(array), length(length) {
+        bytes = static_cast<char*>(env->GetPrimitiveArrayCritical(array, NULL));
+    }
+
+    ~ArrayCritical() {
+        if (bytes != NULL) {
+            env->ReleasePrimitiveArrayCritical(array, bytes, JNI_ABORT);
+        }
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+  private:
+    ArrayCritical(const ArrayCritical&);
+    void operator=(const ArrayCritical&);
+
+    JNIEnv *env;
+    jbyteArray array;
+    size_t length;
+    char *bytes;
+};
+
+/* Copies the contents of a Java byte array into dst. */
+static void copy_array(JNIEnv *env, jbyteArray array, std::string &dst) {
+    jsize length = env->GetArrayLength(array);
+    dst.resize(length);
+    if (length > 0) {
+        env->GetByteArrayRegion(array, 0, length, (jbyte*)&dst[0]);
+    }
+}
+
+/*
+ * Packed buffers exchanged with Java use big-endian 32-bit lengths so they
+ * can be read with the default ByteBuffer byte order.
+ */
+static inline void encode_int32(char *dst, uint32_t value) {
+    dst[0] = (char)(value >> 24);
+    dst[1] = (char)(value >> 16);
+    dst[2] = (char)(value >> 8);
+    dst[3] = (char)value;
+}
+
+static inline uint32_t decode_int32(const char *src) {
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(src);
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void append_int32(std::vector<char> &dst, uint32_t value) {
+    size_t pos = dst.size();
+    dst.resize(pos + 4);
+    encode_int32(&dst[pos], value);
+}
+
+/* Operation tags of a packed write buffer, as written by WriteBatchBuffer. */
+static const int PACKED_OP_DELETE = 0;
+static const int PACKED_OP_PUT = 1;
+
+/*
+ * Walks the operations of a packed write buffer. Each operation is a tag
+ * byte, a 32-bit key length and the key, and for puts a 32-bit value length
+ * and the value. Operations are appended to batch unless it is NULL.
+ * Returns an error message if the buffer is malformed, NULL otherwise.
+ */
+static const char* scan_packed_ops(leveldb_writebatch_t *batch, const char *p, size_t length) {
+    const char *limit = p + length;
+    while (p < limit) {
+        int tag = *p++;
+        if (tag != PACKED_OP_PUT && tag != PACKED_OP_DELETE) {
+            return "LevelDB packed write buffer has an unknown operation";
+        }
+        if (limit - p < 4) {
+            return "LevelDB packed write buffer is truncated";
+        }
+        uint32_t keylen = decode_int32(p);
+        p += 4;
+        if ((size_t)(limit - p) < keylen) {
+            return "LevelDB packed write buffer is truncated";
+        }
+        const char *key = p;
+        p += keylen;
+        if (tag == PACKED_OP_DELETE) {
+            if (batch != NULL) leveldb_writebatch_delete(batch, key, keylen);
+            continue;
+        }
+        if (limit - p < 4) {
+            return "LevelDB packed write buffer is truncated";
+        }
+        uint32_t vallen = decode_int32(p);
+        p += 4;
+        if ((size_t)(limit - p) < vallen) {
+            return "LevelDB packed write buffer is truncated";
+        }
+        if (batch != NULL) leveldb_writebatch_put(batch, key, keylen, p, vallen);
+        p += vallen;
+    }
+    return NULL;
+}
+
+/*
+ * Appends the operations of a packed write buffer to batch. The whole buffer
+ * is validated first, so a malformed buffer leaves batch untouched.
+ */
+static const char* append_packed_ops(leveldb_writebatch_t *batch, const char *p, size_t length) {
+    const char *msg = scan_packed_ops(NULL, p, length);
+    if (msg != NULL) return msg;
+    return scan_packed_ops(batch, p, length);
+}
+
+/*
+ * Dumps a batch in the packed write buffer format through
+ * leveldb_writebatch_iterate, or only measures it if dst is NULL.
+ */
+struct PackedDumpWriter {
+    char *dst;
+    size_t size;
+};
+
+static void dump_put(void *state, const char *k, size_t klen, const char *v, size_t vlen) {
+    PackedDumpWriter *writer = static_cast<PackedDumpWriter*>(state);
+    if (writer->dst != NULL) {
+        char *p = writer->dst + writer->size;
+        *p++ = (char)PACKED_OP_PUT;
+        encode_int32(p, klen);
+        memcpy(p + 4, k, klen);
+        p += 4 + klen;
+        encode_int32(p, vlen);
+        memcpy(p + 4, v, vlen);
+    }
+    writer->size += 9 + klen + vlen;
+}
+
+static void dump_delete(void *state, const char *k, size_t klen) {
+    PackedDumpWriter *writer = static_cast<PackedDumpWriter*>(state);
+    if (writer->dst != NULL) {
+        char *p = writer->dst + writer->size;
+        *p++ = (char)PACKED_OP_DELETE;
+        encode_int32(p, klen);
+        memcpy(p + 4, k, klen);
+    }
+    writer->size += 5 + klen;
+}
+
+static size_t dump_packed_ops(leveldb_writebatch_t *batch, char *dst) {
+    PackedDumpWriter writer = { dst, 0 };
+    leveldb_writebatch_iterate(batch, &writer, dump_put, dump_delete);
+    return writer.size;
+}
+
+/*
+ * The native WriteBatch encoding: an 8-byte sequence number and a 4-byte
+ * record count, both little-endian, then per record a tag byte and a
+ * varint32-prefixed key, followed for puts by a varint32-prefixed value.
+ * leveldb_writebatch_t holds a WriteBatch as its only member, and
+ * SetContents and Sequence only pass Slices and integers, so they can be
+ * declared here without the leveldb internal headers.
+ */
+namespace leveldb {
+class WriteBatch;
+
+class Slice {
+  public:
+    Slice(const char *data, size_t size) : data_(data), size_(size) {}
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+  private:
+    const char *data_;
+    size_t size_;
+};
+
+class WriteBatchInternal {
+  public:
+    static void SetContents(WriteBatch *batch, const Slice &contents);
+    static uint64_t Sequence(const WriteBatch *batch);
+};
+}
+
+static const size_t BATCH_HEADER_SIZE = 12;
+static const int BATCH_TAG_DELETE = 0;
+static const int BATCH_TAG_PUT = 1;
+
+static inline size_t varint32_length(uint32_t value) {
+    size_t length = 1;
+    while (value >= 128) {
+        value >>= 7;
+        length++;
+    }
+    return length;
+}
+
+static inline char* encode_varint32(char *dst, uint32_t value) {
+    while (value >= 128) {
+        *dst++ = (char)(value | 128);
+        value >>= 7;
+    }
+    *dst++ = (char)value;
+    return dst;
+}
+
+static inline const char* decode_varint32(const char *p, const char *limit, uint32_t *value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift <= 28 && p < limit; shift += 7) {
+        uint32_t byte = (unsigned char)*p++;
+        result |= (byte & 127) << shift;
+        if (byte < 128) {
+            *value = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Encodes records into dst, or only measures them if dst is NULL. The
+ * count field is filled in by encode_batch_rep once all records are seen.
+ */
+struct BatchRepWriter {
+    char *dst;
+    size_t size;
+    uint32_t count;
+};
+
+static void rep_put(void *state, const char *k, size_t klen, const char *v, size_t vlen) {
+    BatchRepWriter *writer = static_cast<BatchRepWriter*>(state);
+    if (writer->dst != NULL) {
+        char *p = writer->dst + writer->size;
+        *p++ = (char)BATCH_TAG_PUT;
+        p = encode_varint32(p, klen);
+        memcpy(p, k, klen);
+        p = encode_varint32(p + klen, vlen);
+        memcpy(p, v, vlen);
+    }
+    writer->size += 1 + varint32_length(klen) + klen + varint32_length(vlen) + vlen;
+    writer->count++;
+}
+
+static void rep_delete(void *state, const char *k, size_t klen) {
+    BatchRepWriter *writer = static_cast<BatchRepWriter*>(state);
+    if (writer->dst != NULL) {
+        char *p = writer->dst + writer->size;
+        *p++ = (char)BATCH_TAG_DELETE;
+        p = encode_varint32(p, klen);
+        memcpy(p, k, klen);
+    }
+    writer->size += 1 + varint32_length(klen) + klen;
+    writer->count++;
+}
+
+/*
+ * Writes the native encoding of batch to dst and returns its size. With a
+ * NULL dst only the size is computed.
+ */
+static size_t encode_batch_rep(leveldb_writebatch_t *batch, char *dst) {
+    BatchRepWriter writer = { dst, BATCH_HEADER_SIZE, 0 };
+    leveldb_writebatch_iterate(batch, &writer, rep_put, rep_delete);
+    if (dst != NULL) {
+        uint64_t sequence = leveldb::WriteBatchInternal::Sequence(
+            reinterpret_cast<leveldb::WriteBatch*>(batch));
+        for (int i = 0; i < 8; i++) {
+            dst[i] = (char)(sequence >> (8 * i));
+        }
+        for (int i = 0; i < 4; i++) {
+            dst[8 + i] = (char)(writer.count >> (8 * i));
+        }
+    }
+    return writer.size;
+}
+
+/*
+ * Checks that p holds a well formed native batch encoding, so a damaged
+ * replication stream is rejected before it reaches the log. Returns an
+ * error message if not, NULL otherwise.
+ */
+static const char* check_batch_rep(const char *p, size_t length) {
+    if (length < BATCH_HEADER_SIZE) {
+        return "Corruption: malformed WriteBatch (too small)";
+    }
+    uint32_t count = 0;
+    for (int i = 0; i < 4; i++) {
+        count |= (uint32_t)(unsigned char)p[8 + i] << (8 * i);
+    }
+    const char *limit = p + length;
+    p += BATCH_HEADER_SIZE;
+    uint32_t found = 0;
+    while (p < limit) {
+        int tag = *p++;
+        if (tag != BATCH_TAG_PUT && tag != BATCH_TAG_DELETE) {
+            return "Corruption: unknown WriteBatch tag";
+        }
+        int fields = tag == BATCH_TAG_PUT ? 2 : 1;
+        for (int i = 0; i < fields; i++) {
+            uint32_t fieldlen;
+            p = decode_varint32(p, limit, &fieldlen);
+            if (p == NULL || (size_t)(limit - p) < fieldlen) {
+                return "Corruption: bad WriteBatch record";
+            }
+            p += fieldlen;
+        }
+        found++;
+    }
+    if (found != count) {
+        return "Corruption: WriteBatch has wrong count";
+    }
+    return NULL;
+}
+
+/* Creates a batch holding a copy of the native encoding at p. */
+static leveldb_writebatch_t* batch_from_rep(const char *p, size_t length) {
+    leveldb_writebatch_t *batch = leveldb_writebatch_create();
+    leveldb::WriteBatchInternal::SetContents(
+        reinterpret_cast<leveldb::WriteBatch*>(batch), leveldb::Slice(p, length));
+    return batch;
+}
+
+/*
+ * A key borrowed from a caller-owned buffer, remembering its position in
+ * the caller's request so results can be returned in request order.
+ */
+struct KeyRef {
+    const char *data;
+    size_t length;
+    size_t index;
+};
+
+/* Bytewise ordering, matching the default leveldb comparator. */
+static inline int compare_keys(const char *a, size_t alen, const char *b, size_t blen) {
+    int r = memcmp(a, b, std::min(alen, blen));
+    if (r == 0) {
+        if (alen < blen) r = -1;
+        else if (alen > blen) r = +1;
+    }
+    return r;
+}
+
+static uint32_t hash_key(const char *key, size_t keylen) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < keylen; i++) {
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool key_ref_less(const KeyRef &a, const KeyRef &b) {
+    return compare_keys(a.data, a.length, b.data, b.length) < 0;
+}
+
+/*
+ * Key range [start, end) for native scans; a NULL bound is unbounded. A
+ * reverse scan walks the same range from its end towards start. When prefix
+ * is set the scan also ends at the first key not starting with it.
+ */
+struct ScanBounds {
+    const char *start;
+    size_t start_length;
+    const char *end;
+    size_t end_length;
+    const char *prefix;
+    size_t prefix_length;
+    bool reverse;
+};
+
+/* True while the iterator sits on an entry the scan should still return. */
+static bool scan_valid(leveldb_iterator_t *iter, const ScanBounds *bounds) {
+    if (!leveldb_iter_valid(iter)) {
+        return false;
+    }
+    if (bounds == NULL) {
+        return true;
+    }
+    size_t keylen = 0;
+    const char *key = leveldb_iter_key(iter, &keylen);
+    if (bounds->prefix != NULL &&
+        (keylen < bounds->prefix_length || memcmp(key, bounds->prefix, bounds->prefix_length) != 0)) {
+        return false;
+    }
+    if (bounds->reverse) {
+        return bounds->start == NULL ||
+            compare_keys(key, keylen, bounds->start, bounds->start_length) >= 0;
+    }
+    return bounds->end == NULL ||
+        compare_keys(key, keylen, bounds->end, bounds->end_length) < 0;
+}
+
+/* Positions the iterator on the first entry of the scan. */
+static void scan_seek(leveldb_iterator_t *iter, const ScanBounds *bounds) {
+    if (!bounds->reverse) {
+        if (bounds->start == NULL) {
+            leveldb_iter_seek_to_first(iter);
+        }
+        else {
+            leveldb_iter_seek(iter, bounds->start, bounds->start_length);
+        }
+        return;
+    }
+    if (bounds->end == NULL) {
+        leveldb_iter_seek_to_last(iter);
+        return;
+    }
+    // the end bound is exclusive, so step back from the first key >= end
+    leveldb_iter_seek(iter, bounds->end, bounds->end_length);
+    if (leveldb_iter_valid(iter)) {
+        leveldb_iter_prev(iter);
+    }
+    else {
+        leveldb_iter_seek_to_last(iter);
+    }
+}
+
+/*
+ * Packs entries from the iterator's current position into dst, each as a
+ * 32-bit key length, the key, a 32-bit value length and the value, and
+ * moves the iterator past every entry packed. Stops when the iterator
+ * leaves bounds (NULL for none), max_entries have been packed or the next
+ * entry does not fit in capacity bytes. Returns the number of entries
+ * packed and stores the encoded size of the first entry that did not fit,
+ * if any, in *pending_size, and the bytes packed in *used_size unless it
+ * is NULL.
+ */
+static jint pack_iter_entries(leveldb_iterator_t *iter, const ScanBounds *bounds,
+                              char *dst, size_t capacity,
+                              jint max_entries, size_t *pending_size, size_t *used_size) {
+    size_t used = 0;
+    jint count = 0;
+    *pending_size = 0;
+    while (count < max_entries && scan_valid(iter, bounds)) {
+        size_t keylen = 0, vallen = 0;
+        const char *key = leveldb_iter_key(iter, &keylen);
+        const char *value = leveldb_iter_value(iter, &vallen);
+        size_t entry_size = 8 + keylen + vallen;
+        if (capacity - used < entry_size) {
+            *pending_size = entry_size;
+            break;
+        }
+        encode_int32(dst + used, keylen);
+        memcpy(dst + used + 4, key, keylen);
+        encode_int32(dst + used + 4 + keylen, vallen);
+        memcpy(dst + used + 8 + keylen, value, vallen);
+        used += entry_size;
+        count++;
+        if (bounds != NULL && bounds->reverse) {
+            leveldb_iter_prev(iter);
+        }
+        else {
+            leveldb_iter_next(iter);
+        }
+    }
+    if (used_size != NULL) {
+        *used_size = used;
+    }
+    return count;
+}
+
+/*
+ * A paged range scan: the iterator it owns, copies of the bounds, and the
+ * number of entries the caller still wants (-1 for no limit).
+ */
+struct RangeScan {
+    leveldb_iterator_t *iter;
+    std::string start;
+    std::string end;
+    ScanBounds bounds;
+    jlong remaining;
+};
+
+/*
+ * leveldb_readoptions_t holds a leveldb::ReadOptions as its only member.
+ * The Bloom filter and row cache need its fill_cache and snapshot fields.
+ */
+struct ReadOptionsLayout {
+    bool verify_checksums;
+    bool fill_cache;
+    const void *snapshot;
+};
+
+/*
+ * Initializes a lock that is read by the operations using a per-database
+ * structure and written to change or free it. glibc prefers readers by
+ * default, which lets a steady stream of operations starve the writer, so
+ * writers are preferred where the platform allows. No thread may then
+ * take the read lock twice.
+ */
+static void init_writer_rwlock(pthread_rwlock_t *lock) {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef LINUX
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+}
+
+/*
+ * Bloom filter. An optional filter over the keys of one database, so point
+ * reads and multi-gets can answer keys that were never written without
+ * going to leveldb. It is built by a key scan or loaded from a sidecar file
+ * written by leveldb_bloom_save. Writes add their keys before they reach
+ * leveldb and hold the filter's own lock until they return, so a rebuild
+ * either scans a key or sees it being added. The lock is per filter and
+ * prefers writers where the platform allows, so a rebuild, close or destroy
+ * waits only for the operations already in flight on that database, not
+ * for a stream of them. Deleted keys stay in the filter until
+ * the next rebuild. Reads under a snapshot bypass it, since a snapshot may
+ * still see keys the last rebuild dropped. Bits are set with an atomic or
+ * and tested with plain loads.
+ */
+static const int BLOOM_STAT_NEGATIVES = 0;
+static const int BLOOM_STAT_PASSES = 1;
+static const int BLOOM_STAT_FALSE_POSITIVES = 2;
+static const int BLOOM_STAT_KEYS = 3;
+static const int BLOOM_STAT_DELETES = 4;
+static const int BLOOM_STAT_REBUILDS = 5;
+static const int BLOOM_STAT_BITS = 6;
+static const int BLOOM_STAT_COUNT = 7;
+
+struct BloomBits {
+    std::vector<unsigned char> bytes;
+    size_t bits;
+    int probes;
+};
+
+struct Bloom {
+    leveldb_t *db;
+    int bits_per_key;
+    pthread_rwlock_t lock;  // read by users of the filter, written to change it
+    bool closed;            // the database was closed
+    BloomBits *current;     // NULL until the first build, passing every key
+    bool rebuilding;
+    pthread_mutex_t mutex;
+    std::vector<uint32_t> added;  // hashes of keys written during a rebuild
+    BloomBits *next;              // or, once built, the filter they go to
+    jlong stats[BLOOM_STAT_BITS];
+};
+
+/* Guards blooms only, and is taken before a filter's own lock. */
+static pthread_rwlock_t bloom_lock = PTHREAD_RWLOCK_INITIALIZER;
+static std::map<leveldb_t*, Bloom*> blooms;
+static volatile int bloom_count = 0;
+
+/* Sizes a filter for the hashed keys and sets their bits. */
+static BloomBits* bloom_make(const std::vector<uint32_t> &hashes, int bits_per_key) {
+    BloomBits *filter = new BloomBits();
+    size_t bits = std::max(hashes.size() * bits_per_key, (size_t)64);
+    filter->bytes.assign((bits + 7) / 8, 0);
+    filter->bits = filter->bytes.size() * 8;
+    // ln 2 * bits per key probes minimize the false positive rate
+    filter->probes = std::min(std::max(bits_per_key * 69 / 100, 1), 30);
+    for (size_t i = 0; i < hashes.size(); i++) {
+        uint32_t hash = hashes[i];
+        uint32_t delta = (hash >> 17) | (hash << 15);
+        for (int j = 0; j < filter->probes; j++) {
+            size_t bit = hash % filter->bits;
+            filter->bytes[bit / 8] |= (unsigned char)(1 << (bit % 8));
+            hash += delta;
+        }
+    }
+    return filter;
+}
+
+static void bloom_set(BloomBits *filter, uint32_t hash) {
+    uint32_t delta = (hash >> 17) | (hash << 15);
+    for (int j = 0; j < filter->probes; j++) {
+        size_t bit = hash % filter->bits;
+        __sync_fetch_and_or(&filter->bytes[bit / 8], (unsigned char)(1 << (bit % 8)));
+        hash += delta;
+    }
+}
+
+static bool bloom_test(const BloomBits *filter, uint32_t hash) {
+    const volatile unsigned char *bytes = &filter->bytes[0];
+    uint32_t delta = (hash >> 17) | (hash << 15);
+    for (int j = 0; j < filter->probes; j++) {
+        size_t bit = hash % filter->bits;
+        if ((bytes[bit / 8] & (1 << (bit % 8))) == 0) {
+            return false;
+        }
+        hash += delta;
+    }
+    return true;
+}
+
+/*
+ * Finds the Bloom filter of a database, holding its read lock for as long
+ * as it is in use. The registry lock is only held for the lookup. Writes
+ * keep the filter lock until leveldb has applied them. A thread must not
+ * hold two references to the same filter, as a waiting writer blocks the
+ * second.
+ */
+class BloomRef {
+  public:
+    explicit BloomRef(leveldb_t *db) : bloom_(NULL) {
+        if (bloom_count == 0) {
+            return;
+        }
+        pthread_rwlock_rdlock(&bloom_lock);
+        std::map<leveldb_t*, Bloom*>::const_iterator it = blooms.find(db);
+        if (it != blooms.end()) {
+            bloom_ = it->second;
+            pthread_rwlock_rdlock(&bloom_->lock);
+        }
+        pthread_rwlock_unlock(&bloom_lock);
+    }
+    ~BloomRef() {
+        if (bloom_ != NULL) {
+            pthread_rwlock_unlock(&bloom_->lock);
+        }
+    }
+    Bloom* get() const { return bloom_; }
+  private:
+    Bloom *bloom_;
+};
+
+/* Adds a key about to be written. Called with the filter read lock held. */
+static void bloom_add(Bloom *bloom, const char *key, size_t keylen) {
+    uint32_t hash = hash_key(key, keylen);
+    if (bloom->current != NULL) {
+        bloom_set(bloom->current, hash);
+    }
+    __sync_fetch_and_add(&bloom->stats[BLOOM_STAT_KEYS], 1);
+    if (bloom->rebuilding) {
+        pthread_mutex_lock(&bloom->mutex);
+        if (bloom->next != NULL) {
+            bloom_set(bloom->next, hash);
+        }
+        else {
+            bloom->added.push_back(hash);
+        }
+        pthread_mutex_unlock(&bloom->mutex);
+    }
+}
+
+static void bloom_add_put(void *state, const char *k, size_t klen, const char *v, size_t vlen) {
+    bloom_add(static_cast<Bloom*>(state), k, klen);
+}
+
+static void bloom_add_delete(void *state, const char *k, size_t klen) {
+    __sync_fetch_and_add(&static_cast<Bloom*>(state)->stats[BLOOM_STAT_DELETES], 1);
+}
+
+/*
+ * False if key was definitely never written. bloom may be NULL. Reads under
+ * a snapshot always pass.
+ */
+static bool bloom_may_contain(Bloom *bloom, const leveldb_readoptions_t *options,
+                              const char *key, size_t keylen) {
+    if (bloom == NULL || bloom->current == NULL ||
+        reinterpret_cast<const ReadOptionsLayout*>(options)->snapshot != NULL) {
+        return true;
+    }
+    if (!bloom_test(bloom->current, hash_key(key, keylen))) {
+        __sync_fetch_and_add(&bloom->stats[BLOOM_STAT_NEGATIVES], 1);
+        return false;
+    }
+    __sync_fetch_and_add(&bloom->stats[BLOOM_STAT_PASSES], 1);
+    return true;
+}
+
+/* Counts a read the filter passed that found nothing. */
+static void bloom_note_miss(Bloom *bloom, const leveldb_readoptions_t *options) {
+    if (bloom != NULL && bloom->current != NULL &&
+        reinterpret_cast<const ReadOptionsLayout*>(options)->snapshot == NULL) {
+        __sync_fetch_and_add(&bloom->stats[BLOOM_STAT_FALSE_POSITIVES], 1);
+    }
+}
+
+/*
+ * Rebuilds the filter from a scan of the database, sized for the keys
+ * found. Keys written during the scan are collected and added as well. The
+ * scan never reads under a snapshot, which could miss keys written before
+ * the rebuild started, and does not fill the block cache; only
+ * verify_checksums is taken from options. Returns false and sets msg on
+ * failure, leaving the old filter.
+ */
+static bool bloom_rebuild(Bloom *bloom, const leveldb_readoptions_t *options, std::string &msg) {
+    pthread_rwlock_wrlock(&bloom->lock);
+    leveldb_t *db = bloom->db;
+    bool closed = bloom->closed;
+    bool busy = bloom->rebuilding;
+    if (!closed) {
+        bloom->rebuilding = true;
+    }
+    pthread_rwlock_unlock(&bloom->lock);
+    if (closed) {
+        msg = "LevelDB Bloom filter database is closed";
+        return false;
+    }
+    if (busy) {
+        msg = "LevelDB Bloom filter is already being rebuilt";
+        return false;
+    }
+
+    // every write that started before this point has been applied
+    leveldb_readoptions_t *scan_options = leveldb_readoptions_create();
+    leveldb_readoptions_set_verify_checksums(
+        scan_options, reinterpret_cast<const ReadOptionsLayout*>(options)->verify_checksums);
+    leveldb_readoptions_set_fill_cache(scan_options, 0);
+
+    std::vector<uint32_t> hashes;
+    char *errptr = NULL;
+    leveldb_iterator_t *iter = leveldb_create_iterator(db, scan_options);
+    for (leveldb_iter_seek_to_first(iter); leveldb_iter_valid(iter); leveldb_iter_next(iter)) {
+        size_t keylen = 0;
+        const char *key = leveldb_iter_key(iter, &keylen);
+        hashes.push_back(hash_key(key, keylen));
+    }
+    leveldb_iter_get_error(iter, &errptr);
+    leveldb_iter_destroy(iter);
+    leveldb_readoptions_destroy(scan_options);
+
+    BloomBits *filter = NULL;
+    pthread_mutex_lock(&bloom->mutex);
+    if (errptr == NULL) {
+        hashes.insert(hashes.end(), bloom->added.begin(), bloom->added.end());
+        filter = bloom_make(hashes, bloom->bits_per_key);
+        bloom->next = filter;
+    }
+    std::vector<uint32_t>().swap(bloom->added);
+    pthread_mutex_unlock(&bloom->mutex);
+
+    pthread_rwlock_wrlock(&bloom->lock);
+    BloomBits *old = NULL;
+    if (filter != NULL) {
+        old = bloom->current;
+        bloom->current = filter;
+        bloom->stats[BLOOM_STAT_KEYS] = hashes.size();
+        bloom->stats[BLOOM_STAT_DELETES] = 0;
+        bloom->stats[BLOOM_STAT_REBUILDS]++;
+    }
+    bloom->next = NULL;
+    bloom->rebuilding = false;
+    pthread_rwlock_unlock(&bloom->lock);
+    delete old;
+
+    if (errptr != NULL) {
+        msg = errptr;
+        free(errptr);
+        return false;
+    }
+    return true;
+}
+
+static Bloom* bloom_new(leveldb_t *db, int bits_per_key) {
+    Bloom *bloom = new Bloom();
+    bloom->db = db;
+    bloom->bits_per_key = bits_per_key;
+    init_writer_rwlock(&bloom->lock);
+    bloom->closed = false;
+    bloom->current = NULL;
+    bloom->rebuilding = false;
+    bloom->next = NULL;
+    pthread_mutex_init(&bloom->mutex, NULL);
+    memset(bloom->stats, 0, sizeof(bloom->stats));
+    return bloom;
+}
+
+static void bloom_free(Bloom *bloom) {
+    pthread_rwlock_destroy(&bloom->lock);
+    pthread_mutex_destroy(&bloom->mutex);
+    delete bloom->current;
+    delete bloom;
+}
+
+/* Attaches bloom to its database. Fails if the database has one already. */
+static bool bloom_attach(Bloom *bloom) {
+    pthread_rwlock_wrlock(&bloom_lock);
+    bool attached = blooms.insert(std::make_pair(bloom->db, bloom)).second;
+    if (attached) {
+        bloom_count++;
+    }
+    pthread_rwlock_unlock(&bloom_lock);
+    return attached;
+}
+
+/*
+ * Detaches bloom from its database, if still open, and frees it once the
+ * operations using it have finished.
+ */
+static void bloom_detach(Bloom *bloom) {
+    pthread_rwlock_wrlock(&bloom_lock);
+    std::map<leveldb_t*, Bloom*>::iterator it = blooms.find(bloom->db);
+    if (it != blooms.end() && it->second == bloom) {
+        blooms.erase(it);
+        bloom_count--;
+    }
+    pthread_rwlock_unlock(&bloom_lock);
+    pthread_rwlock_wrlock(&bloom->lock);
+    pthread_rwlock_unlock(&bloom->lock);
+    bloom_free(bloom);
+}
+
+/* Removes the keys that were definitely never written from keys. bloom may be NULL. */
+static void bloom_drop_absent(Bloom *bloom, const leveldb_readoptions_t *options,
+                              std::vector<KeyRef> &keys) {
+    if (bloom == NULL) {
+        return;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (bloom_may_contain(bloom, options, keys[i].data, keys[i].length)) {
+            keys[kept++] = keys[i];
+        }
+    }
+    keys.resize(kept);
+}
+
+/*
+ * Looks up count sorted keys through a single iterator, storing what is
+ * found at each key's index in values and found. The iterator only ever
+ * moves forward, and a seek is skipped whenever it already sits at or past
+ * the next key. Returns false and sets *errptr if the iterator reported an
+ * error.
+ */
+static bool multiget_sorted(leveldb_t *db, const leveldb_readoptions_t *options,
+                            const KeyRef *keys, size_t count,
+                            std::vector<std::string> &values, std::vector<char> &found, char **errptr) {
+    leveldb_iterator_t *iter = leveldb_create_iterator(db, options);
+    bool positioned = false;
+    for (size_t i = 0; i < count; i++) {
+        const KeyRef &key = keys[i];
+        size_t curlen = 0;
+        const char *cur = NULL;
+        if (positioned && leveldb_iter_valid(iter)) {
+            cur = leveldb_iter_key(iter, &curlen);
+        }
+        if (cur == NULL || compare_keys(cur, curlen, key.data, key.length) < 0) {
+            leveldb_iter_seek(iter, key.data, key.length);
+            positioned = true;
+            if (!leveldb_iter_valid(iter)) {
+                // every remaining key sorts past the end as well
+                break;
+            }
+            cur = leveldb_iter_key(iter, &curlen);
+        }
+        if (compare_keys(cur, curlen, key.data, key.length) == 0) {
+            size_t vallen = 0;
+            const char *value = leveldb_iter_value(iter, &vallen);
+            values[key.index].assign(value, vallen);
+            found[key.index] = 1;
+        }
+    }
+    leveldb_iter_get_error(iter, errptr);
+    leveldb_iter_destroy(iter);
+    return *errptr == NULL;
+}
+
+/*
+ * Encodes multi-get results in request order as a flag byte (1 = found)
+ * followed, for found keys, by a 32-bit length and the value bytes.
+ */
+static void encode_multiget(const std::vector<std::string> &values, const std::vector<char> &found,
+                            std::vector<char> &result) {
+    size_t total = values.size();
+    for (size_t i = 0; i < values.size(); i++) {
+        if (found[i]) total += 4 + values[i].size();
+    }
+    result.clear();
+    result.reserve(total);
+    for (size_t i = 0; i < values.size(); i++) {
+        result.push_back(found[i]);
+        if (found[i]) {
+            append_int32(result, values[i].size());
+            result.insert(result.end(), values[i].begin(), values[i].end());
+        }
+    }
+}
+
+/*
+ * Copies the keys of a byte[][] into one native buffer, rather than pinning
+ * each array, and points refs at them. Throws and returns false if a key
+ * is null.
+ */
+static bool gather_keys(JNIEnv *env, jobjectArray keys, std::vector<char> &key_bytes,
+                        std::vector<KeyRef> &refs) {
+    jsize count = env->GetArrayLength(keys);
+    std::vector<jsize> lengths(count);
+    for (jsize i = 0; i < count; i++) {
+        jbyteArray key = (jbyteArray)env->GetObjectArrayElement(keys, i);
+        if (key == NULL) {
+            error(env, "LevelDB key is NULL");
+            return false;
+        }
+        lengths[i] = env->GetArrayLength(key);
+        size_t pos = key_bytes.size();
+        key_bytes.resize(pos + lengths[i]);
+        if (lengths[i] > 0) {
+            env->GetByteArrayRegion(key, 0, lengths[i], (jbyte*)&key_bytes[pos]);
+        }
+        env->DeleteLocalRef(key);
+    }
+
+    refs.resize(count);
+    size_t pos = 0;
+    for (jsize i = 0; i < count; i++) {
+        refs[i].data = key_bytes.empty() ? "" : &key_bytes[pos];
+        refs[i].length = lengths[i];
+        refs[i].index = i;
+        pos += lengths[i];
+    }
+    return true;
+}
+
+/*
+ * Points refs at count keys packed at p, each a 32-bit length followed by
+ * the key bytes. Returns an error message, or NULL on success.
+ */
+static const char* parse_packed_keys(const char *p, size_t length, jint count, std::vector<KeyRef> &refs) {
+    refs.resize(count < 0 ? 0 : count);
+    const char *limit = p + length;
+    for (jint i = 0; i < count; i++) {
+        if (limit - p < 4) {
+            return "LevelDB packed key buffer is truncated";
+        }
+        uint32_t keylen = decode_int32(p);
+        p += 4;
+        if ((size_t)(limit - p) < keylen) {
+            return "LevelDB packed key buffer is truncated";
+        }
+        refs[i].data = p;
+        refs[i].length = keylen;
+        refs[i].index = i;
+        p += keylen;
+    }
+    return NULL;
+}
+
+/*
+ * Looks up all keys, sorted, through a single iterator and encodes the
+ * results with encode_multiget. Keys the Bloom filter of db rules out are
+ * not looked up. Returns false and sets *errptr if the iterator reported
+ * an error.
+ */
+static bool multiget(leveldb_t *db, const leveldb_readoptions_t *options,
+                     std::vector<KeyRef> &keys, std::vector<char> &result, char **errptr) {
+    std::vector<std::string> values(keys.size());
+    std::vector<char> found(keys.size(), 0);
+
+    {
+        BloomRef bloom(db);
+        bloom_drop_absent(bloom.get(), options, keys);
+    }
+    std::sort(keys.begin(), keys.end(), key_ref_less);
+
+    if (!multiget_sorted(db, options, keys.empty() ? NULL : &keys[0], keys.size(), values, found, errptr)) {
+        return false;
+    }
+    encode_multiget(values, found, result);
+    return true;
+}
+
+/*
+ * Chained hash table of keyed entries, shared by the row cache and the
+ * scan-resistant block cache, whose entries start with a ChainedEntry.
+ * Buckets are a power of two, picked by the hash bits above those that pick
+ * a shard. Callers hold the lock of the shard that owns the table.
+ */
+struct ChainedEntry {
+    ChainedEntry *chain;
+    uint32_t hash;
+    std::string key;
+};
+
+struct ChainedTable {
+    std::vector<ChainedEntry*> buckets;
+    size_t entries;
+};
+
+static void chained_init(ChainedTable *table) {
+    table->buckets.assign(16, (ChainedEntry*)NULL);
+    table->entries = 0;
+}
+
+/* The chain slot holding key, or the empty slot at the end of its chain. */
+static ChainedEntry** chained_slot(ChainedTable *table, uint32_t hash, const char *key, size_t keylen) {
+    ChainedEntry **slot = &table->buckets[(hash >> 8) & (table->buckets.size() - 1)];
+    while (*slot != NULL &&
+           ((*slot)->hash != hash || compare_keys((*slot)->key.data(), (*slot)->key.size(), key, keylen) != 0)) {
+        slot = &(*slot)->chain;
+    }
+    return slot;
+}
+
+/* The chain slot holding entry. */
+static ChainedEntry** chained_slot_of(ChainedTable *table, ChainedEntry *entry) {
+    return chained_slot(table, entry->hash, entry->key.data(), entry->key.size());
+}
+
+/* Links entry into a slot chained_slot returned for its key. */
+static void chained_link(ChainedTable *table, ChainedEntry **slot, ChainedEntry *entry) {
+    entry->chain = *slot;
+    *slot = entry;
+    table->entries++;
+}
+
+/* Unlinks the entry in slot and returns it. */
+static ChainedEntry* chained_unlink(ChainedTable *table, ChainedEntry **slot) {
+    ChainedEntry *entry = *slot;
+    *slot = entry->chain;
+    table->entries--;
+    return entry;
+}
+
+/* Doubles the bucket array once chains average more than one entry. */
+static void chained_grow(ChainedTable *table) {
+    if (table->entries <= table->buckets.size()) {
+        return;
+    }
+    std::vector<ChainedEntry*> buckets(table->buckets.size() * 2, (ChainedEntry*)NULL);
+    for (size_t i = 0; i < table->buckets.size(); i++) {
+        ChainedEntry *entry = table->buckets[i];
+        while (entry != NULL) {
+            ChainedEntry *chain = entry->chain;
+            ChainedEntry **head = &buckets[(entry->hash >> 8) & (buckets.size() - 1)];
+            entry->chain = *head;
+            *head = entry;
+            entry = chain;
+        }
+    }
+    table->buckets.swap(buckets);
+}
+
+/*
+ * Row cache. An optional cache of key to value copies in front of the point
+ * reads of one database. It is split into shards, each a chained hash table
+ * with its own mutex, LRU list and share of the memory budget. Reads under
+ * a snapshot bypass it, and reads with fill_cache off use it without
+ * filling it. Every write in this file drops the keys it wrote once the
+ * write returns. A read that missed only fills its shard if no key of
+ * that shard was dropped since the miss, so a value read before a
+ * concurrent write is never cached after it. Caches are found by database
+ * handle; attach one before the database is shared between threads. Each
+ * cache has its own lock, as a Bloom filter does, so closing the database
+ * or destroying the cache waits only for the reads and writes in flight
+ * on it.
+ */
+static const int ROWCACHE_STAT_HITS = 0;
+static const int ROWCACHE_STAT_MISSES = 1;
+static const int ROWCACHE_STAT_BYPASSES = 2;
+static const int ROWCACHE_STAT_INSERTS = 3;
+static const int ROWCACHE_STAT_EVICTIONS = 4;
+static const int ROWCACHE_STAT_INVALIDATIONS = 5;
+static const int ROWCACHE_STAT_ENTRIES = 6;
+static const int ROWCACHE_STAT_BYTES = 7;
+static const int ROWCACHE_STAT_CAPACITY = 8;
+static const int ROWCACHE_STAT_COUNT = 9;
+
+struct RowEntry : public ChainedEntry {
+    RowEntry *prev;
+    RowEntry *next;
+    size_t charge;
+    std::string value;
+};
+
+struct RowShard {
+    pthread_mutex_t mutex;
+    ChainedTable table;
+    RowEntry lru;  // lru.next is the least recently used entry
+    size_t usage;
+    size_t capacity;
+    uint64_t generation;
+    jlong stats[ROWCACHE_STAT_ENTRIES];  // the counters; the rest are read off the shard
+};
+
+struct RowCache {
+    leveldb_t *db;
+    pthread_rwlock_t lock;  // read by users of the cache, written to free it
+    size_t shard_count;
+    RowShard *shards;
+};
+
+/* What a missed read needs to fill the cache afterwards. */
+struct RowFill {
+    RowShard *shard;
+    uint32_t hash;
+    uint64_t generation;
+};
+
+/* Guards row_caches only, and is taken before a cache's own lock. */
+static pthread_rwlock_t row_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+static std::map<leveldb_t*, RowCache*> row_caches;
+static volatile int row_cache_count = 0;
+
+static inline RowShard* row_shard(RowCache *cache, uint32_t hash) {
+    return &cache->shards[hash % cache->shard_count];
+}
+
+static void row_lru_unlink(RowEntry *entry) {
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+}
+
+static void row_lru_append(RowShard *shard, RowEntry *entry) {
+    entry->next = &shard->lru;
+    entry->prev = shard->lru.prev;
+    entry->prev->next = entry;
+    shard->lru.prev = entry;
+}
+
+/* Removes the entry in slot. Called with the shard mutex held. */
+static void row_remove(RowShard *shard, ChainedEntry **slot) {
+    RowEntry *entry = static_cast<RowEntry*>(chained_unlink(&shard->table, slot));
+    row_lru_unlink(entry);
+    shard->usage -= entry->charge;
+    delete entry;
+}
+
+/* Drops key and fences off fills of reads that missed before now. */
+static void row_cache_erase(RowCache *cache, const char *key, size_t keylen) {
+    uint32_t hash = hash_key(key, keylen);
+    RowShard *shard = row_shard(cache, hash);
+
+    pthread_mutex_lock(&shard->mutex);
+    shard->generation++;
+    ChainedEntry **slot = chained_slot(&shard->table, hash, key, keylen);
+    if (*slot != NULL) {
+        row_remove(shard, slot);
+        shard->stats[ROWCACHE_STAT_INVALIDATIONS]++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+static void row_cache_clear(RowCache *cache) {
+    for (size_t i = 0; i < cache->shard_count; i++) {
+        RowShard *shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        shard->generation++;
+        while (shard->lru.next != &shard->lru) {
+            row_remove(shard, chained_slot_of(&shard->table, shard->lru.next));
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
+}
+
+/*
+ * Looks key up in cache, which may be NULL. On a hit the value is copied
+ * into value and true is returned. On a miss fill is set up for
+ * row_cache_fill, or left empty if the read should not fill the cache.
+ */
+static bool row_cache_get(RowCache *cache, const leveldb_readoptions_t *options,
+                          const char *key, size_t keylen, std::string &value, RowFill *fill) {
+    fill->shard = NULL;
+    if (cache == NULL) {
+        return false;
+    }
+    const ReadOptionsLayout *layout = reinterpret_cast<const ReadOptionsLayout*>(options);
+    uint32_t hash = hash_key(key, keylen);
+    RowShard *shard = row_shard(cache, hash);
+
+    pthread_mutex_lock(&shard->mutex);
+    if (layout->snapshot != NULL) {
+        // cached values are the latest ones, not the snapshot's
+        shard->stats[ROWCACHE_STAT_BYPASSES]++;
+        pthread_mutex_unlock(&shard->mutex);
+        return false;
+    }
+    RowEntry *entry = static_cast<RowEntry*>(*chained_slot(&shard->table, hash, key, keylen));
+    if (entry != NULL) {
+        row_lru_unlink(entry);
+        row_lru_append(shard, entry);
+        value.assign(entry->value);
+        shard->stats[ROWCACHE_STAT_HITS]++;
+        pthread_mutex_unlock(&shard->mutex);
+        return true;
+    }
+    shard->stats[ROWCACHE_STAT_MISSES]++;
+    if (layout->fill_cache) {
+        fill->shard = shard;
+        fill->hash = hash;
+        fill->generation = shard->generation;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return false;
+}
+
+/* Caches the value a missed read found, evicting the least recently used rows. */
+static void row_cache_fill(const RowFill &fill, const char *key, size_t keylen,
+                           const char *value, size_t vallen) {
+    RowShard *shard = fill.shard;
+    if (shard == NULL) {
+        return;
+    }
+    size_t charge = sizeof(RowEntry) + keylen + vallen;
+    if (charge > shard->capacity) {
+        return;
+    }
+
+    pthread_mutex_lock(&shard->mutex);
+    ChainedEntry **slot = chained_slot(&shard->table, fill.hash, key, keylen);
+    if (shard->generation != fill.generation || *slot != NULL) {
+        pthread_mutex_unlock(&shard->mutex);
+        return;
+    }
+    RowEntry *entry = new RowEntry();
+    entry->hash = fill.hash;
+    entry->charge = charge;
+    entry->key.assign(key, keylen);
+    entry->value.assign(value, vallen);
+    chained_link(&shard->table, slot, entry);
+    row_lru_append(shard, entry);
+    shard->usage += charge;
+    shard->stats[ROWCACHE_STAT_INSERTS]++;
+
+    while (shard->usage > shard->capacity) {
+        row_remove(shard, chained_slot_of(&shard->table, shard->lru.next));
+        shard->stats[ROWCACHE_STAT_EVICTIONS]++;
+    }
+    chained_grow(&shard->table);
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+/*
+ * Finds the row cache of a database, holding its read lock for as long as
+ * it is in use so the cache cannot be cleared or destroyed underneath. The
+ * registry lock is only held for the lookup. As with BloomRef, a thread
+ * must not hold two references to the same cache.
+ */
+class RowCacheRef {
+  public:
+    explicit RowCacheRef(leveldb_t *db) : cache_(NULL) {
+        if (row_cache_count == 0) {
+            return;
+        }
+        pthread_rwlock_rdlock(&row_cache_lock);
+        std::map<leveldb_t*, RowCache*>::const_iterator it = row_caches.find(db);
+        if (it != row_caches.end()) {
+            cache_ = it->second;
+            pthread_rwlock_rdlock(&cache_->lock);
+        }
+        pthread_rwlock_unlock(&row_cache_lock);
+    }
+    ~RowCacheRef() {
+        if (cache_ != NULL) {
+            pthread_rwlock_unlock(&cache_->lock);
+        }
+    }
+    RowCache* get() const { return cache_; }
+  private:
+    RowCache *cache_;
+};
+
+/* Drops key from the row cache of db, if it has one. */
+static void row_cache_invalidate(leveldb_t *db, const char *key, size_t keylen) {
+    RowCacheRef cache(db);
+    if (cache.get() != NULL) {
+        row_cache_erase(cache.get(), key, keylen);
+    }
+}
+
+static void invalidate_put(void *state, const char *k, size_t klen, const char *v, size_t vlen) {
+    row_cache_erase(static_cast<RowCache*>(state), k, klen);
+}
+
+static void invalidate_delete(void *state, const char *k, size_t klen) {
+    row_cache_erase(static_cast<RowCache*>(state), k, klen);
+}
+
+/* Drops every key batch wrote from the row cache of db, if it has one. */
+static void row_cache_invalidate_batch(leveldb_t *db, leveldb_writebatch_t *batch) {
+    RowCacheRef cache(db);
+    if (cache.get() != NULL) {
+        leveldb_writebatch_iterate(batch, cache.get(), invalidate_put, invalidate_delete);
+    }
+}
+
+/*
+ * leveldb_write, leveldb_put and leveldb_delete, keeping the Bloom filter
+ * and row cache of db in step. Every write in this file goes through these.
+ */
+static void db_write(leveldb_t *db, const leveldb_writeoptions_t *options,
+                     leveldb_writebatch_t *batch, char **errptr) {
+    {
+        BloomRef bloom(db);
+        if (bloom.get() != NULL) {
+            leveldb_writebatch_iterate(batch, bloom.get(), bloom_add_put, bloom_add_delete);
+        }
+        leveldb_write(db, options, batch, errptr);
+    }
+    row_cache_invalidate_batch(db, batch);
+}
+
+static void db_put(leveldb_t *db, const leveldb_writeoptions_t *options,
+                   const char *key, size_t keylen, const char *value, size_t vallen, char **errptr) {
+    {
+        BloomRef bloom(db);
+        if (bloom.get() != NULL) {
+            bloom_add(bloom.get(), key, keylen);
+        }
+        leveldb_put(db, options, key, keylen, value, vallen, errptr);
+    }
+    row_cache_invalidate(db, key, keylen);
+}
+
+static void db_delete(leveldb_t *db, const leveldb_writeoptions_t *options,
+                      const char *key, size_t keylen, char **errptr) {
+    {
+        BloomRef bloom(db);
+        if (bloom.get() != NULL) {
+            __sync_fetch_and_add(&bloom.get()->stats[BLOOM_STAT_DELETES], 1);
+        }
+        leveldb_delete(db, options, key, keylen, errptr);
+    }
+    row_cache_invalidate(db, key, keylen);
+}
+
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1open
+  (JNIEnv *env, jobject obj, jlong options_ptr, jstring name) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return 0;
+    }
+    if (name == NULL) {
+        error(env, "LevelDB filename is NULL");
+        return 0;
+    }
+
+    const char* utf_chars = env->GetStringUTFChars(name, NULL);
+    assert(utf_chars);
+
+    char* errptr = NULL;
+
+    void* retval = leveldb_open(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        utf_chars,
+        &errptr);
+
+    env->ReleaseStringUTFChars(name, utf_chars);
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return 0;
+    }
+
+    return reinterpret_cast<jlong>(retval);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1close
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return;
+    }
+
+    leveldb_t *db = reinterpret_cast<leveldb_t*>(leveldb_ptr);
+
+    // a row cache or Bloom filter outlives its database only until it is destroyed
+    RowCache *cache = NULL;
+    pthread_rwlock_wrlock(&row_cache_lock);
+    std::map<leveldb_t*, RowCache*>::iterator it = row_caches.find(db);
+    if (it != row_caches.end()) {
+        cache = it->second;
+        row_caches.erase(it);
+        row_cache_count--;
+    }
+    pthread_rwlock_unlock(&row_cache_lock);
+    if (cache != NULL) {
+        pthread_rwlock_wrlock(&cache->lock);
+        row_cache_clear(cache);
+        pthread_rwlock_unlock(&cache->lock);
+    }
+
+    Bloom *bloom = NULL;
+    pthread_rwlock_wrlock(&bloom_lock);
+    std::map<leveldb_t*, Bloom*>::iterator bit = blooms.find(db);
+    if (bit != blooms.end()) {
+        bloom = bit->second;
+        blooms.erase(bit);
+        bloom_count--;
+    }
+    pthread_rwlock_unlock(&bloom_lock);
+    if (bloom != NULL) {
+        pthread_rwlock_wrlock(&bloom->lock);
+        bloom->closed = true;
+        pthread_rwlock_unlock(&bloom->lock);
+    }
+
+    leveldb_close(db);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1put
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr, jbyteArray key, jbyteArray value) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return;
+    }
+    if (writeoptions_ptr == 0) {
+        error(env, "LevelDB write options handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+    if (value == 0) {
+        error(env, "LevelDB value is NULL");
+        return;
+    }
+
+    char* errptr = NULL;
+
+    size_t key_length = env->GetArrayLength(key);
+    size_t value_length = env->GetArrayLength(value);
+    if (use_critical(key_length + value_length)) {
+        // leveldb_put copies into a write batch anyway, so fill one straight
+        // from the arrays and write it once the critical region is over
+        leveldb_writebatch_t *batch = leveldb_writebatch_create();
+        {
+            ArrayCritical key_bytes(env, key, key_length);
+            if (key_bytes.data() == NULL) {
+                leveldb_writebatch_destroy(batch);
+                return;
+            }
+            ArrayCritical value_bytes(env, value, value_length);
+            if (value_bytes.data() == NULL) {
+                leveldb_writebatch_destroy(batch);
+                return;
+            }
+            leveldb_writebatch_put(
+                batch,
+                key_bytes.data(),
+                key_bytes.size(),
+                value_bytes.data(),
+                value_bytes.size());
+        }
+        db_write(
+            reinterpret_cast<leveldb_t*>(leveldb_ptr),
+            reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
+            batch,
+            &errptr);
+        leveldb_writebatch_destroy(batch);
+    }
+    else {
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) return;
+        ArrayCopy value_bytes(env, value);
+        if (value_bytes.data() == NULL) return;
+        db_put(
+            reinterpret_cast<leveldb_t*>(leveldb_ptr),
+            reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
+            key_bytes.data(),
+            key_bytes.size(),
+            value_bytes.data(),
+            value_bytes.size(),
+            &errptr);
+    }
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return;
+    }
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1delete
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr, jbyteArray key) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return;
+    }
+    if (writeoptions_ptr == 0) {
+        error(env, "LevelDB write options handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+
+    ArrayCopy key_bytes(env, key);
+    if (key_bytes.data() == NULL) return;
+
+    char* errptr = NULL;
+
+    db_delete(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
+        key_bytes.data(),
+        key_bytes.size(),
+        &errptr);
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return;
+    }
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1write
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr, jlong writebatch_ptr) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return;
+    }
+    if (writeoptions_ptr == 0) {
+        error(env, "LevelDB write options handle is NULL");
+        return;
+    }
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return;
+    }
+
+    char* errptr = NULL;
+
+    db_write(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
+        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr),
+        &errptr);
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return;
+    }
+}
+
+/*
+ * Applies a packed write buffer (see append_packed_ops) atomically with a
+ * single leveldb_write.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1write_1packed
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr,
+   jobject ops, jint ops_offset, jint ops_length) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return;
+    }
+    if (writeoptions_ptr == 0) {
+        error(env, "LevelDB write options handle is NULL");
+        return;
+    }
+    if (ops == 0) {
+        error(env, "LevelDB packed write buffer is NULL");
+        return;
+    }
+
+    const char *ops_bytes = direct_address(env, ops, ops_offset, ops_length);
+    if (ops_bytes == NULL) return;
+
+    leveldb_writebatch_t *batch = leveldb_writebatch_create();
+    const char *msg = append_packed_ops(batch, ops_bytes, ops_length);
+    if (msg != NULL) {
+        leveldb_writebatch_destroy(batch);
+        error(env, msg);
+        return;
+    }
+
+    char* errptr = NULL;
+
+    db_write(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
+        batch,
+        &errptr);
+
+    leveldb_writebatch_destroy(batch);
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return;
+    }
+}
+
+JNIEXPORT jbyteArray JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1get
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr, jbyteArray key) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return NULL;
+    }
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return NULL;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return NULL;
+    }
+
+    size_t vallen = 0;
+
+    char* errptr = NULL;
+
+    char* value = NULL;
+    std::string cached;
+    bool hit = false;
+    {
+        BloomRef bloom(reinterpret_cast<leveldb_t*>(leveldb_ptr));
+        RowCacheRef cache(reinterpret_cast<leveldb_t*>(leveldb_ptr));
+        RowFill fill;
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) return NULL;
+        if (!bloom_may_contain(
+                bloom.get(),
+                reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+                key_bytes.data(),
+                key_bytes.size())) {
+            return env->NewByteArray(0);
+        }
+        hit = row_cache_get(
+            cache.get(),
+            reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+            key_bytes.data(),
+            key_bytes.size(),
+            cached,
+            &fill);
+        if (!hit) {
+            value = leveldb_get(
+                reinterpret_cast<leveldb_t*>(leveldb_ptr),
+                reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+                key_bytes.data(),
+                key_bytes.size(),
+                &vallen,
+                &errptr);
+            if (value != NULL) {
+                row_cache_fill(fill, key_bytes.data(), key_bytes.size(), value, vallen);
+            }
+            else if (errptr == NULL) {
+                bloom_note_miss(bloom.get(), reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr));
+            }
+        }
+    }
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return NULL;
+    }
+    if (hit) {
+        jbyteArray retval = env->NewByteArray(cached.size());
+        if (retval != NULL && !cached.empty()) {
+            env->SetByteArrayRegion(retval, 0, cached.size(), (const jbyte *)cached.data());
+        }
+        return retval;
+    }
+
+    jbyteArray retval = env->NewByteArray(vallen);
+    env->SetByteArrayRegion(retval, 0, vallen, (jbyte *)value);
+
+    free(value);
+    return retval;
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1put_1direct
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr,
+   jobject key, jint key_offset, jint key_length,
+   jobject value, jint value_offset, jint value_length) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return;
+    }
+    if (writeoptions_ptr == 0) {
+        error(env, "LevelDB write options handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+    if (value == 0) {
+        error(env, "LevelDB value is NULL");
+        return;
+    }
+
+    const char *key_bytes = direct_address(env, key, key_offset, key_length);
+    if (key_bytes == NULL) return;
+    const char *value_bytes = direct_address(env, value, value_offset, value_length);
+    if (value_bytes == NULL) return;
+
+    char* errptr = NULL;
+
+    db_put(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
+        key_bytes,
+        key_length,
+        value_bytes,
+        value_length,
+        &errptr);
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return;
+    }
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1delete_1direct
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr,
+   jobject key, jint key_offset, jint key_length) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return;
+    }
+    if (writeoptions_ptr == 0) {
+        error(env, "LevelDB write options handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+
+    const char *key_bytes = direct_address(env, key, key_offset, key_length);
+    if (key_bytes == NULL) return;
+
+    char* errptr = NULL;
+
+    db_delete(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
+        key_bytes,
+        key_length,
+        &errptr);
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return;
+    }
+}
+
+/*
+ * Copies the value for key into the region of the direct value buffer.
+ * Returns the length of the stored value, or -1 if the key was not found.
+ * If the value is longer than value_length nothing is copied; the caller
+ * can compare the return value against the space it offered.
+ */
+JNIEXPORT jint JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1get_1direct
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr,
+   jobject key, jint key_offset, jint key_length,
+   jobject value, jint value_offset, jint value_length) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return -1;
+    }
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return -1;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return -1;
+    }
+    if (value == 0) {
+        error(env, "LevelDB value is NULL");
+        return -1;
+    }
+
+    const char *key_bytes = direct_address(env, key, key_offset, key_length);
+    if (key_bytes == NULL) return -1;
+    char *value_bytes = direct_address(env, value, value_offset, value_length);
+    if (value_bytes == NULL) return -1;
+
+    size_t vallen = 0;
+
+    char* errptr = NULL;
+
+    BloomRef bloom(reinterpret_cast<leveldb_t*>(leveldb_ptr));
+    if (!bloom_may_contain(bloom.get(), reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+                           key_bytes, key_length)) {
+        return -1;
+    }
+
+    RowCacheRef cache(reinterpret_cast<leveldb_t*>(leveldb_ptr));
+    RowFill fill;
+    std::string cached;
+    if (row_cache_get(cache.get(), reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+                      key_bytes, key_length, cached, &fill)) {
+        if (cached.size() <= (size_t)value_length) {
+            memcpy(value_bytes, cached.data(), cached.size());
+        }
+        return (jint)cached.size();
+    }
+
+    char* result = leveldb_get(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+        key_bytes,
+        key_length,
+        &vallen,
+        &errptr);
+    if (result != NULL) {
+        row_cache_fill(fill, key_bytes, key_length, result, vallen);
+    }
+    else if (errptr == NULL) {
+        bloom_note_miss(bloom.get(), reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr));
+    }
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return -1;
+    }
+    if (result == NULL) {
+        return -1;
+    }
+
+    if (vallen <= (size_t)value_length) {
+        memcpy(value_bytes, result, vallen);
+    }
+
+    free(result);
+    return (jint)vallen;
+}
+
+/*
+ * Copies the value for key into value[offset..]. Returns the length of the
+ * stored value, or -1 if the key was not found. If the value does not fit
+ * in the remaining space nothing is copied and the required length is
+ * returned, so the caller can grow its buffer and retry.
+ */
+JNIEXPORT jint JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1get_1into
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr,
+   jbyteArray key, jbyteArray value, jint value_offset) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return -1;
+    }
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return -1;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return -1;
+    }
+    if (value == 0) {
+        error(env, "LevelDB value is NULL");
+        return -1;
+    }
+
+    jsize value_capacity = env->GetArrayLength(value);
+    if (value_offset < 0 || value_offset > value_capacity) {
+        error(env, "LevelDB value offset is out of bounds");
+        return -1;
+    }
+
+    size_t vallen = 0;
+
+    char* errptr = NULL;
+
+    char* result = NULL;
+    std::string cached;
+    bool hit = false;
+    {
+        BloomRef bloom(reinterpret_cast<leveldb_t*>(leveldb_ptr));
+        RowCacheRef cache(reinterpret_cast<leveldb_t*>(leveldb_ptr));
+        RowFill fill;
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) return 0;
+        if (!bloom_may_contain(
+                bloom.get(),
+                reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+                key_bytes.data(),
+                key_bytes.size())) {
+            return -1;
+        }
+        hit = row_cache_get(
+            cache.get(),
+            reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+            key_bytes.data(),
+            key_bytes.size(),
+            cached,
+            &fill);
+        if (!hit) {
+            result = leveldb_get(
+                reinterpret_cast<leveldb_t*>(leveldb_ptr),
+                reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+                key_bytes.data(),
+                key_bytes.size(),
+                &vallen,
+                &errptr);
+            if (result != NULL) {
+                row_cache_fill(fill, key_bytes.data(), key_bytes.size(), result, vallen);
+            }
+            else if (errptr == NULL) {
+                bloom_note_miss(bloom.get(), reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr));
+            }
+        }
+    }
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return -1;
+    }
+    if (hit) {
+        if (cached.size() <= (size_t)(value_capacity - value_offset) && !cached.empty()) {
+            env->SetByteArrayRegion(value, value_offset, cached.size(), (const jbyte *)cached.data());
+        }
+        return (jint)cached.size();
+    }
+    if (result == NULL) {
+        return -1;
+    }
+
+    if (vallen <= (size_t)(value_capacity - value_offset)) {
+        env->SetByteArrayRegion(value, value_offset, vallen, (const jbyte *)result);
+    }
+
+    free(result);
+    return (jint)vallen;
+}
+
+JNIEXPORT jbyteArray JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1multiget
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr, jobjectArray keys) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return NULL;
+    }
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return NULL;
+    }
+    if (keys == 0) {
+        error(env, "LevelDB key array is NULL");
+        return NULL;
+    }
+
+    std::vector<char> key_bytes;
+    std::vector<KeyRef> refs;
+    if (!gather_keys(env, keys, key_bytes, refs)) return NULL;
+
+    std::vector<char> result;
+    char* errptr = NULL;
+
+    if (!multiget(
+            reinterpret_cast<leveldb_t*>(leveldb_ptr),
+            reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+            refs, result, &errptr)) {
+        status_error(env, errptr);
+        free(errptr);
+        return NULL;
+    }
+
+    jbyteArray retval = env->NewByteArray(result.size());
+    if (retval == NULL) return NULL;
+    if (!result.empty()) {
+        env->SetByteArrayRegion(retval, 0, result.size(), (const jbyte *)&result[0]);
+    }
+    return retval;
+}
+
+/*
+ * Multi-get over a direct buffer holding count keys, each encoded as a
+ * 32-bit length followed by the key bytes. Results are encoded as for
+ * leveldb_multiget into the direct result region. Returns the encoded
+ * result length; if that exceeds result_length nothing is copied.
+ */
+JNIEXPORT jint JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1multiget_1direct
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr,
+   jobject keys, jint keys_offset, jint keys_length, jint count,
+   jobject result, jint result_offset, jint result_length) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return -1;
+    }
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return -1;
+    }
+    if (keys == 0) {
+        error(env, "LevelDB key buffer is NULL");
+        return -1;
+    }
+    if (result == 0) {
+        error(env, "LevelDB result buffer is NULL");
+        return -1;
+    }
+
+    const char *key_bytes = direct_address(env, keys, keys_offset, keys_length);
+    if (key_bytes == NULL) return -1;
+    char *result_bytes = direct_address(env, result, result_offset, result_length);
+    if (result_bytes == NULL) return -1;
+
+    std::vector<KeyRef> refs;
+    const char *msg = parse_packed_keys(key_bytes, keys_length, count, refs);
+    if (msg != NULL) {
+        error(env, msg);
+        return -1;
+    }
+
+    std::vector<char> packed;
+    char* errptr = NULL;
+
+    if (!multiget(
+            reinterpret_cast<leveldb_t*>(leveldb_ptr),
+            reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+            refs, packed, &errptr)) {
+        status_error(env, errptr);
+        free(errptr);
+        return -1;
+    }
+
+    if (packed.size() <= (size_t)result_length && !packed.empty()) {
+        memcpy(result_bytes, &packed[0], packed.size());
+    }
+    return (jint)packed.size();
+}
+
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1create_1iterator
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
+    }
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return 0;
+    }
+
+    leveldb_iterator_t* retval = leveldb_create_iterator(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr));
+    return reinterpret_cast<jlong>(retval);
+}
+
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1create_1snapshot
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
+    }
+
+    const leveldb_snapshot_t* retval = leveldb_create_snapshot(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr));
+    return reinterpret_cast<jlong>(retval);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1release_1snapshot
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong snapshot_ptr) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return;
+    }
+    if (snapshot_ptr == 0) {
+        error(env, "LevelDB snapshot handle is NULL");
+        return;
+    }
+
+    leveldb_release_snapshot(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_snapshot_t*>(snapshot_ptr));
+}
+
+JNIEXPORT jstring JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1property_1value
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jstring name) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return NULL;
+    }
+    if (name == 0) {
+        error(env, "LevelDB property name is NULL");
+        return NULL;
+    }
+
+    const char* name_chars = env->GetStringUTFChars(name, NULL);
+
+    char* retval = leveldb_property_value(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        name_chars);
+
+    env->ReleaseStringUTFChars(name, name_chars);
+
+    jstring jretval = env->NewStringUTF(retval);
+    free(retval);
+    return jretval;
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1destroy_1db
+  (JNIEnv *env, jobject obj, jlong options_ptr, jstring name) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+    if (name == 0) {
+        error(env, "LevelDB filename is NULL");
+        return;
+    }
+
+    const char* name_chars = env->GetStringUTFChars(name, NULL);
+
+    char* errptr = NULL;
+
+    leveldb_destroy_db(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        name_chars,
+        &errptr);
+
+    env->ReleaseStringUTFChars(name, name_chars);
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return;
+    }
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1repair_1db
+  (JNIEnv *env, jobject obj, jlong options_ptr, jstring name) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+    if (name == 0) {
+        error(env, "LevelDB filename is NULL");
+        return;
+    }
+
+    const char* name_chars = env->GetStringUTFChars(name, NULL);
+
+    char* errptr = NULL;
+
+    leveldb_repair_db(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        name_chars,
+        &errptr);
+
+    env->ReleaseStringUTFChars(name, name_chars);
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return;
+    }
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1destroy
+  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+
+    if (iterator_ptr == 0) {
+        error(env, "LevelDB iterator handle is NULL");
+        return;
+    }
+
+    leveldb_iter_destroy(
+        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr));
+}
+
+JNIEXPORT jboolean JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1valid
+  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+
+    if (iterator_ptr == 0) {
+        error(env, "LevelDB iterator handle is NULL");
+        return 0;
+    }
+
+    return leveldb_iter_valid(
+        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1seek_1to_1first
+  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+
+    if (iterator_ptr == 0) {
+        error(env, "LevelDB iterator handle is NULL");
+        return;
+    }
+
+    leveldb_iter_seek_to_first(
+        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1seek_1to_1last
+  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+
+    if (iterator_ptr == 0) {
+        error(env, "LevelDB iterator handle is NULL");
+        return;
+    }
+
+    leveldb_iter_seek_to_last(
+        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1seek
+  (JNIEnv *env, jobject obj, jlong iterator_ptr, jbyteArray key) {
+
+    if (iterator_ptr == 0) {
+        error(env, "LevelDB iterator handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+
+    ArrayCopy key_bytes(env, key);
+    if (key_bytes.data() == NULL) return;
+
+    leveldb_iter_seek(
+        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr),
+        key_bytes.data(),
+        key_bytes.size());
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1next
+  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+
+    if (iterator_ptr == 0) {
+        error(env, "LevelDB iterator handle is NULL");
+        return;
+    }
+
+    leveldb_iter_next(
+        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1prev
+  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+
+    if (iterator_ptr == 0) {
+        error(env, "LevelDB iterator handle is NULL");
+        return;
+    }
+
+    leveldb_iter_prev(
+        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr));
+}
+
+JNIEXPORT jbyteArray JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1key
+  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+
+    if (iterator_ptr == 0) {
+        error(env, "LevelDB iterator handle is NULL");
+        return NULL;
+    }
+
+    size_t keylen = 0;
+
+    const char* key = leveldb_iter_key(
+        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr),
+        &keylen);
+
+    jbyteArray retval = env->NewByteArray(keylen);
+        env->SetByteArrayRegion(retval, 0,
+	    keylen, (const jbyte *)key);
+
+	return retval;
+}
+
+JNIEXPORT jbyteArray JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1value
+  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+
+    if (iterator_ptr == 0) {
+        error(env, "LevelDB iterator handle is NULL");
+        return NULL;
+    }
+
+    size_t vallen = 0;
+
+    const char* value = leveldb_iter_value(
+        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr),
+        &vallen);
+
+    jbyteArray retval = env->NewByteArray(vallen);
+        env->SetByteArrayRegion(retval, 0,
+	    vallen, (const jbyte *)value);
+
+	return retval;
+}
+
+JNIEXPORT jstring JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1get_1error
+  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+
+    if (iterator_ptr == 0) {
+        error(env, "LevelDB iterator handle is NULL");
+        return NULL;
+    }
+
+    char *errptr = NULL;
+
+    leveldb_iter_get_error(
+        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr),
+        &errptr);
+
+    if (errptr) {
+        jstring retval = env->NewStringUTF(errptr);
+        free(errptr);
+        return retval;
+    }
+    else {
+        return NULL;
+    }
+}
+
+/*
+ * Packs as many entries as fit, starting at the iterator's current position,
+ * into the direct buffer region and leaves the iterator on the first entry
+ * not returned. Returns the number of entries packed while the iterator still
+ * has entries left, or -(count + 1) once it is exhausted. If not even the
+ * current entry fits, 0 is returned and its encoded size is written as a
+ * 32-bit int at the start of the region when there is room for it. An
+ * iterator that stopped on an error throws rather than reporting exhaustion.
+ */
+JNIEXPORT jint JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1next_1batch
+  (JNIEnv *env, jobject obj, jlong iterator_ptr, jobject buffer, jint offset, jint length,
+   jint max_entries) {
+
+    if (iterator_ptr == 0) {
+        error(env, "LevelDB iterator handle is NULL");
+        return 0;
+    }
+    if (buffer == 0) {
+        error(env, "LevelDB result buffer is NULL");
+        return 0;
+    }
+
+    char *dst = direct_address(env, buffer, offset, length);
+    if (dst == NULL) return 0;
+
+    leveldb_iterator_t *iter = reinterpret_cast<leveldb_iterator_t*>(iterator_ptr);
+
+    size_t pending_size = 0;
+    jint count = pack_iter_entries(iter, NULL, dst, length, max_entries, &pending_size, NULL);
+
+    char *errptr = NULL;
+    leveldb_iter_get_error(iter, &errptr);
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return 0;
+    }
+
+    if (!leveldb_iter_valid(iter)) {
+        return -(count + 1);
+    }
+    if (count == 0 && pending_size > 0 && length >= 4) {
+        encode_int32(dst, pending_size);
+    }
+    return count;
+}
+
+/* Placeholder memory for views that are not pointing at an entry. */
+static char empty_view[1];
+
+/* Matches the leveldb_iter_move_* constants in NativeInterface.java. */
+static const int ITER_MOVE_NONE = 0;
+static const int ITER_MOVE_NEXT = 1;
+static const int ITER_MOVE_PREV = 2;
+static const int ITER_MOVE_FIRST = 3;
+static const int ITER_MOVE_LAST = 4;
+
+JNIEXPORT jobject JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1view_1create
+  (JNIEnv *env, jobject obj) {
+
+    if (!init_view_fields(env)) {
+        error(env, "LevelDB views are not supported by this JVM");
+        return NULL;
+    }
+
+    return env->NewDirectByteBuffer(empty_view, 0);
+}
+
+/*
+ * Points view at no memory, with a capacity and limit of 0, so reads
+ * through it throw instead of touching an iterator that may be gone.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1view_1reset
+  (JNIEnv *env, jobject obj, jobject view) {
+
+    if (view == NULL) {
+        error(env, "LevelDB view is NULL");
+        return;
+    }
+    if (!init_view_fields(env)) {
+        error(env, "LevelDB views are not supported by this JVM");
+        return;
+    }
+
+    point_view(env, view, empty_view, 0);
+}
+
+/*
+ * Applies a move (one of the ITER_MOVE_* constants) and, if the
+ * iterator is then valid, points keyview and valueview at its current key
+ * and value. The views are valid until the iterator moves again; either
+ * may be NULL. Returns whether the iterator is valid.
+ */
+JNIEXPORT jboolean JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1move_1views
+  (JNIEnv *env, jobject obj, jlong iterator_ptr, jint move, jobject keyview, jobject valueview) {
+
+    if (iterator_ptr == 0) {
+        error(env, "LevelDB iterator handle is NULL");
+        return 0;
+    }
+    if (!init_view_fields(env)) {
+        error(env, "LevelDB views are not supported by this JVM");
+        return 0;
+    }
+
+    leveldb_iterator_t *iter = reinterpret_cast<leveldb_iterator_t*>(iterator_ptr);
+
+    switch (move) {
+    case ITER_MOVE_NONE:
+        break;
+    case ITER_MOVE_NEXT:
+        leveldb_iter_next(iter);
+        break;
+    case ITER_MOVE_PREV:
+        leveldb_iter_prev(iter);
+        break;
+    case ITER_MOVE_FIRST:
+        leveldb_iter_seek_to_first(iter);
+        break;
+    case ITER_MOVE_LAST:
+        leveldb_iter_seek_to_last(iter);
+        break;
+    default:
+        if (keyview != NULL) point_view(env, keyview, empty_view, 0);
+        if (valueview != NULL) point_view(env, valueview, empty_view, 0);
+        error(env, "LevelDB iterator move is unknown");
+        return 0;
+    }
+
+    if (!leveldb_iter_valid(iter)) {
+        if (keyview != NULL) point_view(env, keyview, empty_view, 0);
+        if (valueview != NULL) point_view(env, valueview, empty_view, 0);
+        return 0;
+    }
+
+    size_t length = 0;
+    if (keyview != NULL) {
+        const char *key = leveldb_iter_key(iter, &length);
+        point_view(env, keyview, key, length);
+    }
+    if (valueview != NULL) {
+        const char *value = leveldb_iter_value(iter, &length);
+        point_view(env, valueview, value, length);
+    }
+    return 1;
+}
+
+/*
+ * Creates a paged scan over [start_key, end_key) in the given direction,
+ * returning at most limit entries in total (limit <= 0 for no limit). A NULL
+ * key leaves that side unbounded.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1scan_1create
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr,
+   jbyteArray start_key, jbyteArray end_key, jint limit, jboolean reverse) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
+    }
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return 0;
+    }
+
+    RangeScan *scan = new RangeScan();
+    if (start_key != NULL) {
+        copy_array(env, start_key, scan->start);
+    }
+    if (end_key != NULL) {
+        copy_array(env, end_key, scan->end);
+    }
+    scan->bounds.start = start_key != NULL ? scan->start.data() : NULL;
+    scan->bounds.start_length = scan->start.size();
+    scan->bounds.end = end_key != NULL ? scan->end.data() : NULL;
+    scan->bounds.end_length = scan->end.size();
+    scan->bounds.prefix = NULL;
+    scan->bounds.prefix_length = 0;
+    scan->bounds.reverse = reverse;
+    scan->remaining = limit > 0 ? limit : -1;
+
+    scan->iter = leveldb_create_iterator(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr));
+    scan_seek(scan->iter, &scan->bounds);
+
+    return reinterpret_cast<jlong>(scan);
+}
+
+/*
+ * Packs the next page of a scan into the direct buffer region, using the
+ * entry layout and return convention of leveldb_iter_next_batch. The scan
+ * counts as exhausted once it leaves its range or reaches its limit.
+ */
+JNIEXPORT jint JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1scan_1next_1page
+  (JNIEnv *env, jobject obj, jlong scan_ptr, jobject buffer, jint offset, jint length) {
+
+    if (scan_ptr == 0) {
+        error(env, "LevelDB scan handle is NULL");
+        return 0;
+    }
+    if (buffer == 0) {
+        error(env, "LevelDB result buffer is NULL");
+        return 0;
+    }
+
+    char *dst = direct_address(env, buffer, offset, length);
+    if (dst == NULL) return 0;
+
+    RangeScan *scan = reinterpret_cast<RangeScan*>(scan_ptr);
+
+    jint max_entries = 0x7fffffff;
+    if (scan->remaining >= 0 && scan->remaining < max_entries) {
+        max_entries = (jint)scan->remaining;
+    }
+
+    size_t pending_size = 0;
+    jint count = pack_iter_entries(scan->iter, &scan->bounds, dst, length, max_entries, &pending_size, NULL);
+    if (scan->remaining >= 0) {
+        scan->remaining -= count;
+    }
+
+    char *errptr = NULL;
+    leveldb_iter_get_error(scan->iter, &errptr);
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return 0;
+    }
+
+    if (scan->remaining == 0 || !scan_valid(scan->iter, &scan->bounds)) {
+        return -(count + 1);
+    }
+    if (count == 0 && pending_size > 0 && length >= 4) {
+        encode_int32(dst, pending_size);
+    }
+    return count;
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1scan_1destroy
+  (JNIEnv *env, jobject obj, jlong scan_ptr) {
+
+    if (scan_ptr == 0) {
+        error(env, "LevelDB scan handle is NULL");
+        return;
+    }
+
+    RangeScan *scan = reinterpret_cast<RangeScan*>(scan_ptr);
+    leveldb_iter_destroy(scan->iter);
+    delete scan;
+}
+
+/*
+ * Creates a paged forward scan over the keys starting with prefix, returning
+ * at most limit entries in total (limit <= 0 for no limit). Pages are read
+ * and the scan released with leveldb_scan_next_page and leveldb_scan_destroy.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1scan_1create_1prefix
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr,
+   jbyteArray prefix, jint limit) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
+    }
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return 0;
+    }
+    if (prefix == 0) {
+        error(env, "LevelDB prefix is NULL");
+        return 0;
+    }
+
+    RangeScan *scan = new RangeScan();
+    copy_array(env, prefix, scan->start);
+    scan->bounds.start = scan->start.data();
+    scan->bounds.start_length = scan->start.size();
+    scan->bounds.end = NULL;
+    scan->bounds.end_length = 0;
+    scan->bounds.prefix = scan->start.data();
+    scan->bounds.prefix_length = scan->start.size();
+    scan->bounds.reverse = false;
+    scan->remaining = limit > 0 ? limit : -1;
+
+    scan->iter = leveldb_create_iterator(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr));
+    scan_seek(scan->iter, &scan->bounds);
+
+    return reinterpret_cast<jlong>(scan);
+}
+
+/*
+ * Counts the keys starting with prefix without copying any keys or values
+ * out of the iterator.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1prefix_1count
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr, jbyteArray prefix) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
+    }
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return 0;
+    }
+    if (prefix == 0) {
+        error(env, "LevelDB prefix is NULL");
+        return 0;
+    }
+
+    std::string prefix_bytes;
+    copy_array(env, prefix, prefix_bytes);
+
+    leveldb_iterator_t *iter = leveldb_create_iterator(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr));
+
+    jlong count = 0;
+    for (leveldb_iter_seek(iter, prefix_bytes.data(), prefix_bytes.size());
+         leveldb_iter_valid(iter);
+         leveldb_iter_next(iter)) {
+        size_t keylen = 0;
+        const char *key = leveldb_iter_key(iter, &keylen);
+        if (keylen < prefix_bytes.size() ||
+            memcmp(key, prefix_bytes.data(), prefix_bytes.size()) != 0) {
+            break;
+        }
+        count++;
+    }
+
+    char *errptr = NULL;
+    leveldb_iter_get_error(iter, &errptr);
+    leveldb_iter_destroy(iter);
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return 0;
+    }
+    return count;
+}
+
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1create
+  (JNIEnv *env, jobject obj) {
+
+    leveldb_writebatch_t* retval = leveldb_writebatch_create();
+    return reinterpret_cast<jlong>(retval);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1destroy
+  (JNIEnv *env, jobject obj, jlong writebatch_ptr) {
+
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return;
+    }
+
+    leveldb_writebatch_destroy(
+        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1clear
+  (JNIEnv *env, jobject obj, jlong writebatch_ptr) {
+
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return;
+    }
+
+    leveldb_writebatch_clear(
+        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1put
+  (JNIEnv *env, jobject obj, jlong writebatch_ptr, jbyteArray key, jbyteArray value) {
+
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+    if (value == 0) {
+        error(env, "LevelDB value is NULL");
+        return;
+    }
+
+    // appending to a batch is a bounded copy, safe inside a critical region
+    size_t key_length = env->GetArrayLength(key);
+    size_t value_length = env->GetArrayLength(value);
+    if (use_critical(key_length + value_length)) {
+        ArrayCritical key_bytes(env, key, key_length);
+        if (key_bytes.data() == NULL) {
+            return;
+        }
+        ArrayCritical value_bytes(env, value, value_length);
+        if (value_bytes.data() == NULL) {
+            return;
+        }
+        leveldb_writebatch_put(
+            reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr),
+            key_bytes.data(),
+            key_bytes.size(),
+            value_bytes.data(),
+            value_bytes.size());
+    }
+    else {
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) return;
+        ArrayCopy value_bytes(env, value);
+        if (value_bytes.data() == NULL) return;
+        leveldb_writebatch_put(
+            reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr),
+            key_bytes.data(),
+            key_bytes.size(),
+            value_bytes.data(),
+            value_bytes.size());
+    }
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1delete
+  (JNIEnv *env, jobject obj, jlong writebatch_ptr, jbyteArray key) {
+
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+
+    ArrayCopy key_bytes(env, key);
+    if (key_bytes.data() == NULL) return;
+
+    leveldb_writebatch_delete(
+        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr),
+        key_bytes.data(),
+        key_bytes.size());
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1put_1direct
+  (JNIEnv *env, jobject obj, jlong writebatch_ptr,
+   jobject key, jint key_offset, jint key_length,
+   jobject value, jint value_offset, jint value_length) {
+
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+    if (value == 0) {
+        error(env, "LevelDB value is NULL");
+        return;
+    }
+
+    const char *key_bytes = direct_address(env, key, key_offset, key_length);
+    if (key_bytes == NULL) return;
+    const char *value_bytes = direct_address(env, value, value_offset, value_length);
+    if (value_bytes == NULL) return;
+
+    leveldb_writebatch_put(
+        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr),
+        key_bytes,
+        key_length,
+        value_bytes,
+        value_length);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1delete_1direct
+  (JNIEnv *env, jobject obj, jlong writebatch_ptr,
+   jobject key, jint key_offset, jint key_length) {
+
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+
+    const char *key_bytes = direct_address(env, key, key_offset, key_length);
+    if (key_bytes == NULL) return;
+
+    leveldb_writebatch_delete(
+        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr),
+        key_bytes,
+        key_length);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1append_1packed
+  (JNIEnv *env, jobject obj, jlong writebatch_ptr, jobject ops, jint ops_offset, jint ops_length) {
+
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return;
+    }
+    if (ops == 0) {
+        error(env, "LevelDB packed write buffer is NULL");
+        return;
+    }
+
+    const char *ops_bytes = direct_address(env, ops, ops_offset, ops_length);
+    if (ops_bytes == NULL) return;
+
+    const char *msg = append_packed_ops(
+        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr),
+        ops_bytes,
+        ops_length);
+
+    if (msg != NULL) {
+        error(env, msg);
+        return;
+    }
+}
+
+/* Returns the operations of writebatch in the packed write buffer format. */
+JNIEXPORT jbyteArray JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1dump
+  (JNIEnv *env, jobject obj, jlong writebatch_ptr) {
+
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return NULL;
+    }
+
+    leveldb_writebatch_t *batch = reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr);
+    size_t size = dump_packed_ops(batch, NULL);
+
+    jbyteArray retval = env->NewByteArray(size);
+    if (retval == NULL || size == 0) return retval;
+    char *dst = static_cast<char*>(env->GetPrimitiveArrayCritical(retval, NULL));
+    if (dst == NULL) return NULL;
+    dump_packed_ops(batch, dst);
+    env->ReleasePrimitiveArrayCritical(retval, dst, 0);
+    return retval;
+}
+
+/*
+ * Writes the operations of writebatch to buffer[offset..] in the packed
+ * write buffer format and returns their size. If they do not fit in length
+ * bytes nothing is written.
+ */
+JNIEXPORT jint JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1dump_1into
+  (JNIEnv *env, jobject obj, jlong writebatch_ptr, jobject buffer, jint buffer_offset, jint buffer_length) {
+
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return 0;
+    }
+    if (buffer == 0) {
+        error(env, "LevelDB buffer is NULL");
+        return 0;
+    }
+
+    char *dst = direct_address(env, buffer, buffer_offset, buffer_length);
+    if (dst == NULL) return 0;
+
+    leveldb_writebatch_t *batch = reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr);
+    size_t size = dump_packed_ops(batch, NULL);
+    if (size <= (size_t)buffer_length) {
+        dump_packed_ops(batch, dst);
+    }
+    return size;
+}
+
+/* Returns the native encoding of writebatch. */
+JNIEXPORT jbyteArray JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1to_1bytes
+  (JNIEnv *env, jobject obj, jlong writebatch_ptr) {
+
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return NULL;
+    }
+
+    leveldb_writebatch_t *batch = reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr);
+    std::vector<char> rep(encode_batch_rep(batch, NULL));
+    encode_batch_rep(batch, &rep[0]);
+
+    jbyteArray retval = env->NewByteArray(rep.size());
+    if (retval == NULL) return NULL;
+    env->SetByteArrayRegion(retval, 0, rep.size(), (jbyte *)&rep[0]);
+    return retval;
+}
+
+/*
+ * Writes the native encoding of writebatch to buffer[offset..] and returns
+ * its size. If it does not fit in length bytes nothing is written.
+ */
+JNIEXPORT jint JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1to_1buffer
+  (JNIEnv *env, jobject obj, jlong writebatch_ptr, jobject buffer, jint buffer_offset, jint buffer_length) {
+
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return 0;
+    }
+    if (buffer == 0) {
+        error(env, "LevelDB buffer is NULL");
+        return 0;
+    }
+
+    char *dst = direct_address(env, buffer, buffer_offset, buffer_length);
+    if (dst == NULL) return 0;
+
+    leveldb_writebatch_t *batch = reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr);
+    size_t size = encode_batch_rep(batch, NULL);
+    if (size <= (size_t)buffer_length) {
+        encode_batch_rep(batch, dst);
+    }
+    return size;
+}
+
+/* Creates a write batch from a native encoding. */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1from_1bytes
+  (JNIEnv *env, jobject obj, jbyteArray rep) {
+
+    if (rep == 0) {
+        error(env, "LevelDB write batch encoding is NULL");
+        return 0;
+    }
+
+    const char *msg;
+    leveldb_writebatch_t *batch = NULL;
+    {
+        // copied out first, as building the batch allocates
+        ArrayCopy rep_bytes(env, rep);
+        if (rep_bytes.data() == NULL) return 0;
+        msg = check_batch_rep(rep_bytes.data(), rep_bytes.size());
+        if (msg == NULL) {
+            batch = batch_from_rep(rep_bytes.data(), rep_bytes.size());
+        }
+    }
+
+    if (msg != NULL) {
+        status_error(env, msg);
+        return 0;
+    }
+    return reinterpret_cast<jlong>(batch);
+}
+
+/* Creates a write batch from the native encoding in buffer[offset..offset+length). */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1from_1buffer
+  (JNIEnv *env, jobject obj, jobject buffer, jint buffer_offset, jint buffer_length) {
+
+    if (buffer == 0) {
+        error(env, "LevelDB buffer is NULL");
+        return 0;
+    }
+
+    const char *src = direct_address(env, buffer, buffer_offset, buffer_length);
+    if (src == NULL) return 0;
+
+    const char *msg = check_batch_rep(src, buffer_length);
+    if (msg != NULL) {
+        status_error(env, msg);
+        return 0;
+    }
+    return reinterpret_cast<jlong>(batch_from_rep(src, buffer_length));
+}
+
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1create
+  (JNIEnv *env, jobject obj) {
+
+    leveldb_options_t* retval = leveldb_options_create();
+    return reinterpret_cast<jlong>(retval);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1destroy
+  (JNIEnv *env, jobject obj, jlong options_ptr) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+
+    leveldb_options_destroy(
+        reinterpret_cast<leveldb_options_t*>(options_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1create_1if_1missing
+  (JNIEnv *env, jobject obj, jlong options_ptr, jboolean value) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+
+    unsigned char native_bool = value ? 1 : 0;
+
+    leveldb_options_set_create_if_missing(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        native_bool);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1error_1if_1exists
+  (JNIEnv *env, jobject obj, jlong options_ptr, jboolean value) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+
+    unsigned char native_bool = value ? 1 : 0;
+
+    leveldb_options_set_error_if_exists(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        native_bool);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1paranoid_1checks
+  (JNIEnv *env, jobject obj, jlong options_ptr, jboolean value) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+
+    unsigned char native_bool = value ? 1 : 0;
+
+    leveldb_options_set_paranoid_checks(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        native_bool);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1env
+  (JNIEnv *env, jobject obj, jlong options_ptr, jlong env_ptr) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+    if (env_ptr == 0) {
+        error(env, "LevelDB env handle is NULL");
+        return;
+    }
+
+    leveldb_options_set_env(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        reinterpret_cast<leveldb_env_t*>(env_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1info_1log
+  (JNIEnv *env, jobject obj, jlong options_ptr, jlong logger_ptr) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+    if (logger_ptr == 0) {
+        error(env, "LevelDB logger handle is NULL");
+        return;
+    }
+
+    leveldb_options_set_info_log(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        reinterpret_cast<leveldb_logger_t*>(logger_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1write_1buffer_1size
+  (JNIEnv *env, jobject obj, jlong options_ptr, jlong size) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+
+    assert(size > 0);
+
+    leveldb_options_set_write_buffer_size(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        (size_t)size);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1max_1open_1files
+  (JNIEnv *env, jobject obj, jlong options_ptr, jint value) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+
+    leveldb_options_set_max_open_files(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        value);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1cache
+  (JNIEnv *env, jobject obj, jlong options_ptr, jlong cache_ptr) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+    if (cache_ptr == 0) {
+        error(env, "LevelDB cache handle is NULL");
+        return;
+    }
+
+    leveldb_options_set_cache(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        reinterpret_cast<leveldb_cache_t*>(cache_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1block_1size
+  (JNIEnv *env, jobject obj, jlong options_ptr, jlong size) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+
+    assert(size > 0);
+
+    leveldb_options_set_block_size(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        (size_t)size);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1block_1restart_1interval
+  (JNIEnv *env, jobject obj, jlong options_ptr, jint value) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+
+    leveldb_options_set_block_restart_interval(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        value);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1compression
+  (JNIEnv *env, jobject obj, jlong options_ptr, jint value) {
+
+    if (options_ptr == 0) {
+        error(env, "LevelDB options handle is NULL");
+        return;
+    }
+
+    leveldb_options_set_compression(
+        reinterpret_cast<leveldb_options_t*>(options_ptr),
+        value);
+}
+
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1create
+  (JNIEnv *env, jobject obj) {
+
+    leveldb_readoptions_t* retval = leveldb_readoptions_create();
+    return reinterpret_cast<jlong>(retval);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1destroy
+  (JNIEnv *env, jobject obj, jlong readoptions_ptr) {
+
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return;
+    }
+
+    leveldb_readoptions_destroy(
+        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1set_1verify_1checksums
+  (JNIEnv *env, jobject obj, jlong readoptions_ptr, jboolean value) {
+
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return;
+    }
+
+    unsigned char native_bool = value ? 1 : 0;
+
+    leveldb_readoptions_set_verify_checksums(
+        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+        native_bool);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1set_1fill_1cache
+  (JNIEnv *env, jobject obj, jlong readoptions_ptr, jboolean value) {
+
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return;
+    }
+
+    unsigned char native_bool = value ? 1 : 0;
+
+    leveldb_readoptions_set_fill_cache(
+        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+        native_bool);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1set_1snapshot
+  (JNIEnv *env, jobject obj, jlong readoptions_ptr, jlong snapshot_ptr) {
+
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return;
+    }
+
+    leveldb_readoptions_set_snapshot(
+        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+        reinterpret_cast<const leveldb_snapshot_t*>(snapshot_ptr));
+}
+
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writeoptions_1create
+  (JNIEnv *env, jobject obj) {
+
+    leveldb_writeoptions_t* retval = leveldb_writeoptions_create();
+    return reinterpret_cast<jlong>(retval);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writeoptions_1destroy
+  (JNIEnv *env, jobject obj, jlong writeoptions_ptr) {
+
+    if (writeoptions_ptr == 0) {
+        error(env, "LevelDB write options handle is NULL");
+        return;
+    }
+
+    leveldb_writeoptions_destroy(
+        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writeoptions_1set_1sync
+  (JNIEnv *env, jobject obj, jlong writeoptions_ptr, jboolean value) {
+
+    if (writeoptions_ptr == 0) {
+        error(env, "LevelDB write options handle is NULL");
+        return;
+    }
+
+    unsigned char native_bool = value ? 1 : 0;
+
+    leveldb_writeoptions_set_sync(
+        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
+        native_bool);
+}
+
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1cache_1create_1lru
+  (JNIEnv *env, jobject obj, jlong capacity) {
+
+    leveldb_cache_t* retval = leveldb_cache_create_lru(capacity);
+    return reinterpret_cast<jlong>(retval);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1cache_1destroy
+  (JNIEnv *env, jobject obj, jlong cache_ptr) {
+
+    if (cache_ptr == 0) {
+        error(env, "LevelDB cache handle is NULL");
+        return;
+    }
+
+    leveldb_cache_destroy(
+        reinterpret_cast<leveldb_cache_t*>(cache_ptr));
+}
+
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1create_1default_1env
+  (JNIEnv *env, jobject obj) {
+
+    leveldb_env_t* retval = leveldb_create_default_env();
+    return reinterpret_cast<jlong>(retval);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1env_1destroy
+  (JNIEnv *env, jobject obj, jlong env_ptr) {
+
+    if (env_ptr == 0) {
+        error(env, "LevelDB env handle is NULL");
+        return;
+    }
+
+    leveldb_env_destroy(
+        reinterpret_cast<leveldb_env_t*>(env_ptr));
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1set_1marshalling
+  (JNIEnv *env, jobject obj, jint strategy) {
+
+    if (strategy < MARSHAL_AUTO || strategy > MARSHAL_ELEMENTS) {
+        error(env, "LevelDB marshalling strategy is unknown");
+        return;
+    }
+
+    marshal_strategy = strategy;
+}
+
+/*
+ * Group commit. Writers hand their batch to a GroupCommit and wait. The
+ * writer at the head of the queue becomes the leader: it merges the batches
+ * queued behind it into one, applies them with a single leveldb_write using
+ * the committer's (typically synchronous) write options, and wakes every
+ * writer in the group with the shared outcome. The next writer in line then
+ * leads the following group, so concurrent synchronous writers share fsyncs
+ * instead of paying for one each.
+ */
+static const size_t GROUP_COMMIT_MAX_BYTES = 1 << 20;
+
+struct CommitWaiter {
+    leveldb_writebatch_t *batch;
+    char *errptr;
+    bool done;
+    pthread_cond_t cond;
+};
+
+struct GroupCommit {
+    leveldb_t *db;
+    leveldb_writeoptions_t *options;
+    pthread_mutex_t mutex;
+    std::deque<CommitWaiter*> waiters;
+};
+
+/* Copies batch operations into a merged group batch, tracking its size. */
+struct MergeState {
+    leveldb_writebatch_t *batch;
+    size_t bytes;
+};
+
+static void merge_put(void *state, const char *k, size_t klen, const char *v, size_t vlen) {
+    MergeState *merge = static_cast<MergeState*>(state);
+    leveldb_writebatch_put(merge->batch, k, klen, v, vlen);
+    merge->bytes += klen + vlen;
+}
+
+static void merge_delete(void *state, const char *k, size_t klen) {
+    MergeState *merge = static_cast<MergeState*>(state);
+    leveldb_writebatch_delete(merge->batch, k, klen);
+    merge->bytes += klen;
+}
+
+/*
+ * Commits batch through the group committer, blocking until it has been
+ * written as part of some group. On failure *errptr is set to a malloc()ed
+ * status message shared by every batch of the failed group.
+ */
+static void group_commit(GroupCommit *gc, leveldb_writebatch_t *batch, char **errptr) {
+    CommitWaiter self;
+    self.batch = batch;
+    self.errptr = NULL;
+    self.done = false;
+    pthread_cond_init(&self.cond, NULL);
+
+    pthread_mutex_lock(&gc->mutex);
+    gc->waiters.push_back(&self);
+    while (!self.done && gc->waiters.front() != &self) {
+        pthread_cond_wait(&self.cond, &gc->mutex);
+    }
+    if (self.done) {
+        pthread_mutex_unlock(&gc->mutex);
+        pthread_cond_destroy(&self.cond);
+        *errptr = self.errptr;
+        return;
+    }
+
+    // lead a group of the writers queued so far; followers stay parked on
+    // their condition variables, so their batches can be read unlocked
+    std::vector<CommitWaiter*> group(gc->waiters.begin(), gc->waiters.end());
+    pthread_mutex_unlock(&gc->mutex);
+
+    leveldb_writebatch_t *merged = NULL;
+    size_t count = 1;
+    if (group.size() > 1) {
+        merged = leveldb_writebatch_create();
+        MergeState state = { merged, 0 };
+        for (count = 0; count < group.size() && state.bytes < GROUP_COMMIT_MAX_BYTES; count++) {
+            leveldb_writebatch_iterate(group[count]->batch, &state, merge_put, merge_delete);
+        }
+    }
+
+    char *err = NULL;
+    db_write(gc->db, gc->options, merged != NULL ? merged : batch, &err);
+    if (merged != NULL) {
+        leveldb_writebatch_destroy(merged);
+    }
+
+    pthread_mutex_lock(&gc->mutex);
+    for (size_t i = 0; i < count; i++) {
+        CommitWaiter *waiter = gc->waiters.front();
+        gc->waiters.pop_front();
+        if (waiter != &self) {
+            waiter->errptr = err != NULL ? strdup(err) : NULL;
+            waiter->done = true;
+            pthread_cond_signal(&waiter->cond);
+        }
+    }
+    if (!gc->waiters.empty()) {
+        pthread_cond_signal(&gc->waiters.front()->cond);
+    }
+    pthread_mutex_unlock(&gc->mutex);
+
+    pthread_cond_destroy(&self.cond);
+    *errptr = err;
+}
+
+/*
+ * Creates a group committer that writes to db with writeoptions, usually
+ * synchronous ones. The options must outlive the committer.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1group_1commit_1create
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
+    }
+    if (writeoptions_ptr == 0) {
+        error(env, "LevelDB write options handle is NULL");
+        return 0;
+    }
+
+    GroupCommit *gc = new GroupCommit();
+    gc->db = reinterpret_cast<leveldb_t*>(leveldb_ptr);
+    gc->options = reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr);
+    pthread_mutex_init(&gc->mutex, NULL);
+
+    return reinterpret_cast<jlong>(gc);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1group_1commit_1destroy
+  (JNIEnv *env, jobject obj, jlong groupcommit_ptr) {
+
+    if (groupcommit_ptr == 0) {
+        error(env, "LevelDB group commit handle is NULL");
+        return;
+    }
+
+    GroupCommit *gc = reinterpret_cast<GroupCommit*>(groupcommit_ptr);
+    pthread_mutex_destroy(&gc->mutex);
+    delete gc;
+}
+
+/* Writes batch as part of a group and returns once it is durable. */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1group_1commit_1write
+  (JNIEnv *env, jobject obj, jlong groupcommit_ptr, jlong writebatch_ptr) {
+
+    if (groupcommit_ptr == 0) {
+        error(env, "LevelDB group commit handle is NULL");
+        return;
+    }
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return;
+    }
+
+    char* errptr = NULL;
+
+    group_commit(
+        reinterpret_cast<GroupCommit*>(groupcommit_ptr),
+        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr),
+        &errptr);
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return;
+    }
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1group_1commit_1put
+  (JNIEnv *env, jobject obj, jlong groupcommit_ptr, jbyteArray key, jbyteArray value) {
+
+    if (groupcommit_ptr == 0) {
+        error(env, "LevelDB group commit handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+    if (value == 0) {
+        error(env, "LevelDB value is NULL");
+        return;
+    }
+
+    leveldb_writebatch_t *batch = leveldb_writebatch_create();
+    {
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) {
+            leveldb_writebatch_destroy(batch);
+            return;
+        }
+        ArrayCopy value_bytes(env, value);
+        if (value_bytes.data() == NULL) {
+            leveldb_writebatch_destroy(batch);
+            return;
+        }
+        leveldb_writebatch_put(
+            batch,
+            key_bytes.data(),
+            key_bytes.size(),
+            value_bytes.data(),
+            value_bytes.size());
+    }
+
+    char* errptr = NULL;
+
+    group_commit(reinterpret_cast<GroupCommit*>(groupcommit_ptr), batch, &errptr);
+    leveldb_writebatch_destroy(batch);
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return;
+    }
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1group_1commit_1delete
+  (JNIEnv *env, jobject obj, jlong groupcommit_ptr, jbyteArray key) {
+
+    if (groupcommit_ptr == 0) {
+        error(env, "LevelDB group commit handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+
+    leveldb_writebatch_t *batch = leveldb_writebatch_create();
+    {
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) {
+            leveldb_writebatch_destroy(batch);
+            return;
+        }
+        leveldb_writebatch_delete(batch, key_bytes.data(), key_bytes.size());
+    }
+
+    char* errptr = NULL;
+
+    group_commit(reinterpret_cast<GroupCommit*>(groupcommit_ptr), batch, &errptr);
+    leveldb_writebatch_destroy(batch);
+
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
+        return;
+    }
+}
+
+/*
+ * Asynchronous writes. Batches submitted to an AsyncWriter are queued and
+ * applied in submission order by a native writer thread, which merges
+ * whatever has queued up, up to GROUP_COMMIT_MAX_BYTES, into one
+ * leveldb_write. Each submission gets a ticket; tickets are consecutive,
+ * so "completed >= N" means every batch up to N has been written. The
+ * writer stops at the first failed write: later batches are discarded and
+ * awaiting them reports that failure.
+ */
+struct AsyncWriter {
+    leveldb_t *db;
+    leveldb_writeoptions_t *options;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    std::deque<leveldb_writebatch_t*> queue;
+    jlong submitted;
+    jlong completed;
+    jlong failed;
+    char *errptr;
+    bool stopping;
+};
+
+static void* async_writer_main(void *arg) {
+    AsyncWriter *writer = static_cast<AsyncWriter*>(arg);
+
+    pthread_mutex_lock(&writer->mutex);
+    while (true) {
+        while (writer->queue.empty() && !writer->stopping) {
+            pthread_cond_wait(&writer->work_cond, &writer->mutex);
+        }
+        if (writer->queue.empty()) {
+            break;
+        }
+        // submissions only append, so the front of the queue stays put
+        // while it is read unlocked
+        std::vector<leveldb_writebatch_t*> group(writer->queue.begin(), writer->queue.end());
+        jlong first = writer->completed + 1;
+        bool failed = writer->failed != 0;
+        pthread_mutex_unlock(&writer->mutex);
+
+        char *err = NULL;
+        size_t count = group.size();
+        if (!failed) {
+            leveldb_writebatch_t *merged = group[0];
+            count = 1;
+            if (group.size() > 1) {
+                merged = leveldb_writebatch_create();
+                MergeState state = { merged, 0 };
+                for (count = 0; count < group.size() && state.bytes < GROUP_COMMIT_MAX_BYTES; count++) {
+                    leveldb_writebatch_iterate(group[count], &state, merge_put, merge_delete);
+                }
+            }
+            db_write(writer->db, writer->options, merged, &err);
+            if (merged != group[0]) {
+                leveldb_writebatch_destroy(merged);
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            leveldb_writebatch_destroy(group[i]);
+        }
+
+        pthread_mutex_lock(&writer->mutex);
+        writer->queue.erase(writer->queue.begin(), writer->queue.begin() + count);
+        if (err != NULL) {
+            writer->failed = first;
+            writer->errptr = err;
+        }
+        if (writer->failed == 0) {
+            writer->completed += count;
+        }
+        pthread_cond_broadcast(&writer->done_cond);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+    return NULL;
+}
+
+/*
+ * Creates an asynchronous writer for db and starts its writer thread. The
+ * write options decide durability and must outlive the writer.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1async_1writer_1create
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
+    }
+    if (writeoptions_ptr == 0) {
+        error(env, "LevelDB write options handle is NULL");
+        return 0;
+    }
+
+    AsyncWriter *writer = new AsyncWriter();
+    writer->db = reinterpret_cast<leveldb_t*>(leveldb_ptr);
+    writer->options = reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr);
+    writer->submitted = 0;
+    writer->completed = 0;
+    writer->failed = 0;
+    writer->errptr = NULL;
+    writer->stopping = false;
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->work_cond, NULL);
+    pthread_cond_init(&writer->done_cond, NULL);
+
+    if (pthread_create(&writer->thread, NULL, async_writer_main, writer) != 0) {
+        pthread_cond_destroy(&writer->done_cond);
+        pthread_cond_destroy(&writer->work_cond);
+        pthread_mutex_destroy(&writer->mutex);
+        delete writer;
+        error(env, "LevelDB async writer thread could not be started");
+        return 0;
+    }
+
+    return reinterpret_cast<jlong>(writer);
+}
+
+/* Applies everything still queued, then stops the writer thread. */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1async_1writer_1destroy
+  (JNIEnv *env, jobject obj, jlong asyncwriter_ptr) {
+
+    if (asyncwriter_ptr == 0) {
+        error(env, "LevelDB async writer handle is NULL");
+        return;
+    }
+
+    AsyncWriter *writer = reinterpret_cast<AsyncWriter*>(asyncwriter_ptr);
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->stopping = true;
+    pthread_cond_signal(&writer->work_cond);
+    pthread_mutex_unlock(&writer->mutex);
+    pthread_join(writer->thread, NULL);
+
+    free(writer->errptr);
+    pthread_cond_destroy(&writer->done_cond);
+    pthread_cond_destroy(&writer->work_cond);
+    pthread_mutex_destroy(&writer->mutex);
+    delete writer;
+}
+
+/*
+ * Queues writebatch and returns its ticket without waiting. The writer takes
+ * ownership of the batch and destroys it once applied, or at once if an
+ * earlier write has failed and the failure is thrown instead.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1async_1submit
+  (JNIEnv *env, jobject obj, jlong asyncwriter_ptr, jlong writebatch_ptr) {
+
+    if (asyncwriter_ptr == 0) {
+        error(env, "LevelDB async writer handle is NULL");
+        return 0;
+    }
+    if (writebatch_ptr == 0) {
+        error(env, "LevelDB write batch handle is NULL");
+        return 0;
+    }
+
+    AsyncWriter *writer = reinterpret_cast<AsyncWriter*>(asyncwriter_ptr);
+
+    pthread_mutex_lock(&writer->mutex);
+    if (writer->failed != 0) {
+        std::string msg(writer->errptr);
+        pthread_mutex_unlock(&writer->mutex);
+        leveldb_writebatch_destroy(reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr));
+        status_error(env, msg.c_str());
+        return 0;
+    }
+    writer->queue.push_back(reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr));
+    jlong ticket = ++writer->submitted;
+    pthread_cond_signal(&writer->work_cond);
+    pthread_mutex_unlock(&writer->mutex);
+
+    return ticket;
+}
+
+/*
+ * Returns the highest ticket N such that every batch up to N has been
+ * written. Never blocks.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1async_1completed
+  (JNIEnv *env, jobject obj, jlong asyncwriter_ptr) {
+
+    if (asyncwriter_ptr == 0) {
+        error(env, "LevelDB async writer handle is NULL");
+        return 0;
+    }
+
+    AsyncWriter *writer = reinterpret_cast<AsyncWriter*>(asyncwriter_ptr);
+
+    pthread_mutex_lock(&writer->mutex);
+    jlong completed = writer->completed;
+    pthread_mutex_unlock(&writer->mutex);
+
+    return completed;
+}
+
+/*
+ * Waits until every batch up to ticket has been written, for at most
+ * timeout_millis (negative to wait forever). Returns false on timeout, and
+ * throws if a batch up to ticket failed.
+ */
+JNIEXPORT jboolean JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1async_1await
+  (JNIEnv *env, jobject obj, jlong asyncwriter_ptr, jlong ticket, jlong timeout_millis) {
+
+    if (asyncwriter_ptr == 0) {
+        error(env, "LevelDB async writer handle is NULL");
+        return 0;
+    }
+
+    AsyncWriter *writer = reinterpret_cast<AsyncWriter*>(asyncwriter_ptr);
+
+    struct timespec deadline;
+    if (timeout_millis >= 0) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        jlong nanos = (jlong)now.tv_usec * 1000 + (timeout_millis % 1000) * 1000000;
+        deadline.tv_sec = now.tv_sec + timeout_millis / 1000 + nanos / 1000000000;
+        deadline.tv_nsec = nanos % 1000000000;
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+    bool timed_out = false;
+    while (writer->completed < ticket && !(writer->failed != 0 && writer->failed <= ticket)) {
+        if (timeout_millis < 0) {
+            pthread_cond_wait(&writer->done_cond, &writer->mutex);
+        }
+        else if (pthread_cond_timedwait(&writer->done_cond, &writer->mutex, &deadline) == ETIMEDOUT) {
+            timed_out = writer->completed < ticket;
+            break;
+        }
+    }
+    if (writer->completed < ticket && writer->failed != 0 && writer->failed <= ticket) {
+        std::string msg(writer->errptr);
+        pthread_mutex_unlock(&writer->mutex);
+        status_error(env, msg.c_str());
+        return 0;
+    }
+    pthread_mutex_unlock(&writer->mutex);
+
+    return timed_out ? 0 : 1;
+}
+
+/*
+ * Sorted bulk load. A BulkLoader writes the keys of a new database, in
+ * strictly increasing order, straight into table files at the bottom level,
+ * then writes a MANIFEST listing them and points CURRENT at it. Nothing goes
+ * through the log, the memtable or compactions, so each byte is written once.
+ * The leveldb internals that build and install tables are not usable from
+ * here, so the table, log and version edit formats are written directly.
+ * Tables are uncompressed, every entry has sequence number 1, and only the
+ * default bytewise comparator is supported.
+ */
+namespace leveldb {
+namespace crc32c {
+uint32_t Extend(uint32_t init_crc, const char *data, size_t n);
+}
+}
+
+static const size_t BULK_BLOCK_SIZE = 4096;
+static const int BULK_RESTART_INTERVAL = 16;
+static const int BULK_LEVEL = 6;
+static const uint64_t BULK_SEQUENCE = 1;
+static const uint64_t BULK_MANIFEST_NUMBER = 1;
+static const char BULK_MANIFEST_NAME[] = "MANIFEST-000001";
+static const uint64_t TABLE_MAGIC_NUMBER = 0xdb4775248b80fb57ull;
+static const size_t FOOTER_HANDLES_SIZE = 40;
+static const size_t LOG_BLOCK_SIZE = 32768;
+static const size_t LOG_HEADER_SIZE = 7;
+
+/* Version edit field tags. */
+static const int EDIT_COMPARATOR = 1;
+static const int EDIT_LOG_NUMBER = 2;
+static const int EDIT_NEXT_FILE_NUMBER = 3;
+static const int EDIT_LAST_SEQUENCE = 4;
+static const int EDIT_NEW_FILE = 7;
+
+static inline uint32_t masked_crc(uint32_t crc) {
+    return ((crc >> 15) | (crc << 17)) + 0xa282ead8ul;
+}
+
+static void put_fixed32(std::string &dst, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        dst.push_back((char)(value >> (8 * i)));
+    }
+}
+
+static void put_fixed64(std::string &dst, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        dst.push_back((char)(value >> (8 * i)));
+    }
+}
+
+static void put_varint64(std::string &dst, uint64_t value) {
+    while (value >= 128) {
+        dst.push_back((char)(value | 128));
+        value >>= 7;
+    }
+    dst.push_back((char)value);
+}
+
+static void put_length_prefixed(std::string &dst, const std::string &value) {
+    put_varint64(dst, value.size());
+    dst.append(value);
+}
+
+/* Builds one table block: prefix compressed entries and a restart array. */
+struct BlockWriter {
+    std::string buffer;
+    std::vector<uint32_t> restarts;
+    std::string last_key;
+    int counter;
+    int interval;
+};
+
+static void block_reset(BlockWriter *block, int interval) {
+    block->buffer.clear();
+    block->restarts.assign(1, 0);
+    block->last_key.clear();
+    block->counter = 0;
+    block->interval = interval;
+}
+
+static void block_add(BlockWriter *block, const std::string &key, const char *value, size_t vallen) {
+    size_t shared = 0;
+    if (block->counter < block->interval) {
+        size_t limit = std::min(block->last_key.size(), key.size());
+        while (shared < limit && block->last_key[shared] == key[shared]) {
+            shared++;
+        }
+    }
+    else {
+        block->restarts.push_back(block->buffer.size());
+        block->counter = 0;
+    }
+    put_varint64(block->buffer, shared);
+    put_varint64(block->buffer, key.size() - shared);
+    put_varint64(block->buffer, vallen);
+    block->buffer.append(key, shared, std::string::npos);
+    block->buffer.append(value, vallen);
+    block->last_key = key;
+    block->counter++;
+}
+
+static size_t block_size(const BlockWriter *block) {
+    return block->buffer.size() + 4 * block->restarts.size() + 4;
+}
+
+static void block_finish(BlockWriter *block) {
+    for (size_t i = 0; i < block->restarts.size(); i++) {
+        put_fixed32(block->buffer, block->restarts[i]);
+    }
+    put_fixed32(block->buffer, block->restarts.size());
+}
+
+struct BulkTable {
+    uint64_t number;
+    uint64_t size;
+    std::string smallest;
+    std::string largest;
+};
+
+struct BulkLoader {
+    std::string dbname;
+    uint64_t max_file_size;
+    FILE *file;
+    BulkTable table;
+    BlockWriter data;
+    BlockWriter index;
+    std::string key;
+    bool has_key;
+    std::vector<BulkTable> tables;
+    uint64_t next_file_number;
+    bool finished;
+    std::string error;
+};
+
+static std::string bulk_file_name(const BulkLoader *loader, uint64_t number, const char *suffix) {
+    char name[64];
+    snprintf(name, sizeof(name), "/%06llu.%s", (unsigned long long)number, suffix);
+    return loader->dbname + name;
+}
+
+static void bulk_io_error(BulkLoader *loader, const std::string &fname) {
+    if (loader->error.empty()) {
+        loader->error = "IO error: " + fname + ": " + strerror(errno);
+    }
+}
+
+/* Writes contents with its block trailer and encodes its handle into handle. */
+static void bulk_write_block(BulkLoader *loader, const std::string &contents, std::string &handle) {
+    handle.clear();
+    put_varint64(handle, loader->table.size);
+    put_varint64(handle, contents.size());
+
+    char trailer[5];
+    trailer[0] = 0; // no compression
+    uint32_t crc = leveldb::crc32c::Extend(0, contents.data(), contents.size());
+    crc = masked_crc(leveldb::crc32c::Extend(crc, trailer, 1));
+    for (int i = 0; i < 4; i++) {
+        trailer[1 + i] = (char)(crc >> (8 * i));
+    }
+
+    if (fwrite(contents.data(), 1, contents.size(), loader->file) != contents.size() ||
+        fwrite(trailer, 1, sizeof(trailer), loader->file) != sizeof(trailer)) {
+        bulk_io_error(loader, bulk_file_name(loader, loader->table.number, "sst"));
+    }
+    loader->table.size += contents.size() + sizeof(trailer);
+}
+
+/* Writes the pending data block and indexes it under its last key. */
+static void bulk_flush_block(BulkLoader *loader) {
+    if (loader->data.counter == 0) {
+        return;
+    }
+    block_finish(&loader->data);
+    std::string handle;
+    bulk_write_block(loader, loader->data.buffer, handle);
+    block_add(&loader->index, loader->data.last_key, handle.data(), handle.size());
+    block_reset(&loader->data, BULK_RESTART_INTERVAL);
+}
+
+static void bulk_open_table(BulkLoader *loader) {
+    loader->table.number = loader->next_file_number++;
+    loader->table.size = 0;
+    std::string fname = bulk_file_name(loader, loader->table.number, "sst");
+    loader->file = fopen(fname.c_str(), "wb");
+    if (loader->file == NULL) {
+        bulk_io_error(loader, fname);
+    }
+    block_reset(&loader->data, BULK_RESTART_INTERVAL);
+    block_reset(&loader->index, 1);
+}
+
+/* Finishes the open table with its index and footer and syncs it. */
+static void bulk_close_table(BulkLoader *loader) {
+    bulk_flush_block(loader);
+    loader->table.largest = loader->index.last_key;
+
+    BlockWriter metaindex;
+    block_reset(&metaindex, BULK_RESTART_INTERVAL);
+    block_finish(&metaindex);
+    std::string metaindex_handle;
+    bulk_write_block(loader, metaindex.buffer, metaindex_handle);
+
+    block_finish(&loader->index);
+    std::string index_handle;
+    bulk_write_block(loader, loader->index.buffer, index_handle);
+
+    std::string footer = metaindex_handle + index_handle;
+    footer.resize(FOOTER_HANDLES_SIZE);
+    put_fixed64(footer, TABLE_MAGIC_NUMBER);
+
+    std::string fname = bulk_file_name(loader, loader->table.number, "sst");
+    if (fwrite(footer.data(), 1, footer.size(), loader->file) != footer.size() ||
+        fflush(loader->file) != 0 || fsync(fileno(loader->file)) != 0) {
+        bulk_io_error(loader, fname);
+    }
+    loader->table.size += footer.size();
+    if (fclose(loader->file) != 0) {
+        bulk_io_error(loader, fname);
+    }
+    loader->file = NULL;
+    loader->tables.push_back(loader->table);
+}
+
+static void bulk_add(BulkLoader *loader, const char *key, size_t keylen, const char *value, size_t vallen) {
+    if (!loader->error.empty()) {
+        return;
+    }
+    if (loader->finished) {
+        loader->error = "Invalid argument: bulk load is already finished";
+        return;
+    }
+    if (loader->has_key && compare_keys(key, keylen, loader->key.data(), loader->key.size()) <= 0) {
+        loader->error = "Invalid argument: bulk load keys must be strictly increasing";
+        return;
+    }
+    loader->key.assign(key, keylen);
+    loader->has_key = true;
+
+    if (loader->file == NULL) {
+        bulk_open_table(loader);
+        if (!loader->error.empty()) return;
+    }
+
+    std::string internal_key(key, keylen);
+    put_fixed64(internal_key, (BULK_SEQUENCE << 8) | 1); // kTypeValue
+    if (loader->data.counter == 0 && loader->index.counter == 0) {
+        loader->table.smallest = internal_key;
+    }
+    block_add(&loader->data, internal_key, value, vallen);
+
+    if (block_size(&loader->data) >= BULK_BLOCK_SIZE) {
+        bulk_flush_block(loader);
+        if (loader->table.size >= loader->max_file_size) {
+            bulk_close_table(loader);
+        }
+    }
+}
+
+/* Appends record to a log file as FULL, FIRST, MIDDLE and LAST fragments. */
+static void log_add_record(std::string &log, const std::string &record) {
+    size_t left = record.size();
+    const char *p = record.data();
+    bool begin = true;
+    do {
+        size_t leftover = LOG_BLOCK_SIZE - log.size() % LOG_BLOCK_SIZE;
+        if (leftover < LOG_HEADER_SIZE) {
+            log.append(leftover, '\0');
+            leftover = LOG_BLOCK_SIZE;
+        }
+        size_t fragment = std::min(left, leftover - LOG_HEADER_SIZE);
+        bool end = fragment == left;
+        char type = begin && end ? 1 : begin ? 2 : end ? 4 : 3;
+
+        uint32_t crc = masked_crc(leveldb::crc32c::Extend(
+            leveldb::crc32c::Extend(0, &type, 1), p, fragment));
+        put_fixed32(log, crc);
+        log.push_back((char)(fragment & 0xff));
+        log.push_back((char)(fragment >> 8));
+        log.push_back(type);
+        log.append(p, fragment);
+
+        p += fragment;
+        left -= fragment;
+        begin = false;
+    } while (left > 0);
+}
+
+static void bulk_write_file(BulkLoader *loader, const std::string &fname, const std::string &contents) {
+    FILE *file = fopen(fname.c_str(), "wb");
+    if (file == NULL) {
+        bulk_io_error(loader, fname);
+        return;
+    }
+    if (fwrite(contents.data(), 1, contents.size(), file) != contents.size() ||
+        fflush(file) != 0 || fsync(fileno(file)) != 0) {
+        bulk_io_error(loader, fname);
+    }
+    if (fclose(file) != 0) {
+        bulk_io_error(loader, fname);
+    }
+}
+
+/*
+ * Closes the last table and installs all of them at BULK_LEVEL with a new
+ * MANIFEST. CURRENT is written last, so an interrupted load never leaves a
+ * database that opens with part of the data.
+ */
+static void bulk_finish(BulkLoader *loader) {
+    if (!loader->error.empty()) {
+        return;
+    }
+    if (loader->finished) {
+        loader->error = "Invalid argument: bulk load is already finished";
+        return;
+    }
+    if (loader->file != NULL) {
+        bulk_close_table(loader);
+    }
+
+    std::string edit;
+    put_varint64(edit, EDIT_COMPARATOR);
+    put_length_prefixed(edit, "leveldb.BytewiseComparator");
+    put_varint64(edit, EDIT_LOG_NUMBER);
+    put_varint64(edit, 0);
+    put_varint64(edit, EDIT_NEXT_FILE_NUMBER);
+    put_varint64(edit, loader->next_file_number);
+    put_varint64(edit, EDIT_LAST_SEQUENCE);
+    put_varint64(edit, loader->tables.empty() ? 0 : BULK_SEQUENCE);
+    for (size_t i = 0; i < loader->tables.size(); i++) {
+        const BulkTable &table = loader->tables[i];
+        put_varint64(edit, EDIT_NEW_FILE);
+        put_varint64(edit, BULK_LEVEL);
+        put_varint64(edit, table.number);
+        put_varint64(edit, table.size);
+        put_length_prefixed(edit, table.smallest);
+        put_length_prefixed(edit, table.largest);
+    }
+
+    std::string manifest;
+    log_add_record(manifest, edit);
+    bulk_write_file(loader, loader->dbname + "/" + BULK_MANIFEST_NAME, manifest);
+
+    std::string tmpname = bulk_file_name(loader, BULK_MANIFEST_NUMBER, "dbtmp");
+    bulk_write_file(loader, tmpname, std::string(BULK_MANIFEST_NAME) + "\n");
+    if (loader->error.empty() && rename(tmpname.c_str(), (loader->dbname + "/CURRENT").c_str()) != 0) {
+        bulk_io_error(loader, tmpname);
+    }
+    if (loader->error.empty()) {
+        loader->finished = true;
+    }
+}
+
+/*
+ * Starts a bulk load into the new database name, cutting a new table file
+ * whenever one reaches max_file_size bytes.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1bulkload_1create
+  (JNIEnv *env, jobject obj, jstring name, jlong max_file_size) {
+
+    if (name == NULL) {
+        error(env, "LevelDB filename is NULL");
+        return 0;
+    }
+    if (max_file_size <= 0) {
+        error(env, "LevelDB bulk load file size must be positive");
+        return 0;
+    }
+
+    const char* utf_chars = env->GetStringUTFChars(name, NULL);
+    assert(utf_chars);
+    std::string dbname(utf_chars);
+    env->ReleaseStringUTFChars(name, utf_chars);
+
+    mkdir(dbname.c_str(), 0755);
+    std::string current = dbname + "/CURRENT";
+    if (access(current.c_str(), F_OK) == 0) {
+        std::string msg = "Invalid argument: " + dbname + ": exists (bulk load needs a new database)";
+        status_error(env, msg.c_str());
+        return 0;
+    }
+
+    BulkLoader *loader = new BulkLoader();
+    loader->dbname = dbname;
+    loader->max_file_size = max_file_size;
+    loader->file = NULL;
+    loader->has_key = false;
+    loader->next_file_number = BULK_MANIFEST_NUMBER + 1;
+    loader->finished = false;
+    return reinterpret_cast<jlong>(loader);
+}
+
+/* Removes the files of an unfinished load. */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1bulkload_1destroy
+  (JNIEnv *env, jobject obj, jlong bulkload_ptr) {
+
+    if (bulkload_ptr == 0) {
+        error(env, "LevelDB bulk load handle is NULL");
+        return;
+    }
+
+    BulkLoader *loader = reinterpret_cast<BulkLoader*>(bulkload_ptr);
+    if (!loader->finished) {
+        if (loader->file != NULL) {
+            fclose(loader->file);
+        }
+        for (uint64_t number = BULK_MANIFEST_NUMBER + 1; number < loader->next_file_number; number++) {
+            unlink(bulk_file_name(loader, number, "sst").c_str());
+        }
+        unlink((loader->dbname + "/" + BULK_MANIFEST_NAME).c_str());
+        unlink(bulk_file_name(loader, BULK_MANIFEST_NUMBER, "dbtmp").c_str());
+    }
+    delete loader;
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1bulkload_1add
+  (JNIEnv *env, jobject obj, jlong bulkload_ptr, jbyteArray key, jbyteArray value) {
+
+    if (bulkload_ptr == 0) {
+        error(env, "LevelDB bulk load handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+    if (value == 0) {
+        error(env, "LevelDB value is NULL");
+        return;
+    }
+
+    BulkLoader *loader = reinterpret_cast<BulkLoader*>(bulkload_ptr);
+    {
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) return;
+        ArrayCopy value_bytes(env, value);
+        if (value_bytes.data() == NULL) return;
+        bulk_add(loader, key_bytes.data(), key_bytes.size(), value_bytes.data(), value_bytes.size());
+    }
+
+    if (!loader->error.empty()) {
+        status_error(env, loader->error.c_str());
+    }
+}
+
+/*
+ * Adds the entries packed in buffer[offset..offset+length), each as a 32-bit
+ * key length, the key, a 32-bit value length and the value.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1bulkload_1add_1packed
+  (JNIEnv *env, jobject obj, jlong bulkload_ptr, jobject entries, jint entries_offset, jint entries_length) {
+
+    if (bulkload_ptr == 0) {
+        error(env, "LevelDB bulk load handle is NULL");
+        return;
+    }
+    if (entries == 0) {
+        error(env, "LevelDB buffer is NULL");
+        return;
+    }
+
+    const char *p = direct_address(env, entries, entries_offset, entries_length);
+    if (p == NULL) return;
+
+    BulkLoader *loader = reinterpret_cast<BulkLoader*>(bulkload_ptr);
+    const char *limit = p + entries_length;
+    while (p < limit && loader->error.empty()) {
+        const char *fields[2] = { NULL, NULL };
+        uint32_t lengths[2] = { 0, 0 };
+        for (int i = 0; i < 2; i++) {
+            if (limit - p < 4 || (size_t)(limit - p - 4) < decode_int32(p)) {
+                loader->error = "Invalid argument: bulk load buffer is truncated";
+                break;
+            }
+            lengths[i] = decode_int32(p);
+            fields[i] = p + 4;
+            p += 4 + lengths[i];
+        }
+        if (loader->error.empty()) {
+            bulk_add(loader, fields[0], lengths[0], fields[1], lengths[1]);
+        }
+    }
+
+    if (!loader->error.empty()) {
+        status_error(env, loader->error.c_str());
+    }
+}
+
+/* Writes the last table and the MANIFEST, after which name can be opened. */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1bulkload_1finish
+  (JNIEnv *env, jobject obj, jlong bulkload_ptr) {
+
+    if (bulkload_ptr == 0) {
+        error(env, "LevelDB bulk load handle is NULL");
+        return;
+    }
+
+    BulkLoader *loader = reinterpret_cast<BulkLoader*>(bulkload_ptr);
+    bulk_finish(loader);
+
+    if (!loader->error.empty()) {
+        status_error(env, loader->error.c_str());
+    }
+}
+
+/*
+ * External-sort ingestion. Unsorted entries are collected into runs of
+ * bounded size; each full run is handed to a worker thread that sorts it and
+ * spills it to an unlinked temporary file while the caller keeps adding.
+ * Finishing merges the runs and applies them in key order, either through
+ * large leveldb_write batches or into a BulkLoader. When a key was added more
+ * than once the last value wins, as it would with leveldb_put. Each run
+ * being merged holds a file and a read buffer, so when there are more than
+ * the memory limit (or INGEST_MAX_MERGE_WIDTH) allows, runs are first merged
+ * in groups into fewer, larger spill files.
+ */
+static const size_t INGEST_WRITE_BYTES = 4 << 20;
+static const size_t INGEST_SPILL_CHUNK = 1 << 20;
+static const size_t INGEST_MIN_READ_BUFFER = 64 << 10;
+static const size_t INGEST_MAX_MERGE_WIDTH = 64;
+
+struct IngestEntry {
+    size_t offset;
+    uint32_t keylen;
+    uint32_t vallen;
+};
+
+struct IngestRun {
+    size_t number;
+    std::vector<char> data;
+    std::vector<IngestEntry> entries;
+};
+
+struct IngestEntryLess {
+    const char *data;
+    bool operator()(const IngestEntry &a, const IngestEntry &b) const {
+        return compare_keys(data + a.offset, a.keylen, data + b.offset, b.keylen) < 0;
+    }
+};
+
+struct Ingest {
+    std::string tmpdir;
+    size_t memory_limit;
+    size_t run_size;
+    IngestRun *current;
+    std::vector<pthread_t> workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    std::deque<IngestRun*> pending;
+    int sorting;
+    std::vector<int> spills;
+    bool stopping;
+    bool finished;
+    std::string error;
+};
+
+static void ingest_fail(Ingest *ingest, const std::string &msg) {
+    if (ingest->error.empty()) {
+        ingest->error = msg;
+    }
+}
+
+static bool write_fully(int fd, const char *p, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, p, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += written;
+        length -= written;
+    }
+    return true;
+}
+
+/*
+ * Creates an unlinked temporary file in tmpdir. Returns the file
+ * descriptor, or -1 with the reason in msg.
+ */
+static int ingest_tempfile(const std::string &tmpdir, std::string &fname, std::string &msg) {
+    fname = tmpdir + "/jleveldb-ingest-XXXXXX";
+    std::vector<char> name(fname.begin(), fname.end());
+    name.push_back('\0');
+    int fd = mkstemp(&name[0]);
+    if (fd < 0) {
+        msg = "IO error: " + fname + ": " + strerror(errno);
+        return -1;
+    }
+    unlink(&name[0]);
+    return fd;
+}
+
+/*
+ * Sorts run and writes it to a new temporary file, keeping only the last
+ * value added for each key. Returns the file descriptor, or -1 with the
+ * reason in msg.
+ */
+static int ingest_spill(const std::string &tmpdir, IngestRun *run, std::string &msg) {
+    IngestEntryLess less = { run->data.empty() ? NULL : &run->data[0] };
+    std::stable_sort(run->entries.begin(), run->entries.end(), less);
+
+    std::string fname;
+    int fd = ingest_tempfile(tmpdir, fname, msg);
+    if (fd < 0) {
+        return -1;
+    }
+
+    std::vector<char> chunk;
+    for (size_t i = 0; i < run->entries.size(); i++) {
+        const IngestEntry &entry = run->entries[i];
+        if (i + 1 < run->entries.size() && !less(entry, run->entries[i + 1])) {
+            continue; // superseded by a later value for the same key
+        }
+        append_int32(chunk, entry.keylen);
+        append_int32(chunk, entry.vallen);
+        chunk.insert(chunk.end(), run->data.begin() + entry.offset,
+                     run->data.begin() + entry.offset + entry.keylen + entry.vallen);
+        if (chunk.size() >= INGEST_SPILL_CHUNK || i + 1 == run->entries.size()) {
+            if (!write_fully(fd, &chunk[0], chunk.size())) {
+                msg = "IO error: " + fname + ": " + strerror(errno);
+                close(fd);
+                return -1;
+            }
+            chunk.clear();
+        }
+    }
+    return fd;
+}
+
+static void* ingest_worker_main(void *arg) {
+    Ingest *ingest = static_cast<Ingest*>(arg);
+
+    pthread_mutex_lock(&ingest->mutex);
+    while (true) {
+        while (ingest->pending.empty() && !ingest->stopping) {
+            pthread_cond_wait(&ingest->work_cond, &ingest->mutex);
+        }
+        if (ingest->pending.empty()) {
+            break;
+        }
+        IngestRun *run = ingest->pending.front();
+        ingest->pending.pop_front();
+        ingest->sorting++;
+        pthread_mutex_unlock(&ingest->mutex);
+
+        std::string msg;
+        int fd = ingest_spill(ingest->tmpdir, run, msg);
+
+        pthread_mutex_lock(&ingest->mutex);
+        if (fd < 0) {
+            ingest_fail(ingest, msg);
+        }
+        else {
+            ingest->spills[run->number] = fd;
+        }
+        delete run;
+        ingest->sorting--;
+        pthread_cond_broadcast(&ingest->done_cond);
+    }
+    pthread_mutex_unlock(&ingest->mutex);
+    return NULL;
+}
+
+/*
+ * Hands the current run to the workers, first waiting for one to be free so
+ * no more than one run per worker, plus the one being filled, is in memory.
+ */
+static void ingest_seal(Ingest *ingest) {
+    IngestRun *run = ingest->current;
+    if (run->entries.empty()) {
+        return;
+    }
+
+    pthread_mutex_lock(&ingest->mutex);
+    while (ingest->pending.size() + ingest->sorting >= ingest->workers.size()) {
+        pthread_cond_wait(&ingest->done_cond, &ingest->mutex);
+    }
+    run->number = ingest->spills.size();
+    ingest->spills.push_back(-1);
+    ingest->pending.push_back(run);
+    pthread_cond_signal(&ingest->work_cond);
+    pthread_mutex_unlock(&ingest->mutex);
+
+    ingest->current = new IngestRun();
+    ingest->current->data.reserve(ingest->run_size);
+}
+
+static void ingest_add(Ingest *ingest, const char *key, size_t keylen, const char *value, size_t vallen) {
+    if (ingest->finished) {
+        ingest_fail(ingest, "Invalid argument: ingest is already finished");
+        return;
+    }
+
+    IngestRun *run = ingest->current;
+    if (!run->entries.empty() && run->data.size() + keylen + vallen > ingest->run_size) {
+        ingest_seal(ingest);
+        run = ingest->current;
+    }
+    IngestEntry entry = { run->data.size(), (uint32_t)keylen, (uint32_t)vallen };
+    run->data.insert(run->data.end(), key, key + keylen);
+    run->data.insert(run->data.end(), value, value + vallen);
+    run->entries.push_back(entry);
+}
+
+/* Reads one spilled run back in key order during the merge. */
+struct SpillReader {
+    FILE *file;
+    size_t run;
+    std::string key;
+    std::string value;
+};
+
+/*
+ * Moves reader to its next entry. Returns false at the end of the run, and
+ * also when the file cannot be read or ends inside an entry, in which case
+ * the ingest fails rather than losing the rest of the run.
+ */
+static bool spill_next(Ingest *ingest, SpillReader *reader) {
+    char lengths[8];
+    size_t n = fread(lengths, 1, 8, reader->file);
+    if (n == 0 && feof(reader->file) && !ferror(reader->file)) {
+        return false;
+    }
+    if (n == 8) {
+        reader->key.resize(decode_int32(lengths));
+        reader->value.resize(decode_int32(lengths + 4));
+        if ((reader->key.empty() ||
+             fread(&reader->key[0], 1, reader->key.size(), reader->file) == reader->key.size()) &&
+            (reader->value.empty() ||
+             fread(&reader->value[0], 1, reader->value.size(), reader->file) == reader->value.size())) {
+            return true;
+        }
+    }
+    if (ferror(reader->file)) {
+        ingest_fail(ingest, std::string("IO error: ingest spill file: ") + strerror(errno));
+    }
+    else {
+        ingest_fail(ingest, "Corruption: ingest spill file is truncated");
+    }
+    return false;
+}
+
+/*
+ * Heap order for the merge: the smallest key on top and, among equal keys,
+ * the most recent run, whose value wins.
+ */
+struct SpillReaderAfter {
+    bool operator()(const SpillReader *a, const SpillReader *b) const {
+        int r = compare_keys(a->key.data(), a->key.size(), b->key.data(), b->key.size());
+        return r > 0 || (r == 0 && a->run < b->run);
+    }
+};
+
+/* Where merged entries go: a database or a bulk load. */
+struct IngestSink {
+    leveldb_t *db;
+    leveldb_writeoptions_t *options;
+    leveldb_writebatch_t *batch;
+    size_t bytes;
+    BulkLoader *loader;
+};
+
+static void ingest_flush_sink(Ingest *ingest, IngestSink *sink) {
+    if (sink->batch == NULL || sink->bytes == 0) {
+        return;
+    }
+    char *errptr = NULL;
+    db_write(sink->db, sink->options, sink->batch, &errptr);
+    if (errptr != NULL) {
+        ingest_fail(ingest, errptr);
+        free(errptr);
+    }
+    leveldb_writebatch_clear(sink->batch);
+    sink->bytes = 0;
+}
+
+static void ingest_emit(Ingest *ingest, IngestSink *sink, const std::string &key, const std::string &value) {
+    if (sink->loader != NULL) {
+        bulk_add(sink->loader, key.data(), key.size(), value.data(), value.size());
+        if (!sink->loader->error.empty()) {
+            ingest_fail(ingest, sink->loader->error);
+        }
+        return;
+    }
+    leveldb_writebatch_put(sink->batch, key.data(), key.size(), value.data(), value.size());
+    sink->bytes += key.size() + value.size();
+    if (sink->bytes >= INGEST_WRITE_BYTES) {
+        ingest_flush_sink(ingest, sink);
+    }
 }
 
-JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1open
-  (JNIEnv *env, jobject obj, jlong options_ptr, jstring name) {
+/* A spill file written by a merge pass, in the layout ingest_spill writes. */
+struct SpillWriter {
+    int fd;
+    std::vector<char> chunk;
+};
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
+static void spill_write(Ingest *ingest, SpillWriter *writer) {
+    if (!writer->chunk.empty() && !write_fully(writer->fd, &writer->chunk[0], writer->chunk.size())) {
+        ingest_fail(ingest, std::string("IO error: ingest spill file: ") + strerror(errno));
+    }
+    writer->chunk.clear();
+}
+
+typedef void (*MergeEmit)(Ingest *ingest, void *state, const std::string &key, const std::string &value);
+
+static void emit_to_spill(Ingest *ingest, void *state, const std::string &key, const std::string &value) {
+    SpillWriter *writer = static_cast<SpillWriter*>(state);
+    append_int32(writer->chunk, key.size());
+    append_int32(writer->chunk, value.size());
+    writer->chunk.insert(writer->chunk.end(), key.begin(), key.end());
+    writer->chunk.insert(writer->chunk.end(), value.begin(), value.end());
+    if (writer->chunk.size() >= INGEST_SPILL_CHUNK) {
+        spill_write(ingest, writer);
+    }
+}
+
+static void emit_to_sink(Ingest *ingest, void *state, const std::string &key, const std::string &value) {
+    ingest_emit(ingest, static_cast<IngestSink*>(state), key, value);
+}
+
+static void close_spills(const std::vector<int> &fds) {
+    for (size_t i = 0; i < fds.size(); i++) {
+        close(fds[i]);
+    }
+}
+
+/*
+ * Merges the spilled runs in fds, oldest first, passing each key to emit
+ * once with its newest value, and closes them. Stops at the first failure.
+ */
+static void ingest_merge(Ingest *ingest, const std::vector<int> &fds, MergeEmit emit, void *state) {
+    size_t runs = fds.size();
+    size_t read_buffer = runs == 0 ? 0 : ingest->memory_limit / runs;
+    read_buffer = std::min(std::max(read_buffer, INGEST_MIN_READ_BUFFER), INGEST_SPILL_CHUNK);
+
+    std::vector<SpillReader> readers(runs);
+    std::vector<SpillReader*> heap;
+    for (size_t i = 0; i < runs; i++) {
+        int fd = fds[i];
+        readers[i].run = i;
+        readers[i].file = NULL;
+        if (lseek(fd, 0, SEEK_SET) < 0 || (readers[i].file = fdopen(fd, "rb")) == NULL) {
+            ingest_fail(ingest, std::string("IO error: ingest spill file: ") + strerror(errno));
+            close(fd);
+            continue;
+        }
+        setvbuf(readers[i].file, NULL, _IOFBF, read_buffer);
+        if (spill_next(ingest, &readers[i])) {
+            heap.push_back(&readers[i]);
+        }
+    }
+    SpillReaderAfter after;
+    std::make_heap(heap.begin(), heap.end(), after);
+
+    while (!heap.empty() && ingest->error.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), after);
+        SpillReader *top = heap.back();
+        emit(ingest, state, top->key, top->value);
+
+        // Drop older values of the same key, then advance the winner.
+        while (heap.size() > 1 && heap.front()->key == top->key) {
+            std::pop_heap(heap.begin(), heap.end() - 1, after);
+            SpillReader *older = heap[heap.size() - 2];
+            if (spill_next(ingest, older)) {
+                std::push_heap(heap.begin(), heap.end() - 1, after);
+            }
+            else {
+                heap.erase(heap.end() - 2);
+            }
+        }
+        if (spill_next(ingest, top)) {
+            std::push_heap(heap.begin(), heap.end(), after);
+        }
+        else {
+            heap.pop_back();
+        }
+    }
+
+    for (size_t i = 0; i < runs; i++) {
+        if (readers[i].file != NULL) {
+            fclose(readers[i].file);
+        }
+    }
+}
+
+/* Spills the last run, waits for the workers and merges every run into sink. */
+static void ingest_finish(Ingest *ingest, IngestSink *sink) {
+    if (ingest->finished) {
+        ingest_fail(ingest, "Invalid argument: ingest is already finished");
+        return;
+    }
+    ingest->finished = true;
+    ingest_seal(ingest);
+
+    pthread_mutex_lock(&ingest->mutex);
+    while (!ingest->pending.empty() || ingest->sorting > 0) {
+        pthread_cond_wait(&ingest->done_cond, &ingest->mutex);
+    }
+    pthread_mutex_unlock(&ingest->mutex);
+    if (!ingest->error.empty()) {
+        return;
+    }
+
+    std::vector<int> runs;
+    runs.swap(ingest->spills);
+    size_t width = std::min(INGEST_MAX_MERGE_WIDTH, ingest->memory_limit / INGEST_MIN_READ_BUFFER);
+    width = std::max(width, (size_t)2);
+
+    while (runs.size() > width && ingest->error.empty()) {
+        // consecutive groups, so later runs still win within and across them
+        std::vector<int> merged;
+        for (size_t i = 0; i < runs.size(); i += width) {
+            std::vector<int> group(runs.begin() + i, runs.begin() + std::min(i + width, runs.size()));
+            if (!ingest->error.empty()) {
+                close_spills(group);
+                continue;
+            }
+            if (group.size() == 1) {
+                merged.push_back(group[0]);
+                continue;
+            }
+            std::string fname, msg;
+            SpillWriter writer;
+            writer.fd = ingest_tempfile(ingest->tmpdir, fname, msg);
+            if (writer.fd < 0) {
+                ingest_fail(ingest, msg);
+                close_spills(group);
+                continue;
+            }
+            ingest_merge(ingest, group, emit_to_spill, &writer);
+            spill_write(ingest, &writer);
+            merged.push_back(writer.fd);
+        }
+        runs.swap(merged);
+    }
+    if (!ingest->error.empty()) {
+        close_spills(runs);
+        return;
+    }
+
+    ingest_merge(ingest, runs, emit_to_sink, sink);
+    if (ingest->error.empty()) {
+        ingest_flush_sink(ingest, sink);
+    }
+}
+
+/*
+ * Creates an ingest that spills sorted runs to tmpdir, keeping about
+ * memory_limit bytes of entries in memory across threads sorting workers.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1ingest_1create
+  (JNIEnv *env, jobject obj, jstring tmpdir, jlong memory_limit, jint threads) {
+
+    if (tmpdir == NULL) {
+        error(env, "LevelDB ingest directory is NULL");
         return 0;
     }
-    if (name == NULL) {
-        error(env, "LevelDB filename is NULL");
+    if (memory_limit <= 0 || threads <= 0) {
+        error(env, "LevelDB ingest memory limit and thread count must be positive");
         return 0;
     }
 
-    const char* utf_chars = env->GetStringUTFChars(name, NULL);
+    const char* utf_chars = env->GetStringUTFChars(tmpdir, NULL);
     assert(utf_chars);
 
-    char* errptr = NULL;
+    Ingest *ingest = new Ingest();
+    ingest->tmpdir = utf_chars;
+    env->ReleaseStringUTFChars(tmpdir, utf_chars);
+    ingest->memory_limit = memory_limit;
+    ingest->run_size = memory_limit / (threads + 1);
+    ingest->current = new IngestRun();
+    ingest->current->data.reserve(ingest->run_size);
+    ingest->sorting = 0;
+    ingest->stopping = false;
+    ingest->finished = false;
+    pthread_mutex_init(&ingest->mutex, NULL);
+    pthread_cond_init(&ingest->work_cond, NULL);
+    pthread_cond_init(&ingest->done_cond, NULL);
+
+    for (jint i = 0; i < threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, ingest_worker_main, ingest) != 0) {
+            break;
+        }
+        ingest->workers.push_back(thread);
+    }
+    if (ingest->workers.empty()) {
+        pthread_cond_destroy(&ingest->done_cond);
+        pthread_cond_destroy(&ingest->work_cond);
+        pthread_mutex_destroy(&ingest->mutex);
+        delete ingest->current;
+        delete ingest;
+        error(env, "LevelDB ingest threads could not be started");
+        return 0;
+    }
 
-    void* retval = leveldb_open(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        utf_chars,
-        &errptr);
+    return reinterpret_cast<jlong>(ingest);
+}
 
-    env->ReleaseStringUTFChars(name, utf_chars);
+/* Stops the workers and discards whatever has not been merged. */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1ingest_1destroy
+  (JNIEnv *env, jobject obj, jlong ingest_ptr) {
 
-    if (errptr != NULL) {
-        error(env, errptr);
-        free(errptr);
-        return 0;
+    if (ingest_ptr == 0) {
+        error(env, "LevelDB ingest handle is NULL");
+        return;
     }
 
-    return reinterpret_cast<jlong>(retval);
+    Ingest *ingest = reinterpret_cast<Ingest*>(ingest_ptr);
+
+    pthread_mutex_lock(&ingest->mutex);
+    ingest->stopping = true;
+    while (!ingest->pending.empty()) {
+        delete ingest->pending.front();
+        ingest->pending.pop_front();
+    }
+    pthread_cond_broadcast(&ingest->work_cond);
+    pthread_mutex_unlock(&ingest->mutex);
+    for (size_t i = 0; i < ingest->workers.size(); i++) {
+        pthread_join(ingest->workers[i], NULL);
+    }
+
+    for (size_t i = 0; i < ingest->spills.size(); i++) {
+        if (ingest->spills[i] >= 0) {
+            close(ingest->spills[i]);
+        }
+    }
+    pthread_cond_destroy(&ingest->done_cond);
+    pthread_cond_destroy(&ingest->work_cond);
+    pthread_mutex_destroy(&ingest->mutex);
+    delete ingest->current;
+    delete ingest;
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1close
-  (JNIEnv *env, jobject obj, jlong leveldb_ptr) {
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1ingest_1add
+  (JNIEnv *env, jobject obj, jlong ingest_ptr, jbyteArray key, jbyteArray value) {
 
-    if (leveldb_ptr == 0) {
-        error(env, "LevelDB database handle is NULL");
+    if (ingest_ptr == 0) {
+        error(env, "LevelDB ingest handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return;
+    }
+    if (value == 0) {
+        error(env, "LevelDB value is NULL");
         return;
     }
 
-    leveldb_close(
-        reinterpret_cast<leveldb_t*>(leveldb_ptr));
+    Ingest *ingest = reinterpret_cast<Ingest*>(ingest_ptr);
+    {
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) return;
+        ArrayCopy value_bytes(env, value);
+        if (value_bytes.data() == NULL) return;
+        ingest_add(ingest, key_bytes.data(), key_bytes.size(), value_bytes.data(), value_bytes.size());
+    }
+
+    pthread_mutex_lock(&ingest->mutex);
+    std::string msg = ingest->error;
+    pthread_mutex_unlock(&ingest->mutex);
+    if (!msg.empty()) {
+        status_error(env, msg.c_str());
+    }
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1put
-  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr, jbyteArray key, jbyteArray value) {
+/*
+ * Adds the entries packed in buffer[offset..offset+length), each as a 32-bit
+ * key length, the key, a 32-bit value length and the value.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1ingest_1add_1packed
+  (JNIEnv *env, jobject obj, jlong ingest_ptr, jobject entries, jint entries_offset, jint entries_length) {
+
+    if (ingest_ptr == 0) {
+        error(env, "LevelDB ingest handle is NULL");
+        return;
+    }
+    if (entries == 0) {
+        error(env, "LevelDB buffer is NULL");
+        return;
+    }
+
+    const char *p = direct_address(env, entries, entries_offset, entries_length);
+    if (p == NULL) return;
+
+    Ingest *ingest = reinterpret_cast<Ingest*>(ingest_ptr);
+    const char *limit = p + entries_length;
+    while (p < limit) {
+        const char *fields[2] = { NULL, NULL };
+        uint32_t lengths[2] = { 0, 0 };
+        for (int i = 0; i < 2; i++) {
+            if (limit - p < 4 || (size_t)(limit - p - 4) < decode_int32(p)) {
+                error(env, "LevelDB packed ingest buffer is truncated");
+                return;
+            }
+            lengths[i] = decode_int32(p);
+            fields[i] = p + 4;
+            p += 4 + lengths[i];
+        }
+        ingest_add(ingest, fields[0], lengths[0], fields[1], lengths[1]);
+    }
 
+    pthread_mutex_lock(&ingest->mutex);
+    std::string msg = ingest->error;
+    pthread_mutex_unlock(&ingest->mutex);
+    if (!msg.empty()) {
+        status_error(env, msg.c_str());
+    }
+}
+
+/* Merges everything added into db through large writes. */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1ingest_1finish
+  (JNIEnv *env, jobject obj, jlong ingest_ptr, jlong leveldb_ptr, jlong writeoptions_ptr) {
+
+    if (ingest_ptr == 0) {
+        error(env, "LevelDB ingest handle is NULL");
+        return;
+    }
     if (leveldb_ptr == 0) {
         error(env, "LevelDB database handle is NULL");
         return;
@@ -96,835 +5236,2930 @@ JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1put
         error(env, "LevelDB write options handle is NULL");
         return;
     }
-    if (key == 0) {
-        error(env, "LevelDB key is NULL");
+
+    Ingest *ingest = reinterpret_cast<Ingest*>(ingest_ptr);
+    IngestSink sink = {
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
+        leveldb_writebatch_create(), 0, NULL };
+    ingest_finish(ingest, &sink);
+    leveldb_writebatch_destroy(sink.batch);
+
+    if (!ingest->error.empty()) {
+        status_error(env, ingest->error.c_str());
+    }
+}
+
+/*
+ * Merges everything added into a bulk load, which the caller then finishes.
+ * The bulk load must not already hold keys at or after the ingested ones.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1ingest_1finish_1bulkload
+  (JNIEnv *env, jobject obj, jlong ingest_ptr, jlong bulkload_ptr) {
+
+    if (ingest_ptr == 0) {
+        error(env, "LevelDB ingest handle is NULL");
         return;
     }
-    if (value == 0) {
-        error(env, "LevelDB value is NULL");
+    if (bulkload_ptr == 0) {
+        error(env, "LevelDB bulk load handle is NULL");
         return;
     }
 
-    jsize key_length = env->GetArrayLength(key);
-    const jbyte *key_bytes = env->GetByteArrayElements(key, NULL);
-    jsize value_length = env->GetArrayLength(value);
-    const jbyte *value_bytes = env->GetByteArrayElements(value, NULL);
+    Ingest *ingest = reinterpret_cast<Ingest*>(ingest_ptr);
+    IngestSink sink = { NULL, NULL, NULL, 0, reinterpret_cast<BulkLoader*>(bulkload_ptr) };
+    ingest_finish(ingest, &sink);
 
-    char* errptr = NULL;
+    if (!ingest->error.empty()) {
+        status_error(env, ingest->error.c_str());
+    }
+}
 
-    leveldb_put(
-        reinterpret_cast<leveldb_t*>(leveldb_ptr),
-        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
-        (const char*)key_bytes,
-        key_length,
-        (const char*)value_bytes,
-        value_length,
-        &errptr);
+/*
+ * Write admission control. leveldb delays each write by 1ms once level 0
+ * holds LEVEL0_SLOWDOWN_FILES files and blocks writers at
+ * LEVEL0_STOP_FILES, which Java only sees as latency. An Admission caches
+ * the level-0 file count, refreshed at most once per poll interval, so
+ * leveldb_admission_would_stall is a cheap non-blocking probe. An optional
+ * token bucket meters written bytes, and its rate is scaled down linearly
+ * from throttle_files up to the stop trigger so writers slow gradually
+ * instead of hitting the hard stop. This leveldb version has no memtable
+ * usage property, so memtable pressure is handled by the byte rate.
+ */
+static const int LEVEL0_SLOWDOWN_FILES = 8;
+static const int LEVEL0_STOP_FILES = 12;
+
+struct Admission {
+    leveldb_t *db;
+    pthread_mutex_t mutex;
+    jlong poll_micros;
+    jlong next_poll;
+    int level0_files;
+    int throttle_files;
+    double rate;
+    double burst;
+    double tokens;
+    jlong last_refill;
+};
+
+static jlong now_micros() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (jlong)now.tv_sec * 1000000 + now.tv_usec;
+}
 
-    if (errptr != NULL) {
-        error(env, errptr);
-        free(errptr);
+/* Refreshes the cached level-0 file count if it is older than the poll interval. */
+static void admission_poll(Admission *admission, jlong now) {
+    if (now < admission->next_poll) {
         return;
     }
+    admission->next_poll = now + admission->poll_micros;
+    char *value = leveldb_property_value(admission->db, "leveldb.num-files-at-level0");
+    if (value != NULL) {
+        admission->level0_files = atoi(value);
+        free(value);
+    }
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1delete
-  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr, jbyteArray key) {
+/* The share of the configured rate allowed at the current level-0 count. */
+static double admission_rate_factor(const Admission *admission) {
+    if (admission->level0_files <= admission->throttle_files) {
+        return 1.0;
+    }
+    if (admission->level0_files >= LEVEL0_STOP_FILES) {
+        return 0.0;
+    }
+    return (double)(LEVEL0_STOP_FILES - admission->level0_files) /
+           (LEVEL0_STOP_FILES - admission->throttle_files);
+}
+
+/*
+ * Creates an admission controller for db that polls the level-0 file count
+ * at most every poll_millis and starts throttling above throttle_files.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1admission_1create
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jint throttle_files, jlong poll_millis) {
 
     if (leveldb_ptr == 0) {
         error(env, "LevelDB database handle is NULL");
+        return 0;
+    }
+    if (throttle_files < 0 || throttle_files >= LEVEL0_STOP_FILES || poll_millis < 0) {
+        error(env, "LevelDB admission throttle must be below the level-0 stop trigger");
+        return 0;
+    }
+
+    Admission *admission = new Admission();
+    admission->db = reinterpret_cast<leveldb_t*>(leveldb_ptr);
+    pthread_mutex_init(&admission->mutex, NULL);
+    admission->poll_micros = poll_millis * 1000;
+    admission->next_poll = 0;
+    admission->level0_files = 0;
+    admission->throttle_files = throttle_files;
+    admission->rate = 0;
+    admission->burst = 0;
+    admission->tokens = 0;
+    admission->last_refill = now_micros();
+    admission_poll(admission, admission->last_refill);
+
+    return reinterpret_cast<jlong>(admission);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1admission_1destroy
+  (JNIEnv *env, jobject obj, jlong admission_ptr) {
+
+    if (admission_ptr == 0) {
+        error(env, "LevelDB admission handle is NULL");
         return;
     }
-    if (writeoptions_ptr == 0) {
-        error(env, "LevelDB write options handle is NULL");
+
+    Admission *admission = reinterpret_cast<Admission*>(admission_ptr);
+    pthread_mutex_destroy(&admission->mutex);
+    delete admission;
+}
+
+/*
+ * Meters writes at bytes_per_second with bursts of up to burst_bytes. A
+ * rate of 0 turns the throttle off.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1admission_1set_1rate
+  (JNIEnv *env, jobject obj, jlong admission_ptr, jlong bytes_per_second, jlong burst_bytes) {
+
+    if (admission_ptr == 0) {
+        error(env, "LevelDB admission handle is NULL");
         return;
     }
-    if (key == 0) {
-        error(env, "LevelDB key is NULL");
+    if (bytes_per_second < 0 || burst_bytes < 0 || (bytes_per_second > 0 && burst_bytes == 0)) {
+        error(env, "LevelDB admission rate must not be negative and needs a positive burst");
         return;
     }
 
-    jsize key_length = env->GetArrayLength(key);
-    const jbyte *key_bytes = env->GetByteArrayElements(key, NULL);
+    Admission *admission = reinterpret_cast<Admission*>(admission_ptr);
 
-    char* errptr = NULL;
+    pthread_mutex_lock(&admission->mutex);
+    admission->rate = bytes_per_second;
+    admission->burst = burst_bytes;
+    admission->tokens = burst_bytes;
+    admission->last_refill = now_micros();
+    pthread_mutex_unlock(&admission->mutex);
+}
 
-    leveldb_delete(
-        reinterpret_cast<leveldb_t*>(leveldb_ptr),
-        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
-        (const char*)key_bytes,
-        key_length,
-        &errptr);
+/* Returns the level-0 file count, at most one poll interval old. */
+JNIEXPORT jint JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1admission_1level0_1files
+  (JNIEnv *env, jobject obj, jlong admission_ptr) {
+
+    if (admission_ptr == 0) {
+        error(env, "LevelDB admission handle is NULL");
+        return 0;
+    }
+
+    Admission *admission = reinterpret_cast<Admission*>(admission_ptr);
+
+    pthread_mutex_lock(&admission->mutex);
+    admission_poll(admission, now_micros());
+    jint files = admission->level0_files;
+    pthread_mutex_unlock(&admission->mutex);
+
+    return files;
+}
+
+/*
+ * Returns true if leveldb would delay or block a write made now because
+ * of level-0 files. Never blocks.
+ */
+JNIEXPORT jboolean JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1admission_1would_1stall
+  (JNIEnv *env, jobject obj, jlong admission_ptr) {
+
+    if (admission_ptr == 0) {
+        error(env, "LevelDB admission handle is NULL");
+        return 0;
+    }
+
+    Admission *admission = reinterpret_cast<Admission*>(admission_ptr);
+
+    pthread_mutex_lock(&admission->mutex);
+    admission_poll(admission, now_micros());
+    bool stall = admission->level0_files >= LEVEL0_SLOWDOWN_FILES;
+    pthread_mutex_unlock(&admission->mutex);
+
+    return stall ? 1 : 0;
+}
+
+/*
+ * Takes bytes from the token bucket, waiting while it is short, and returns
+ * the microseconds waited. Requests larger than the burst are admitted once
+ * the bucket is full and leave it in debt. Returns at once if the throttle
+ * is off.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1admission_1acquire
+  (JNIEnv *env, jobject obj, jlong admission_ptr, jlong bytes) {
+
+    if (admission_ptr == 0) {
+        error(env, "LevelDB admission handle is NULL");
+        return 0;
+    }
+
+    Admission *admission = reinterpret_cast<Admission*>(admission_ptr);
+    jlong start = now_micros();
+
+    pthread_mutex_lock(&admission->mutex);
+    while (admission->rate > 0) {
+        jlong now = now_micros();
+        admission_poll(admission, now);
+        double rate = admission->rate * admission_rate_factor(admission);
+        admission->tokens = std::min(admission->burst,
+            admission->tokens + rate * (now - admission->last_refill) / 1000000);
+        admission->last_refill = now;
+
+        double needed = std::min((double)bytes, admission->burst);
+        if (admission->tokens >= needed) {
+            admission->tokens -= bytes;
+            break;
+        }
+
+        // Sleep until the tokens should be there, but no longer than a poll
+        // interval so a change in level 0 is noticed.
+        jlong wait = admission->poll_micros > 0 ? admission->poll_micros : 1000;
+        if (rate > 0) {
+            wait = std::min(wait, (jlong)((needed - admission->tokens) * 1000000 / rate) + 1);
+        }
+        pthread_mutex_unlock(&admission->mutex);
+        usleep(wait);
+        pthread_mutex_lock(&admission->mutex);
+    }
+    pthread_mutex_unlock(&admission->mutex);
+
+    return now_micros() - start;
+}
+
+/*
+ * Atomic read-modify-write. Operations through one AtomicOps handle are
+ * serialized per key by a striped lock table, so each is a single read and
+ * a single write with no Java-side locking. Writes that bypass the handle
+ * are not serialized with them. Counters are 8-byte big-endian longs, as
+ * ByteBuffer.putLong writes them, and a missing key counts as 0.
+ */
+static const int ATOMIC_OP_ADD = 0;
+static const int ATOMIC_OP_APPEND = 1;
+static const int ATOMIC_OP_MAX = 2;
+
+struct AtomicOps {
+    leveldb_t *db;
+    leveldb_readoptions_t *readoptions;
+    leveldb_writeoptions_t *writeoptions;
+    size_t stripes;
+    pthread_mutex_t *locks;
+};
+
+static inline void encode_int64(char *dst, uint64_t value) {
+    encode_int32(dst, (uint32_t)(value >> 32));
+    encode_int32(dst + 4, (uint32_t)value);
+}
+
+static inline uint64_t decode_int64(const char *src) {
+    return ((uint64_t)decode_int32(src) << 32) | decode_int32(src + 4);
+}
+
+static size_t key_stripe(const AtomicOps *atomic, const char *key, size_t keylen) {
+    return hash_key(key, keylen) % atomic->stripes;
+}
+
+/*
+ * Locks the stripes of several keys in ascending order, so batches that
+ * share stripes cannot deadlock, and unlocks them when it goes out of scope.
+ */
+class StripeGuard {
+  public:
+    StripeGuard(AtomicOps *atomic) : atomic(atomic) {}
 
+    void add(const char *key, size_t keylen) {
+        stripes.push_back(key_stripe(atomic, key, keylen));
+    }
+
+    void lock() {
+        std::sort(stripes.begin(), stripes.end());
+        stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+        for (size_t i = 0; i < stripes.size(); i++) {
+            pthread_mutex_lock(&atomic->locks[stripes[i]]);
+        }
+    }
+
+    ~StripeGuard() {
+        for (size_t i = stripes.size(); i > 0; i--) {
+            pthread_mutex_unlock(&atomic->locks[stripes[i - 1]]);
+        }
+    }
+
+  private:
+    StripeGuard(const StripeGuard&);
+    void operator=(const StripeGuard&);
+
+    AtomicOps *atomic;
+    std::vector<size_t> stripes;
+};
+
+/* Reads key into value, returning whether it exists. */
+static bool atomic_read(AtomicOps *atomic, const char *key, size_t keylen,
+                        std::string &value, char **errptr) {
+    size_t vallen = 0;
+    char *bytes = leveldb_get(atomic->db, atomic->readoptions, key, keylen, &vallen, errptr);
+    if (bytes == NULL) {
+        return false;
+    }
+    value.assign(bytes, vallen);
+    free(bytes);
+    return true;
+}
+
+/*
+ * Applies op with operand to value, where found says whether the key
+ * existed. Returns an error message if the operation does not apply.
+ */
+static const char* apply_atomic_op(int op, bool found, std::string &value,
+                                   const char *operand, size_t operandlen) {
+    if (op == ATOMIC_OP_APPEND) {
+        if (!found) value.clear();
+        value.append(operand, operandlen);
+        return NULL;
+    }
+    if (op != ATOMIC_OP_ADD && op != ATOMIC_OP_MAX) {
+        return "Invalid argument: unknown atomic operation";
+    }
+    if (operandlen != 8 || (found && value.size() != 8)) {
+        return "Invalid argument: value is not a 64-bit integer";
+    }
+    int64_t current = found ? (int64_t)decode_int64(value.data()) : 0;
+    int64_t argument = (int64_t)decode_int64(operand);
+    int64_t result;
+    if (op == ATOMIC_OP_ADD) {
+        result = (int64_t)((uint64_t)current + (uint64_t)argument);
+    }
+    else {
+        result = found ? std::max(current, argument) : argument;
+    }
+    value.resize(8);
+    encode_int64(&value[0], result);
+    return NULL;
+}
+
+/*
+ * Applies one operation under its key's stripe and stores the new value in
+ * value. Returns false with the reason in msg if it fails.
+ */
+static bool atomic_apply(AtomicOps *atomic, int op, const char *key, size_t keylen,
+                         const char *operand, size_t operandlen,
+                         std::string &value, std::string &msg) {
+    StripeGuard guard(atomic);
+    guard.add(key, keylen);
+    guard.lock();
+
+    char *errptr = NULL;
+    bool found = atomic_read(atomic, key, keylen, value, &errptr);
+    if (errptr == NULL) {
+        const char *invalid = apply_atomic_op(op, found, value, operand, operandlen);
+        if (invalid != NULL) {
+            msg = invalid;
+            return false;
+        }
+        db_put(atomic->db, atomic->writeoptions, key, keylen, value.data(), value.size(), &errptr);
+    }
     if (errptr != NULL) {
-        error(env, errptr);
+        msg = errptr;
         free(errptr);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Creates an atomic operations handle for db that writes with writeoptions
+ * and serializes keys over the given number of lock stripes.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1create
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr, jint stripes) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
+    }
+    if (writeoptions_ptr == 0) {
+        error(env, "LevelDB write options handle is NULL");
+        return 0;
+    }
+    if (stripes <= 0) {
+        error(env, "LevelDB atomic lock stripes must be positive");
+        return 0;
+    }
+
+    AtomicOps *atomic = new AtomicOps();
+    atomic->db = reinterpret_cast<leveldb_t*>(leveldb_ptr);
+    atomic->readoptions = leveldb_readoptions_create();
+    atomic->writeoptions = reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr);
+    atomic->stripes = stripes;
+    atomic->locks = new pthread_mutex_t[stripes];
+    for (jint i = 0; i < stripes; i++) {
+        pthread_mutex_init(&atomic->locks[i], NULL);
+    }
+
+    return reinterpret_cast<jlong>(atomic);
+}
+
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1destroy
+  (JNIEnv *env, jobject obj, jlong atomic_ptr) {
+
+    if (atomic_ptr == 0) {
+        error(env, "LevelDB atomic handle is NULL");
         return;
     }
+
+    AtomicOps *atomic = reinterpret_cast<AtomicOps*>(atomic_ptr);
+    for (size_t i = 0; i < atomic->stripes; i++) {
+        pthread_mutex_destroy(&atomic->locks[i]);
+    }
+    delete[] atomic->locks;
+    leveldb_readoptions_destroy(atomic->readoptions);
+    delete atomic;
+}
+
+/* Applies a counter operation and returns the key's new value. */
+static jlong atomic_int64_op(JNIEnv *env, jlong atomic_ptr, int op, jbyteArray key, jlong operand) {
+    if (atomic_ptr == 0) {
+        error(env, "LevelDB atomic handle is NULL");
+        return 0;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return 0;
+    }
+
+    AtomicOps *atomic = reinterpret_cast<AtomicOps*>(atomic_ptr);
+    char operand_bytes[8];
+    encode_int64(operand_bytes, operand);
+
+    std::string value, msg;
+    bool ok;
+    {
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) return 0;
+        ok = atomic_apply(atomic, op, key_bytes.data(), key_bytes.size(),
+                          operand_bytes, sizeof(operand_bytes), value, msg);
+    }
+
+    if (!ok) {
+        status_error(env, msg.c_str());
+        return 0;
+    }
+    return (jlong)decode_int64(value.data());
+}
+
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1add_1int64
+  (JNIEnv *env, jobject obj, jlong atomic_ptr, jbyteArray key, jlong delta) {
+    return atomic_int64_op(env, atomic_ptr, ATOMIC_OP_ADD, key, delta);
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1write
-  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr, jlong writebatch_ptr) {
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1max_1int64
+  (JNIEnv *env, jobject obj, jlong atomic_ptr, jbyteArray key, jlong value) {
+    return atomic_int64_op(env, atomic_ptr, ATOMIC_OP_MAX, key, value);
+}
 
-    if (leveldb_ptr == 0) {
-        error(env, "LevelDB database handle is NULL");
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1append
+  (JNIEnv *env, jobject obj, jlong atomic_ptr, jbyteArray key, jbyteArray bytes) {
+
+    if (atomic_ptr == 0) {
+        error(env, "LevelDB atomic handle is NULL");
         return;
     }
-    if (writeoptions_ptr == 0) {
-        error(env, "LevelDB write options handle is NULL");
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
         return;
     }
-    if (writebatch_ptr == 0) {
-        error(env, "LevelDB write batch handle is NULL");
+    if (bytes == 0) {
+        error(env, "LevelDB value is NULL");
         return;
     }
 
-    char* errptr = NULL;
+    AtomicOps *atomic = reinterpret_cast<AtomicOps*>(atomic_ptr);
+
+    std::string value, msg;
+    bool ok;
+    {
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) return;
+        ArrayCopy operand_bytes(env, bytes);
+        if (operand_bytes.data() == NULL) return;
+        ok = atomic_apply(atomic, ATOMIC_OP_APPEND, key_bytes.data(), key_bytes.size(),
+                          operand_bytes.data(), operand_bytes.size(), value, msg);
+    }
 
-    leveldb_write(
-        reinterpret_cast<leveldb_t*>(leveldb_ptr),
-        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
-        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr),
-        &errptr);
+    if (!ok) {
+        status_error(env, msg.c_str());
+    }
+}
 
-    if (errptr != NULL) {
-        error(env, errptr);
-        free(errptr);
-        return;
+/* One decoded operation of a packed atomic buffer. */
+struct AtomicOpRef {
+    int op;
+    const char *key;
+    size_t keylen;
+    const char *operand;
+    size_t operandlen;
+};
+
+/*
+ * Decodes packed atomic operations, each a tag byte, a 32-bit key length
+ * and the key, and a 32-bit operand length and the operand. Returns an
+ * error message if the buffer is malformed, NULL otherwise.
+ */
+static const char* decode_atomic_ops(const char *p, size_t length, std::vector<AtomicOpRef> &ops) {
+    const char *limit = p + length;
+    while (p < limit) {
+        AtomicOpRef ref;
+        ref.op = *p++;
+        const char **fields[2] = { &ref.key, &ref.operand };
+        size_t *lengths[2] = { &ref.keylen, &ref.operandlen };
+        for (int i = 0; i < 2; i++) {
+            if (limit - p < 4 || (size_t)(limit - p - 4) < decode_int32(p)) {
+                return "LevelDB packed atomic buffer is truncated";
+            }
+            *lengths[i] = decode_int32(p);
+            *fields[i] = p + 4;
+            p += 4 + *lengths[i];
+        }
+        ops.push_back(ref);
     }
+    return NULL;
 }
 
-JNIEXPORT jbyteArray JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1get
-  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr, jbyteArray key) {
+/*
+ * Applies the packed operations as one write while holding the stripes of
+ * all their keys. Operations on the same key see each other's results in
+ * order. If any operation fails nothing is written.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1apply_1packed
+  (JNIEnv *env, jobject obj, jlong atomic_ptr, jobject ops, jint ops_offset, jint ops_length) {
 
-    if (leveldb_ptr == 0) {
-        error(env, "LevelDB database handle is NULL");
-        return NULL;
-    }
-    if (readoptions_ptr == 0) {
-        error(env, "LevelDB read options handle is NULL");
-        return NULL;
+    if (atomic_ptr == 0) {
+        error(env, "LevelDB atomic handle is NULL");
+        return;
     }
-    if (key == 0) {
-        error(env, "LevelDB key is NULL");
-        return NULL;
+    if (ops == 0) {
+        error(env, "LevelDB packed atomic buffer is NULL");
+        return;
     }
 
-    jsize key_length = env->GetArrayLength(key);
-    const jbyte *key_bytes = env->GetByteArrayElements(key, NULL);
+    const char *ops_bytes = direct_address(env, ops, ops_offset, ops_length);
+    if (ops_bytes == NULL) return;
 
-    size_t vallen = 0;
+    std::vector<AtomicOpRef> refs;
+    const char *malformed = decode_atomic_ops(ops_bytes, ops_length, refs);
+    if (malformed != NULL) {
+        error(env, malformed);
+        return;
+    }
 
-    char* errptr = NULL;
+    AtomicOps *atomic = reinterpret_cast<AtomicOps*>(atomic_ptr);
+    StripeGuard guard(atomic);
+    for (size_t i = 0; i < refs.size(); i++) {
+        guard.add(refs[i].key, refs[i].keylen);
+    }
+    guard.lock();
 
-    char* value = leveldb_get(
-        reinterpret_cast<leveldb_t*>(leveldb_ptr),
-        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
-        (const char*)key_bytes,
-        key_length,
-        &vallen,
-        &errptr);
+    // Latest value of each key touched so far, and whether it exists.
+    std::map<std::string, std::pair<bool, std::string> > values;
+    char *errptr = NULL;
+    const char *msg = NULL;
+    for (size_t i = 0; i < refs.size() && msg == NULL; i++) {
+        std::string key(refs[i].key, refs[i].keylen);
+        std::map<std::string, std::pair<bool, std::string> >::iterator it = values.find(key);
+        if (it == values.end()) {
+            std::pair<bool, std::string> entry;
+            entry.first = atomic_read(atomic, key.data(), key.size(), entry.second, &errptr);
+            if (errptr != NULL) break;
+            it = values.insert(std::make_pair(key, entry)).first;
+        }
+        msg = apply_atomic_op(refs[i].op, it->second.first, it->second.second,
+                              refs[i].operand, refs[i].operandlen);
+        it->second.first = true;
+    }
+
+    if (errptr == NULL && msg == NULL) {
+        leveldb_writebatch_t *batch = leveldb_writebatch_create();
+        std::map<std::string, std::pair<bool, std::string> >::iterator it;
+        for (it = values.begin(); it != values.end(); ++it) {
+            leveldb_writebatch_put(batch, it->first.data(), it->first.size(),
+                                   it->second.second.data(), it->second.second.size());
+        }
+        db_write(atomic->db, atomic->writeoptions, batch, &errptr);
+        leveldb_writebatch_destroy(batch);
+    }
 
     if (errptr != NULL) {
-        error(env, errptr);
+        status_error(env, errptr);
         free(errptr);
-        return NULL;
     }
+    else if (msg != NULL) {
+        status_error(env, msg);
+    }
+}
 
-    jbyteArray retval = env->NewByteArray(vallen);
-    env->SetByteArrayRegion(retval, 0, vallen, (jbyte *)value);
+/*
+ * Conditional writes on the same atomic handle and lock stripes: an
+ * operation is applied only if the key's current value, or its absence,
+ * matches. Each returns whether it was applied.
+ */
+static const int ATOMIC_OP_COMPARE_AND_SET = 3;
+static const int ATOMIC_OP_PUT_IF_ABSENT = 4;
+static const int ATOMIC_OP_DELETE_IF_EQUALS = 5;
 
-    free(value);
-    return retval;
+/*
+ * Applies a conditional op to the key's state, where found says whether it
+ * exists and value holds its value. Returns whether the condition held.
+ */
+static bool apply_conditional_op(int op, bool &found, std::string &value,
+                                 const char *expected, size_t expectedlen,
+                                 const char *update, size_t updatelen) {
+    bool matches = op == ATOMIC_OP_PUT_IF_ABSENT ? !found :
+        found && value.size() == expectedlen && memcmp(value.data(), expected, expectedlen) == 0;
+    if (!matches) {
+        return false;
+    }
+    if (op == ATOMIC_OP_DELETE_IF_EQUALS) {
+        found = false;
+        value.clear();
+    }
+    else {
+        found = true;
+        value.assign(update, updatelen);
+    }
+    return true;
 }
 
-JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1create_1iterator
-  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr) {
-
-    if (leveldb_ptr == 0) {
-        error(env, "LevelDB database handle is NULL");
+/* One decoded operation of a packed conditional buffer. */
+struct ConditionalRef {
+    int op;
+    const char *fields[3];
+    size_t lengths[3];
+};
+
+/* The state of a key within a packed conditional call, and whether it changed. */
+struct KeyState {
+    bool found;
+    bool dirty;
+    std::string value;
+};
+
+static jboolean atomic_conditional(JNIEnv *env, jlong atomic_ptr, int op,
+                                   jbyteArray key, jbyteArray expected, jbyteArray update) {
+    if (atomic_ptr == 0) {
+        error(env, "LevelDB atomic handle is NULL");
         return 0;
     }
-    if (readoptions_ptr == 0) {
-        error(env, "LevelDB read options handle is NULL");
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
+        return 0;
+    }
+    if (op != ATOMIC_OP_PUT_IF_ABSENT && expected == 0) {
+        error(env, "LevelDB expected value is NULL");
+        return 0;
+    }
+    if (op != ATOMIC_OP_DELETE_IF_EQUALS && update == 0) {
+        error(env, "LevelDB value is NULL");
         return 0;
     }
 
-    leveldb_iterator_t* retval = leveldb_create_iterator(
-        reinterpret_cast<leveldb_t*>(leveldb_ptr),
-        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr));
-    return reinterpret_cast<jlong>(retval);
-}
-
-JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1create_1snapshot
-  (JNIEnv *env, jobject obj, jlong leveldb_ptr) {
+    AtomicOps *atomic = reinterpret_cast<AtomicOps*>(atomic_ptr);
+    char *errptr = NULL;
+    bool applied = false;
+    {
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) return 0;
+        std::string expected_bytes, update_bytes;
+        if (expected != 0) copy_array(env, expected, expected_bytes);
+        if (update != 0) copy_array(env, update, update_bytes);
+
+        StripeGuard guard(atomic);
+        guard.add(key_bytes.data(), key_bytes.size());
+        guard.lock();
+
+        std::string value;
+        bool found = atomic_read(atomic, key_bytes.data(), key_bytes.size(), value, &errptr);
+        if (errptr == NULL) {
+            applied = apply_conditional_op(op, found, value,
+                expected_bytes.data(), expected_bytes.size(), update_bytes.data(), update_bytes.size());
+        }
+        if (applied && found) {
+            db_put(atomic->db, atomic->writeoptions, key_bytes.data(), key_bytes.size(),
+                   value.data(), value.size(), &errptr);
+        }
+        else if (applied) {
+            db_delete(atomic->db, atomic->writeoptions, key_bytes.data(), key_bytes.size(), &errptr);
+        }
+    }
 
-    if (leveldb_ptr == 0) {
-        error(env, "LevelDB database handle is NULL");
+    if (errptr != NULL) {
+        status_error(env, errptr);
+        free(errptr);
         return 0;
     }
-
-    const leveldb_snapshot_t* retval = leveldb_create_snapshot(
-        reinterpret_cast<leveldb_t*>(leveldb_ptr));
-    return reinterpret_cast<jlong>(retval);
+    return applied ? 1 : 0;
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1release_1snapshot
-  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong snapshot_ptr) {
+/* Sets key to value if its current value equals expected. */
+JNIEXPORT jboolean JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1compare_1and_1set
+  (JNIEnv *env, jobject obj, jlong atomic_ptr, jbyteArray key, jbyteArray expected, jbyteArray value) {
+    return atomic_conditional(env, atomic_ptr, ATOMIC_OP_COMPARE_AND_SET, key, expected, value);
+}
 
-    if (leveldb_ptr == 0) {
-        error(env, "LevelDB database handle is NULL");
-        return;
-    }
-    if (snapshot_ptr == 0) {
-        error(env, "LevelDB snapshot handle is NULL");
-        return;
-    }
+/* Sets key to value if it does not exist. */
+JNIEXPORT jboolean JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1put_1if_1absent
+  (JNIEnv *env, jobject obj, jlong atomic_ptr, jbyteArray key, jbyteArray value) {
+    return atomic_conditional(env, atomic_ptr, ATOMIC_OP_PUT_IF_ABSENT, key, NULL, value);
+}
 
-    leveldb_release_snapshot(
-        reinterpret_cast<leveldb_t*>(leveldb_ptr),
-        reinterpret_cast<leveldb_snapshot_t*>(snapshot_ptr));
+/* Deletes key if its current value equals expected. */
+JNIEXPORT jboolean JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1delete_1if_1equals
+  (JNIEnv *env, jobject obj, jlong atomic_ptr, jbyteArray key, jbyteArray expected) {
+    return atomic_conditional(env, atomic_ptr, ATOMIC_OP_DELETE_IF_EQUALS, key, expected, NULL);
 }
 
-JNIEXPORT jstring JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1property_1value
-  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jstring name) {
+/*
+ * Applies packed conditional operations in order while holding the stripes
+ * of all their keys, and writes the ones whose condition held in a single
+ * write. Each operation is a tag byte and 32-bit length-prefixed fields: the
+ * key, then the expected value unless it is a put-if-absent, then the new
+ * value unless it is a delete-if-equals. Operations on the same key see the
+ * effect of earlier ones. Stores one byte per operation, 1 if it was applied,
+ * at results[results_offset..] and returns the number applied.
+ */
+JNIEXPORT jint JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1conditional_1packed
+  (JNIEnv *env, jobject obj, jlong atomic_ptr, jobject ops, jint ops_offset, jint ops_length,
+   jobject results, jint results_offset, jint results_length) {
 
-    if (leveldb_ptr == 0) {
-        error(env, "LevelDB database handle is NULL");
-        return NULL;
+    if (atomic_ptr == 0) {
+        error(env, "LevelDB atomic handle is NULL");
+        return 0;
     }
-    if (name == 0) {
-        error(env, "LevelDB property name is NULL");
-        return NULL;
+    if (ops == 0 || results == 0) {
+        error(env, "LevelDB buffer is NULL");
+        return 0;
     }
 
-    const char* name_chars = env->GetStringUTFChars(name, NULL);
-
-    char* retval = leveldb_property_value(
-        reinterpret_cast<leveldb_t*>(leveldb_ptr),
-        name_chars);
-
-    env->ReleaseStringUTFChars(name, name_chars);
-
-    jstring jretval = env->NewStringUTF(retval);
-    free(retval);
-    return jretval;
-}
-
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1destroy_1db
-  (JNIEnv *env, jobject obj, jlong options_ptr, jstring name) {
-
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
-        return;
+    const char *p = direct_address(env, ops, ops_offset, ops_length);
+    if (p == NULL) return 0;
+    char *applied = direct_address(env, results, results_offset, results_length);
+    if (applied == NULL) return 0;
+
+    std::vector<ConditionalRef> refs;
+    const char *limit = p + ops_length;
+    while (p < limit) {
+        ConditionalRef ref;
+        memset(&ref, 0, sizeof(ref));
+        ref.op = *p++;
+        if (ref.op < ATOMIC_OP_COMPARE_AND_SET || ref.op > ATOMIC_OP_DELETE_IF_EQUALS) {
+            error(env, "LevelDB packed conditional buffer has an unknown operation");
+            return 0;
+        }
+        for (int i = 0; i < 3; i++) {
+            if ((i == 1 && ref.op == ATOMIC_OP_PUT_IF_ABSENT) ||
+                (i == 2 && ref.op == ATOMIC_OP_DELETE_IF_EQUALS)) {
+                continue;
+            }
+            if (limit - p < 4 || (size_t)(limit - p - 4) < decode_int32(p)) {
+                error(env, "LevelDB packed conditional buffer is truncated");
+                return 0;
+            }
+            ref.lengths[i] = decode_int32(p);
+            ref.fields[i] = p + 4;
+            p += 4 + ref.lengths[i];
+        }
+        refs.push_back(ref);
     }
-    if (name == 0) {
-        error(env, "LevelDB filename is NULL");
-        return;
+    if (refs.size() > (size_t)results_length) {
+        error(env, "LevelDB conditional result buffer is too small");
+        return 0;
     }
 
-    const char* name_chars = env->GetStringUTFChars(name, NULL);
-
-    char* errptr = NULL;
+    AtomicOps *atomic = reinterpret_cast<AtomicOps*>(atomic_ptr);
+    StripeGuard guard(atomic);
+    for (size_t i = 0; i < refs.size(); i++) {
+        guard.add(refs[i].fields[0], refs[i].lengths[0]);
+    }
+    guard.lock();
 
-    leveldb_destroy_db(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        name_chars,
-        &errptr);
+    std::map<std::string, KeyState> states;
+    char *errptr = NULL;
+    jint count = 0;
+    for (size_t i = 0; i < refs.size(); i++) {
+        std::string key(refs[i].fields[0], refs[i].lengths[0]);
+        std::map<std::string, KeyState>::iterator it = states.find(key);
+        if (it == states.end()) {
+            KeyState state;
+            state.found = atomic_read(atomic, key.data(), key.size(), state.value, &errptr);
+            state.dirty = false;
+            if (errptr != NULL) break;
+            it = states.insert(std::make_pair(key, state)).first;
+        }
+        KeyState &state = it->second;
+        bool ok = apply_conditional_op(refs[i].op, state.found, state.value,
+            refs[i].fields[1], refs[i].lengths[1], refs[i].fields[2], refs[i].lengths[2]);
+        applied[i] = ok ? 1 : 0;
+        if (ok) {
+            state.dirty = true;
+            count++;
+        }
+    }
 
-    env->ReleaseStringUTFChars(name, name_chars);
+    if (errptr == NULL && count > 0) {
+        leveldb_writebatch_t *batch = leveldb_writebatch_create();
+        std::map<std::string, KeyState>::iterator it;
+        for (it = states.begin(); it != states.end(); ++it) {
+            if (!it->second.dirty) continue;
+            if (it->second.found) {
+                leveldb_writebatch_put(batch, it->first.data(), it->first.size(),
+                                       it->second.value.data(), it->second.value.size());
+            }
+            else {
+                leveldb_writebatch_delete(batch, it->first.data(), it->first.size());
+            }
+        }
+        db_write(atomic->db, atomic->writeoptions, batch, &errptr);
+        leveldb_writebatch_destroy(batch);
+    }
 
     if (errptr != NULL) {
-        error(env, errptr);
+        status_error(env, errptr);
         free(errptr);
-        return;
+        return 0;
     }
+    return count;
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1repair_1db
-  (JNIEnv *env, jobject obj, jlong options_ptr, jstring name) {
-
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
-        return;
+/*
+ * Auto-flushing batcher. Puts and deletes accumulate in a write batch that
+ * is written with leveldb_write once it reaches max_bytes or max_ops, or
+ * max_delay after its first operation, whichever comes first. Size and
+ * count flushes happen in the writing thread; a timer thread handles the
+ * delay. A flush swaps in an empty batch and writes the full one without
+ * the mutex held, so other threads keep adding meanwhile; flushes wait for
+ * each other to keep writes in order. A failed flush puts its operations
+ * back ahead of those added since, to be retried by the next flush, and is
+ * reported by the next call. Flush latencies are kept in a log2 histogram
+ * for the statistics.
+ */
+static const int BATCHER_STAT_FLUSHES = 0;
+static const int BATCHER_STAT_OPS = 1;
+static const int BATCHER_STAT_BYTES = 2;
+static const int BATCHER_STAT_TOTAL_MICROS = 3;
+static const int BATCHER_STAT_MAX_MICROS = 4;
+static const int BATCHER_STAT_P50_MICROS = 5;
+static const int BATCHER_STAT_P99_MICROS = 6;
+static const int BATCHER_STAT_COUNT = 7;
+static const int LATENCY_BUCKETS = 40;
+
+struct Batcher {
+    leveldb_t *db;
+    leveldb_writeoptions_t *options;
+    leveldb_writebatch_t *batch;
+    leveldb_writebatch_t *spare;  // empty, swapped in by a flush
+    size_t bytes;
+    size_t ops;
+    size_t max_bytes;
+    size_t max_ops;
+    jlong max_delay_micros;
+    jlong first_op;
+    pthread_t timer;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_cond_t flushed_cond;
+    bool flushing;
+    bool stopping;
+    std::string error;
+    jlong stats[BATCHER_STAT_COUNT];
+    jlong latencies[LATENCY_BUCKETS];
+};
+
+/*
+ * Writes the pending batch. Called with the mutex held, which is released
+ * during the write.
+ */
+static void batcher_flush(Batcher *batcher) {
+    while (batcher->flushing) {
+        pthread_cond_wait(&batcher->flushed_cond, &batcher->mutex);
     }
-    if (name == 0) {
-        error(env, "LevelDB filename is NULL");
+    if (batcher->ops == 0) {
         return;
     }
+    leveldb_writebatch_t *batch = batcher->batch;
+    size_t ops = batcher->ops;
+    size_t bytes = batcher->bytes;
+    batcher->batch = batcher->spare;
+    batcher->spare = NULL;
+    batcher->ops = 0;
+    batcher->bytes = 0;
+    batcher->flushing = true;
+    pthread_mutex_unlock(&batcher->mutex);
+
+    jlong start = now_micros();
+    char *errptr = NULL;
+    db_write(batcher->db, batcher->options, batch, &errptr);
+    jlong latency = now_micros() - start;
 
-    const char* name_chars = env->GetStringUTFChars(name, NULL);
-
-    char* errptr = NULL;
-
-    leveldb_repair_db(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        name_chars,
-        &errptr);
-
-    env->ReleaseStringUTFChars(name, name_chars);
+    pthread_mutex_lock(&batcher->mutex);
+    batcher->flushing = false;
+    pthread_cond_broadcast(&batcher->flushed_cond);
 
     if (errptr != NULL) {
-        error(env, errptr);
+        if (batcher->error.empty()) {
+            batcher->error = errptr;
+        }
         free(errptr);
+        // keep the failed operations first, then retry after a full delay
+        MergeState state = { batch, 0 };
+        leveldb_writebatch_iterate(batcher->batch, &state, merge_put, merge_delete);
+        leveldb_writebatch_clear(batcher->batch);
+        batcher->spare = batcher->batch;
+        batcher->batch = batch;
+        batcher->ops += ops;
+        batcher->bytes += bytes;
+        batcher->first_op = now_micros();
         return;
     }
+
+    batcher->stats[BATCHER_STAT_FLUSHES]++;
+    batcher->stats[BATCHER_STAT_OPS] += ops;
+    batcher->stats[BATCHER_STAT_BYTES] += bytes;
+    batcher->stats[BATCHER_STAT_TOTAL_MICROS] += latency;
+    batcher->stats[BATCHER_STAT_MAX_MICROS] = std::max(batcher->stats[BATCHER_STAT_MAX_MICROS], latency);
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && (latency >> bucket) > 0) {
+        bucket++;
+    }
+    batcher->latencies[bucket]++;
+    leveldb_writebatch_clear(batch);
+    batcher->spare = batch;
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1destroy
-  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+/* Upper bound, in microseconds, of the latency bucket holding fraction of flushes. */
+static jlong batcher_percentile(const Batcher *batcher, double fraction) {
+    jlong flushes = batcher->stats[BATCHER_STAT_FLUSHES];
+    if (flushes == 0) {
+        return 0;
+    }
+    jlong seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += batcher->latencies[bucket];
+        if (seen >= fraction * flushes) {
+            return bucket == 0 ? 0 : ((jlong)1 << bucket) - 1;
+        }
+    }
+    return batcher->stats[BATCHER_STAT_MAX_MICROS];
+}
 
-    if (iterator_ptr == 0) {
-        error(env, "LevelDB iterator handle is NULL");
-        return;
+static void* batcher_timer_main(void *arg) {
+    Batcher *batcher = static_cast<Batcher*>(arg);
+
+    pthread_mutex_lock(&batcher->mutex);
+    while (!batcher->stopping) {
+        if (batcher->ops == 0) {
+            pthread_cond_wait(&batcher->cond, &batcher->mutex);
+            continue;
+        }
+        jlong deadline = batcher->first_op + batcher->max_delay_micros;
+        if (now_micros() >= deadline) {
+            batcher_flush(batcher);
+            continue;
+        }
+        struct timespec until;
+        until.tv_sec = deadline / 1000000;
+        until.tv_nsec = (deadline % 1000000) * 1000;
+        pthread_cond_timedwait(&batcher->cond, &batcher->mutex, &until);
     }
+    pthread_mutex_unlock(&batcher->mutex);
+    return NULL;
+}
 
-    leveldb_iter_destroy(
-        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr));
+/*
+ * Takes the sticky error of a failed automatic flush, if any, so it can be
+ * thrown. Called with the mutex held.
+ */
+static std::string batcher_take_error(Batcher *batcher) {
+    std::string msg;
+    msg.swap(batcher->error);
+    return msg;
 }
 
-JNIEXPORT jboolean JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1valid
-  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+/* Records an added operation and flushes if a size or count bound is reached. */
+static std::string batcher_added(Batcher *batcher, size_t bytes) {
+    if (batcher->ops == 0) {
+        batcher->first_op = now_micros();
+        pthread_cond_signal(&batcher->cond);
+    }
+    batcher->ops++;
+    batcher->bytes += bytes;
+    if (batcher->bytes >= batcher->max_bytes || batcher->ops >= batcher->max_ops) {
+        batcher_flush(batcher);
+    }
+    return batcher_take_error(batcher);
+}
 
-    if (iterator_ptr == 0) {
-        error(env, "LevelDB iterator handle is NULL");
+/*
+ * Creates a batcher for db. A bound of 0 leaves it unlimited, so with all
+ * three at 0 the batch is only written by leveldb_batcher_flush.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1batcher_1create
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong writeoptions_ptr,
+   jlong max_bytes, jint max_ops, jlong max_delay_millis) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
+    }
+    if (writeoptions_ptr == 0) {
+        error(env, "LevelDB write options handle is NULL");
+        return 0;
+    }
+    if (max_bytes < 0 || max_ops < 0 || max_delay_millis < 0) {
+        error(env, "LevelDB batcher bounds must not be negative");
         return 0;
     }
 
-    return leveldb_iter_valid(
-        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr));
+    Batcher *batcher = new Batcher();
+    batcher->db = reinterpret_cast<leveldb_t*>(leveldb_ptr);
+    batcher->options = reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr);
+    batcher->batch = leveldb_writebatch_create();
+    batcher->spare = leveldb_writebatch_create();
+    batcher->bytes = 0;
+    batcher->ops = 0;
+    batcher->max_bytes = max_bytes > 0 ? max_bytes : (size_t)-1;
+    batcher->max_ops = max_ops > 0 ? max_ops : (size_t)-1;
+    batcher->max_delay_micros = max_delay_millis * 1000;
+    batcher->first_op = 0;
+    batcher->flushing = false;
+    batcher->stopping = false;
+    memset(batcher->stats, 0, sizeof(batcher->stats));
+    memset(batcher->latencies, 0, sizeof(batcher->latencies));
+    pthread_mutex_init(&batcher->mutex, NULL);
+    pthread_cond_init(&batcher->cond, NULL);
+    pthread_cond_init(&batcher->flushed_cond, NULL);
+
+    if (max_delay_millis > 0 &&
+        pthread_create(&batcher->timer, NULL, batcher_timer_main, batcher) != 0) {
+        pthread_cond_destroy(&batcher->flushed_cond);
+        pthread_cond_destroy(&batcher->cond);
+        pthread_mutex_destroy(&batcher->mutex);
+        leveldb_writebatch_destroy(batcher->spare);
+        leveldb_writebatch_destroy(batcher->batch);
+        delete batcher;
+        error(env, "LevelDB batcher timer thread could not be started");
+        return 0;
+    }
+
+    return reinterpret_cast<jlong>(batcher);
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1seek_1to_1first
-  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+/*
+ * Flushes what is pending, then frees the batcher. If that flush fails the
+ * failure is thrown with the number of operations that were not written.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1batcher_1destroy
+  (JNIEnv *env, jobject obj, jlong batcher_ptr) {
 
-    if (iterator_ptr == 0) {
-        error(env, "LevelDB iterator handle is NULL");
+    if (batcher_ptr == 0) {
+        error(env, "LevelDB batcher handle is NULL");
         return;
     }
 
-    leveldb_iter_seek_to_first(
-        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr));
-}
+    Batcher *batcher = reinterpret_cast<Batcher*>(batcher_ptr);
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1seek_1to_1last
-  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+    pthread_mutex_lock(&batcher->mutex);
+    batcher->stopping = true;
+    pthread_cond_signal(&batcher->cond);
+    pthread_mutex_unlock(&batcher->mutex);
+    if (batcher->max_delay_micros > 0) {
+        pthread_join(batcher->timer, NULL);
+    }
 
-    if (iterator_ptr == 0) {
-        error(env, "LevelDB iterator handle is NULL");
-        return;
+    pthread_mutex_lock(&batcher->mutex);
+    batcher_flush(batcher);
+    std::string msg = batcher_take_error(batcher);
+    if (batcher->ops > 0) {
+        char lost[64];
+        snprintf(lost, sizeof(lost), " (%lu batched operations not written)", (unsigned long)batcher->ops);
+        msg += lost;
     }
+    pthread_mutex_unlock(&batcher->mutex);
 
-    leveldb_iter_seek_to_last(
-        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr));
+    pthread_cond_destroy(&batcher->flushed_cond);
+    pthread_cond_destroy(&batcher->cond);
+    pthread_mutex_destroy(&batcher->mutex);
+    leveldb_writebatch_destroy(batcher->spare);
+    leveldb_writebatch_destroy(batcher->batch);
+    delete batcher;
+
+    if (!msg.empty()) {
+        status_error(env, msg.c_str());
+    }
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1seek
-  (JNIEnv *env, jobject obj, jlong iterator_ptr, jbyteArray key) {
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1batcher_1put
+  (JNIEnv *env, jobject obj, jlong batcher_ptr, jbyteArray key, jbyteArray value) {
 
-    if (iterator_ptr == 0) {
-        error(env, "LevelDB iterator handle is NULL");
+    if (batcher_ptr == 0) {
+        error(env, "LevelDB batcher handle is NULL");
         return;
     }
     if (key == 0) {
         error(env, "LevelDB key is NULL");
         return;
     }
-
-    jsize key_length = env->GetArrayLength(key);
-    const jbyte *key_bytes = env->GetByteArrayElements(key, NULL);
-
-    leveldb_iter_seek(
-        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr),
-        (const char*)key_bytes,
-        key_length);
-}
-
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1next
-  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
-
-    if (iterator_ptr == 0) {
-        error(env, "LevelDB iterator handle is NULL");
+    if (value == 0) {
+        error(env, "LevelDB value is NULL");
         return;
     }
 
-    leveldb_iter_next(
-        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr));
+    Batcher *batcher = reinterpret_cast<Batcher*>(batcher_ptr);
+    std::string msg;
+    {
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) return;
+        ArrayCopy value_bytes(env, value);
+        if (value_bytes.data() == NULL) return;
+
+        pthread_mutex_lock(&batcher->mutex);
+        leveldb_writebatch_put(batcher->batch, key_bytes.data(), key_bytes.size(),
+                               value_bytes.data(), value_bytes.size());
+        msg = batcher_added(batcher, key_bytes.size() + value_bytes.size());
+        pthread_mutex_unlock(&batcher->mutex);
+    }
+
+    if (!msg.empty()) {
+        status_error(env, msg.c_str());
+    }
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1prev
-  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1batcher_1delete
+  (JNIEnv *env, jobject obj, jlong batcher_ptr, jbyteArray key) {
 
-    if (iterator_ptr == 0) {
-        error(env, "LevelDB iterator handle is NULL");
+    if (batcher_ptr == 0) {
+        error(env, "LevelDB batcher handle is NULL");
+        return;
+    }
+    if (key == 0) {
+        error(env, "LevelDB key is NULL");
         return;
     }
 
-    leveldb_iter_prev(
-        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr));
-}
+    Batcher *batcher = reinterpret_cast<Batcher*>(batcher_ptr);
+    std::string msg;
+    {
+        ArrayCopy key_bytes(env, key);
+        if (key_bytes.data() == NULL) return;
 
-JNIEXPORT jbyteArray JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1key
-  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+        pthread_mutex_lock(&batcher->mutex);
+        leveldb_writebatch_delete(batcher->batch, key_bytes.data(), key_bytes.size());
+        msg = batcher_added(batcher, key_bytes.size());
+        pthread_mutex_unlock(&batcher->mutex);
+    }
 
-    if (iterator_ptr == 0) {
-        error(env, "LevelDB iterator handle is NULL");
-        return NULL;
+    if (!msg.empty()) {
+        status_error(env, msg.c_str());
     }
+}
 
-    size_t keylen = 0;
+/* Writes whatever is pending now. */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1batcher_1flush
+  (JNIEnv *env, jobject obj, jlong batcher_ptr) {
 
-    const char* key = leveldb_iter_key(
-        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr),
-        &keylen);
+    if (batcher_ptr == 0) {
+        error(env, "LevelDB batcher handle is NULL");
+        return;
+    }
 
-    jbyteArray retval = env->NewByteArray(keylen);
-        env->SetByteArrayRegion(retval, 0,
-	    keylen, (const jbyte *)key);
+    Batcher *batcher = reinterpret_cast<Batcher*>(batcher_ptr);
 
-	return retval;
+    pthread_mutex_lock(&batcher->mutex);
+    batcher_flush(batcher);
+    std::string msg = batcher_take_error(batcher);
+    pthread_mutex_unlock(&batcher->mutex);
+
+    if (!msg.empty()) {
+        status_error(env, msg.c_str());
+    }
 }
 
-JNIEXPORT jbyteArray JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1value
-  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+/*
+ * Copies the flush statistics into stats, as many as fit, and optionally
+ * resets them.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1batcher_1stats
+  (JNIEnv *env, jobject obj, jlong batcher_ptr, jlongArray stats, jboolean reset) {
 
-    if (iterator_ptr == 0) {
-        error(env, "LevelDB iterator handle is NULL");
-        return NULL;
+    if (batcher_ptr == 0) {
+        error(env, "LevelDB batcher handle is NULL");
+        return;
+    }
+    if (stats == 0) {
+        error(env, "LevelDB statistics array is NULL");
+        return;
     }
 
-    size_t vallen = 0;
-
-    const char* value = leveldb_iter_value(
-        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr),
-        &vallen);
+    Batcher *batcher = reinterpret_cast<Batcher*>(batcher_ptr);
+    jlong values[BATCHER_STAT_COUNT];
 
-    jbyteArray retval = env->NewByteArray(vallen);
-        env->SetByteArrayRegion(retval, 0,
-	    vallen, (const jbyte *)value);
+    pthread_mutex_lock(&batcher->mutex);
+    memcpy(values, batcher->stats, sizeof(values));
+    values[BATCHER_STAT_P50_MICROS] = batcher_percentile(batcher, 0.5);
+    values[BATCHER_STAT_P99_MICROS] = batcher_percentile(batcher, 0.99);
+    if (reset) {
+        memset(batcher->stats, 0, sizeof(batcher->stats));
+        memset(batcher->latencies, 0, sizeof(batcher->latencies));
+    }
+    pthread_mutex_unlock(&batcher->mutex);
 
-	return retval;
+    jsize count = std::min((jsize)BATCHER_STAT_COUNT, env->GetArrayLength(stats));
+    env->SetLongArrayRegion(stats, 0, count, values);
 }
 
-JNIEXPORT jstring JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1get_1error
-  (JNIEnv *env, jobject obj, jlong iterator_ptr) {
+/*
+ * Attaches a row cache of capacity bytes, split into shards, to db. The
+ * point reads and writes of db go through it from now on.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1rowcache_1create
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong capacity, jint shards) {
 
-    if (iterator_ptr == 0) {
-        error(env, "LevelDB iterator handle is NULL");
-        return NULL;
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
+    }
+    if (capacity <= 0) {
+        error(env, "LevelDB row cache capacity must be positive");
+        return 0;
+    }
+    if (shards <= 0) {
+        error(env, "LevelDB row cache shard count must be positive");
+        return 0;
     }
 
-    char *errptr = NULL;
-
-    leveldb_iter_get_error(
-        reinterpret_cast<leveldb_iterator_t*>(iterator_ptr),
-        &errptr);
+    RowCache *cache = new RowCache();
+    cache->db = reinterpret_cast<leveldb_t*>(leveldb_ptr);
+    init_writer_rwlock(&cache->lock);
+    cache->shard_count = shards;
+    cache->shards = new RowShard[shards];
+    for (jint i = 0; i < shards; i++) {
+        RowShard *shard = &cache->shards[i];
+        pthread_mutex_init(&shard->mutex, NULL);
+        chained_init(&shard->table);
+        shard->lru.next = &shard->lru;
+        shard->lru.prev = &shard->lru;
+        shard->usage = 0;
+        shard->capacity = capacity / shards;
+        shard->generation = 0;
+        memset(shard->stats, 0, sizeof(shard->stats));
+    }
 
-    if (errptr) {
-        jstring retval = env->NewStringUTF(errptr);
-        free(errptr);
-        return retval;
+    pthread_rwlock_wrlock(&row_cache_lock);
+    bool attached = row_caches.insert(std::make_pair(cache->db, cache)).second;
+    if (attached) {
+        row_cache_count++;
     }
-    else {
-        return NULL;
+    pthread_rwlock_unlock(&row_cache_lock);
+
+    if (!attached) {
+        for (jint i = 0; i < shards; i++) {
+            pthread_mutex_destroy(&cache->shards[i].mutex);
+        }
+        pthread_rwlock_destroy(&cache->lock);
+        delete[] cache->shards;
+        delete cache;
+        error(env, "LevelDB database already has a row cache");
+        return 0;
     }
+    return reinterpret_cast<jlong>(cache);
 }
 
-JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1create
-  (JNIEnv *env, jobject obj) {
+/*
+ * Detaches the row cache from its database, if still open, and frees it
+ * once the operations using it have finished.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1rowcache_1destroy
+  (JNIEnv *env, jobject obj, jlong rowcache_ptr) {
 
-    leveldb_writebatch_t* retval = leveldb_writebatch_create();
-    return reinterpret_cast<jlong>(retval);
-}
+    if (rowcache_ptr == 0) {
+        error(env, "LevelDB row cache handle is NULL");
+        return;
+    }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1destroy
-  (JNIEnv *env, jobject obj, jlong writebatch_ptr) {
+    RowCache *cache = reinterpret_cast<RowCache*>(rowcache_ptr);
 
-    if (writebatch_ptr == 0) {
-        error(env, "LevelDB write batch handle is NULL");
-        return;
+    pthread_rwlock_wrlock(&row_cache_lock);
+    std::map<leveldb_t*, RowCache*>::iterator it = row_caches.find(cache->db);
+    if (it != row_caches.end() && it->second == cache) {
+        row_caches.erase(it);
+        row_cache_count--;
     }
+    pthread_rwlock_unlock(&row_cache_lock);
+    pthread_rwlock_wrlock(&cache->lock);
+    pthread_rwlock_unlock(&cache->lock);
 
-    leveldb_writebatch_destroy(
-        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr));
+    row_cache_clear(cache);
+    for (size_t i = 0; i < cache->shard_count; i++) {
+        pthread_mutex_destroy(&cache->shards[i].mutex);
+    }
+    pthread_rwlock_destroy(&cache->lock);
+    delete[] cache->shards;
+    delete cache;
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1clear
-  (JNIEnv *env, jobject obj, jlong writebatch_ptr) {
+/*
+ * Copies the row cache statistics into stats, as many as fit, and
+ * optionally resets the counters. Entries, bytes and capacity are current
+ * values and are not reset.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1rowcache_1stats
+  (JNIEnv *env, jobject obj, jlong rowcache_ptr, jlongArray stats, jboolean reset) {
 
-    if (writebatch_ptr == 0) {
-        error(env, "LevelDB write batch handle is NULL");
+    if (rowcache_ptr == 0) {
+        error(env, "LevelDB row cache handle is NULL");
+        return;
+    }
+    if (stats == 0) {
+        error(env, "LevelDB statistics array is NULL");
         return;
     }
 
-    leveldb_writebatch_clear(
-        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr));
+    RowCache *cache = reinterpret_cast<RowCache*>(rowcache_ptr);
+    jlong values[ROWCACHE_STAT_COUNT];
+    memset(values, 0, sizeof(values));
+
+    for (size_t i = 0; i < cache->shard_count; i++) {
+        RowShard *shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        for (int stat = 0; stat < ROWCACHE_STAT_ENTRIES; stat++) {
+            values[stat] += shard->stats[stat];
+        }
+        values[ROWCACHE_STAT_ENTRIES] += shard->table.entries;
+        values[ROWCACHE_STAT_BYTES] += shard->usage;
+        values[ROWCACHE_STAT_CAPACITY] += shard->capacity;
+        if (reset) {
+            memset(shard->stats, 0, sizeof(shard->stats));
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
+
+    jsize count = std::min((jsize)ROWCACHE_STAT_COUNT, env->GetArrayLength(stats));
+    env->SetLongArrayRegion(stats, 0, count, values);
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1put
-  (JNIEnv *env, jobject obj, jlong writebatch_ptr, jbyteArray key, jbyteArray value) {
+/*
+ * Sidecar file of a Bloom filter: the magic, bits per key, probe count and
+ * filter length as big-endian ints, the filter bytes, and a masked crc32c
+ * of everything before it.
+ */
+static const char BLOOM_FILE_MAGIC[] = "jldbblm1";
+static const size_t BLOOM_FILE_HEADER = 8 + 3 * 4;
 
-    if (writebatch_ptr == 0) {
-        error(env, "LevelDB write batch handle is NULL");
-        return;
+/*
+ * Attaches a Bloom filter with bits_per_key bits per key to db and builds
+ * it from a scan, as bloom_rebuild does.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1bloom_1create
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr, jint bits_per_key) {
+
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
     }
-    if (key == 0) {
-        error(env, "LevelDB key is NULL");
-        return;
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
+        return 0;
     }
-    if (value == 0) {
-        error(env, "LevelDB value is NULL");
-        return;
+    if (bits_per_key <= 0) {
+        error(env, "LevelDB Bloom filter bits per key must be positive");
+        return 0;
     }
 
-    jsize key_length = env->GetArrayLength(key);
-    const jbyte *key_bytes = env->GetByteArrayElements(key, NULL);
-    jsize value_length = env->GetArrayLength(value);
-    const jbyte *value_bytes = env->GetByteArrayElements(value, NULL);
+    Bloom *bloom = bloom_new(reinterpret_cast<leveldb_t*>(leveldb_ptr), bits_per_key);
+    if (!bloom_attach(bloom)) {
+        bloom_free(bloom);
+        error(env, "LevelDB database already has a Bloom filter");
+        return 0;
+    }
 
-    leveldb_writebatch_put(
-        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr),
-        (const char*)key_bytes,
-        key_length,
-        (const char*)value_bytes,
-        value_length);
+    // attached first, passing every key, so writes during the scan are seen
+    std::string msg;
+    if (!bloom_rebuild(bloom, reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr), msg)) {
+        bloom_detach(bloom);
+        status_error(env, msg.c_str());
+        return 0;
+    }
+    return reinterpret_cast<jlong>(bloom);
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1delete
-  (JNIEnv *env, jobject obj, jlong writebatch_ptr, jbyteArray key) {
+/*
+ * Attaches the Bloom filter saved in the file name to db. It is only
+ * correct if db has not been written since the filter was saved, so the
+ * file is removed once attached: after a crash there is no stale filter to
+ * load, and the caller falls back to leveldb_bloom_create.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1bloom_1load
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jstring name) {
 
-    if (writebatch_ptr == 0) {
-        error(env, "LevelDB write batch handle is NULL");
-        return;
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
     }
-    if (key == 0) {
-        error(env, "LevelDB key is NULL");
-        return;
+    if (name == NULL) {
+        error(env, "LevelDB Bloom filter filename is NULL");
+        return 0;
     }
 
-    jsize key_length = env->GetArrayLength(key);
-    const jbyte *key_bytes = env->GetByteArrayElements(key, NULL);
+    const char* utf_chars = env->GetStringUTFChars(name, NULL);
+    assert(utf_chars);
+    std::string fname(utf_chars);
+    env->ReleaseStringUTFChars(name, utf_chars);
 
-    leveldb_writebatch_delete(
-        reinterpret_cast<leveldb_writebatch_t*>(writebatch_ptr),
-        (const char*)key_bytes,
-        key_length);
-}
+    std::string contents;
+    FILE *file = fopen(fname.c_str(), "rb");
+    if (file == NULL) {
+        status_error(env, ("IO error: " + fname + ": " + strerror(errno)).c_str());
+        return 0;
+    }
+    char buffer[8192];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, n);
+    }
+    bool failed = ferror(file) != 0;
+    fclose(file);
+    if (failed) {
+        status_error(env, ("IO error: " + fname + ": " + strerror(errno)).c_str());
+        return 0;
+    }
 
-JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1create
-  (JNIEnv *env, jobject obj) {
+    const char *p = contents.data();
+    if (contents.size() < BLOOM_FILE_HEADER + 4 ||
+        memcmp(p, BLOOM_FILE_MAGIC, 8) != 0 ||
+        decode_int32(p + 16) != contents.size() - BLOOM_FILE_HEADER - 4 ||
+        decode_int32(p + contents.size() - 4) !=
+            masked_crc(leveldb::crc32c::Extend(0, p, contents.size() - 4))) {
+        status_error(env, ("Corruption: " + fname + ": not a valid Bloom filter file").c_str());
+        return 0;
+    }
+    int bits_per_key = (int)decode_int32(p + 8);
+    int probes = (int)decode_int32(p + 12);
+    size_t length = decode_int32(p + 16);
+    if (bits_per_key <= 0 || probes <= 0 || probes > 30 || length == 0) {
+        status_error(env, ("Corruption: " + fname + ": not a valid Bloom filter file").c_str());
+        return 0;
+    }
 
-    leveldb_options_t* retval = leveldb_options_create();
-    return reinterpret_cast<jlong>(retval);
+    Bloom *bloom = bloom_new(reinterpret_cast<leveldb_t*>(leveldb_ptr), bits_per_key);
+    bloom->current = new BloomBits();
+    bloom->current->bytes.assign(p + BLOOM_FILE_HEADER, p + BLOOM_FILE_HEADER + length);
+    bloom->current->bits = length * 8;
+    bloom->current->probes = probes;
+    if (!bloom_attach(bloom)) {
+        bloom_free(bloom);
+        error(env, "LevelDB database already has a Bloom filter");
+        return 0;
+    }
+    if (unlink(fname.c_str()) != 0) {
+        std::string msg = "IO error: " + fname + ": " + strerror(errno);
+        bloom_detach(bloom);
+        status_error(env, msg.c_str());
+        return 0;
+    }
+    return reinterpret_cast<jlong>(bloom);
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1destroy
-  (JNIEnv *env, jobject obj, jlong options_ptr) {
+/* Detaches the Bloom filter from its database, if still open, and frees it. */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1bloom_1destroy
+  (JNIEnv *env, jobject obj, jlong bloom_ptr) {
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
+    if (bloom_ptr == 0) {
+        error(env, "LevelDB Bloom filter handle is NULL");
         return;
     }
 
-    leveldb_options_destroy(
-        reinterpret_cast<leveldb_options_t*>(options_ptr));
+    bloom_detach(reinterpret_cast<Bloom*>(bloom_ptr));
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1create_1if_1missing
-  (JNIEnv *env, jobject obj, jlong options_ptr, jboolean value) {
+/*
+ * Rebuilds the filter from a scan of the latest state, dropping deleted
+ * keys and resizing it for the keys there are now. Reads and writes carry
+ * on against the old filter meanwhile.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1bloom_1rebuild
+  (JNIEnv *env, jobject obj, jlong bloom_ptr, jlong readoptions_ptr) {
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
+    if (bloom_ptr == 0) {
+        error(env, "LevelDB Bloom filter handle is NULL");
+        return;
+    }
+    if (readoptions_ptr == 0) {
+        error(env, "LevelDB read options handle is NULL");
         return;
     }
 
-    unsigned char native_bool = value ? 1 : 0;
-
-    leveldb_options_set_create_if_missing(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        native_bool);
+    std::string msg;
+    if (!bloom_rebuild(reinterpret_cast<Bloom*>(bloom_ptr),
+                       reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr), msg)) {
+        status_error(env, msg.c_str());
+    }
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1error_1if_1exists
-  (JNIEnv *env, jobject obj, jlong options_ptr, jboolean value) {
+/*
+ * Copies the Bloom filter statistics into stats, as many as fit, and
+ * optionally resets the read counters. Keys and deletes count since the
+ * last rebuild.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1bloom_1stats
+  (JNIEnv *env, jobject obj, jlong bloom_ptr, jlongArray stats, jboolean reset) {
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
+    if (bloom_ptr == 0) {
+        error(env, "LevelDB Bloom filter handle is NULL");
+        return;
+    }
+    if (stats == 0) {
+        error(env, "LevelDB statistics array is NULL");
         return;
     }
 
-    unsigned char native_bool = value ? 1 : 0;
+    Bloom *bloom = reinterpret_cast<Bloom*>(bloom_ptr);
+    jlong values[BLOOM_STAT_COUNT];
 
-    leveldb_options_set_error_if_exists(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        native_bool);
+    pthread_rwlock_rdlock(&bloom->lock);
+    for (int stat = 0; stat < BLOOM_STAT_BITS; stat++) {
+        values[stat] = __sync_fetch_and_add(&bloom->stats[stat], 0);
+    }
+    values[BLOOM_STAT_BITS] = bloom->current != NULL ? bloom->current->bits : 0;
+    if (reset) {
+        __sync_fetch_and_and(&bloom->stats[BLOOM_STAT_NEGATIVES], 0);
+        __sync_fetch_and_and(&bloom->stats[BLOOM_STAT_PASSES], 0);
+        __sync_fetch_and_and(&bloom->stats[BLOOM_STAT_FALSE_POSITIVES], 0);
+    }
+    pthread_rwlock_unlock(&bloom->lock);
+
+    jsize count = std::min((jsize)BLOOM_STAT_COUNT, env->GetArrayLength(stats));
+    env->SetLongArrayRegion(stats, 0, count, values);
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1paranoid_1checks
-  (JNIEnv *env, jobject obj, jlong options_ptr, jboolean value) {
+/*
+ * Writes the filter to the file name, through a temporary file that is
+ * renamed into place. Save it after the last write, before closing;
+ * leveldb_bloom_load consumes the file.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1bloom_1save
+  (JNIEnv *env, jobject obj, jlong bloom_ptr, jstring name) {
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
+    if (bloom_ptr == 0) {
+        error(env, "LevelDB Bloom filter handle is NULL");
+        return;
+    }
+    if (name == NULL) {
+        error(env, "LevelDB Bloom filter filename is NULL");
         return;
     }
 
-    unsigned char native_bool = value ? 1 : 0;
+    Bloom *bloom = reinterpret_cast<Bloom*>(bloom_ptr);
 
-    leveldb_options_set_paranoid_checks(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        native_bool);
+    std::string contents(BLOOM_FILE_MAGIC, 8);
+    contents.resize(BLOOM_FILE_HEADER);
+    pthread_rwlock_rdlock(&bloom->lock);
+    if (bloom->current != NULL) {
+        encode_int32(&contents[8], bloom->bits_per_key);
+        encode_int32(&contents[12], bloom->current->probes);
+        encode_int32(&contents[16], bloom->current->bytes.size());
+        contents.append((const char*)&bloom->current->bytes[0], bloom->current->bytes.size());
+    }
+    pthread_rwlock_unlock(&bloom->lock);
+    if (contents.size() == BLOOM_FILE_HEADER) {
+        error(env, "LevelDB Bloom filter has not been built");
+        return;
+    }
+    char crc[4];
+    encode_int32(crc, masked_crc(leveldb::crc32c::Extend(0, contents.data(), contents.size())));
+    contents.append(crc, 4);
+
+    const char* utf_chars = env->GetStringUTFChars(name, NULL);
+    assert(utf_chars);
+    std::string fname(utf_chars);
+    env->ReleaseStringUTFChars(name, utf_chars);
+    std::string tmpname = fname + ".tmp";
+
+    FILE *file = fopen(tmpname.c_str(), "wb");
+    bool failed = file == NULL;
+    if (!failed) {
+        failed = fwrite(contents.data(), 1, contents.size(), file) != contents.size() ||
+                 fflush(file) != 0 || fsync(fileno(file)) != 0;
+        failed = fclose(file) != 0 || failed;
+    }
+    if (!failed && rename(tmpname.c_str(), fname.c_str()) != 0) {
+        failed = true;
+    }
+    if (failed) {
+        std::string msg = "IO error: " + tmpname + ": " + strerror(errno);
+        unlink(tmpname.c_str());
+        status_error(env, msg.c_str());
+    }
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1env
-  (JNIEnv *env, jobject obj, jlong options_ptr, jlong env_ptr) {
+/*
+ * Scan-resistant block cache. leveldb only talks to its block cache through
+ * the abstract leveldb::Cache, declared here to match the bundled library,
+ * so any implementation can be installed in a leveldb_cache_t. This one is
+ * a sharded 2Q cache. A block seen for the first time goes into a FIFO
+ * holding a quarter of the capacity. When the FIFO evicts it, only its hash
+ * and charge are kept in a ghost queue. A block that is looked up again
+ * while in the FIFO, or that misses while it is still a ghost, goes into
+ * the main LRU, which only re-referenced blocks enter. leveldb's iterators
+ * look each block up once, so a scan cycles through the FIFO without
+ * evicting the working set. As in the LRU cache, entries hold a reference
+ * while cached, and the deleter runs once the last handle is released.
+ */
+namespace leveldb {
+class Cache {
+  public:
+    Cache() {}
+    virtual ~Cache();
+
+    struct Handle {};
+    virtual Handle* Insert(const Slice &key, void *value, size_t charge,
+                           void (*deleter)(const Slice &key, void *value)) = 0;
+    virtual Handle* Lookup(const Slice &key) = 0;
+    virtual void Release(Handle *handle) = 0;
+    virtual void* Value(Handle *handle) = 0;
+    virtual void Erase(const Slice &key) = 0;
+    virtual uint64_t NewId() = 0;
+
+  private:
+    void *rep_;
+};
+}
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
-        return;
+/* leveldb_cache_t holds the leveldb::Cache it wraps as its only member. */
+struct CacheLayout {
+    leveldb::Cache *rep;
+};
+
+static const int TWOQ_IN = 0;
+static const int TWOQ_MAIN = 1;
+
+static const int TWOQ_STAT_HITS = 0;
+static const int TWOQ_STAT_MISSES = 1;
+static const int TWOQ_STAT_INSERTS = 2;
+static const int TWOQ_STAT_PROMOTIONS = 3;
+static const int TWOQ_STAT_EVICTIONS = 4;
+static const int TWOQ_STAT_ENTRIES = 5;
+static const int TWOQ_STAT_BYTES = 6;
+static const int TWOQ_STAT_CAPACITY = 7;
+static const int TWOQ_STAT_COUNT = 8;
+
+struct TwoQEntry : public leveldb::Cache::Handle, public ChainedEntry {
+    TwoQEntry *prev;
+    TwoQEntry *next;
+    int queue;
+    int refs;
+    size_t charge;
+    void *value;
+    void (*deleter)(const leveldb::Slice &key, void *value);
+};
+
+struct TwoQShard {
+    pthread_mutex_t mutex;
+    ChainedTable table;
+    TwoQEntry queues[2];  // list heads; next is the oldest entry
+    size_t usage[2];
+    size_t capacity;
+    size_t in_capacity;
+    std::deque<std::pair<uint32_t, size_t> > ghosts;
+    std::map<uint32_t, int> ghost_counts;
+    size_t ghost_usage;
+    size_t ghost_capacity;
+    jlong stats[TWOQ_STAT_ENTRIES];  // the counters; the rest are read off the shard
+};
+
+class TwoQueueCache : public leveldb::Cache {
+  public:
+    TwoQueueCache(size_t capacity, size_t shard_count);
+    virtual ~TwoQueueCache();
+
+    virtual Handle* Insert(const leveldb::Slice &key, void *value, size_t charge,
+                           void (*deleter)(const leveldb::Slice &key, void *value));
+    virtual Handle* Lookup(const leveldb::Slice &key);
+    virtual void Release(Handle *handle);
+    virtual void* Value(Handle *handle);
+    virtual void Erase(const leveldb::Slice &key);
+    virtual uint64_t NewId();
+
+    /* Sums the statistics of all shards into values, TWOQ_STAT_COUNT of them. */
+    void Stats(jlong *values, bool reset);
+
+  private:
+    TwoQShard* shard(uint32_t hash) { return &shards_[hash % shard_count_]; }
+
+    size_t shard_count_;
+    TwoQShard *shards_;
+    pthread_mutex_t id_mutex_;
+    uint64_t last_id_;
+};
+
+static void twoq_unlink(TwoQEntry *entry) {
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+}
+
+static void twoq_append(TwoQShard *shard, TwoQEntry *entry, int queue) {
+    TwoQEntry *head = &shard->queues[queue];
+    entry->queue = queue;
+    entry->next = head;
+    entry->prev = head->prev;
+    entry->prev->next = entry;
+    head->prev = entry;
+}
+
+static void twoq_unref(TwoQEntry *entry) {
+    if (--entry->refs == 0) {
+        entry->deleter(leveldb::Slice(entry->key.data(), entry->key.size()), entry->value);
+        delete entry;
     }
-    if (env_ptr == 0) {
-        error(env, "LevelDB env handle is NULL");
-        return;
+}
+
+/* Takes the entry in slot out of the cache, dropping the cache's reference. */
+static void twoq_remove(TwoQShard *shard, ChainedEntry **slot) {
+    TwoQEntry *entry = static_cast<TwoQEntry*>(chained_unlink(&shard->table, slot));
+    twoq_unlink(entry);
+    shard->usage[entry->queue] -= entry->charge;
+    twoq_unref(entry);
+}
+
+static void twoq_remember(TwoQShard *shard, uint32_t hash, size_t charge) {
+    shard->ghosts.push_back(std::make_pair(hash, charge));
+    shard->ghost_counts[hash]++;
+    shard->ghost_usage += charge;
+    while (shard->ghost_usage > shard->ghost_capacity && !shard->ghosts.empty()) {
+        std::pair<uint32_t, size_t> oldest = shard->ghosts.front();
+        shard->ghosts.pop_front();
+        shard->ghost_usage -= oldest.second;
+        std::map<uint32_t, int>::iterator it = shard->ghost_counts.find(oldest.first);
+        if (--it->second == 0) {
+            shard->ghost_counts.erase(it);
+        }
+    }
+}
+
+/* Evicts until the shard fits, from the FIFO while it is over its share. */
+static void twoq_evict(TwoQShard *shard) {
+    while (shard->usage[TWOQ_IN] + shard->usage[TWOQ_MAIN] > shard->capacity) {
+        bool from_in = shard->usage[TWOQ_IN] > shard->in_capacity ||
+                       shard->queues[TWOQ_MAIN].next == &shard->queues[TWOQ_MAIN];
+        TwoQEntry *victim = shard->queues[from_in ? TWOQ_IN : TWOQ_MAIN].next;
+        if (from_in) {
+            twoq_remember(shard, victim->hash, victim->charge);
+        }
+        twoq_remove(shard, chained_slot_of(&shard->table, victim));
+        shard->stats[TWOQ_STAT_EVICTIONS]++;
+    }
+}
+
+TwoQueueCache::TwoQueueCache(size_t capacity, size_t shard_count)
+    : shard_count_(shard_count), shards_(new TwoQShard[shard_count]), last_id_(0) {
+    pthread_mutex_init(&id_mutex_, NULL);
+    for (size_t i = 0; i < shard_count_; i++) {
+        TwoQShard *shard = &shards_[i];
+        pthread_mutex_init(&shard->mutex, NULL);
+        chained_init(&shard->table);
+        for (int queue = TWOQ_IN; queue <= TWOQ_MAIN; queue++) {
+            shard->queues[queue].next = &shard->queues[queue];
+            shard->queues[queue].prev = &shard->queues[queue];
+            shard->usage[queue] = 0;
+        }
+        shard->capacity = (capacity + shard_count_ - 1) / shard_count_;
+        shard->in_capacity = shard->capacity / 4;
+        shard->ghost_usage = 0;
+        shard->ghost_capacity = shard->capacity / 2;
+        memset(shard->stats, 0, sizeof(shard->stats));
     }
+}
 
-    leveldb_options_set_env(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        reinterpret_cast<leveldb_env_t*>(env_ptr));
+TwoQueueCache::~TwoQueueCache() {
+    for (size_t i = 0; i < shard_count_; i++) {
+        TwoQShard *shard = &shards_[i];
+        for (int queue = TWOQ_IN; queue <= TWOQ_MAIN; queue++) {
+            while (shard->queues[queue].next != &shard->queues[queue]) {
+                twoq_remove(shard, chained_slot_of(&shard->table, shard->queues[queue].next));
+            }
+        }
+        pthread_mutex_destroy(&shard->mutex);
+    }
+    pthread_mutex_destroy(&id_mutex_);
+    delete[] shards_;
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1info_1log
-  (JNIEnv *env, jobject obj, jlong options_ptr, jlong logger_ptr) {
+leveldb::Cache::Handle* TwoQueueCache::Insert(const leveldb::Slice &key, void *value, size_t charge,
+                                              void (*deleter)(const leveldb::Slice &key, void *value)) {
+    uint32_t hash = hash_key(key.data(), key.size());
+    TwoQShard *s = shard(hash);
+
+    TwoQEntry *entry = new TwoQEntry();
+    entry->hash = hash;
+    entry->refs = 2;  // the cache's and the returned handle's
+    entry->charge = charge;
+    entry->key.assign(key.data(), key.size());
+    entry->value = value;
+    entry->deleter = deleter;
+
+    pthread_mutex_lock(&s->mutex);
+    ChainedEntry **slot = chained_slot(&s->table, hash, key.data(), key.size());
+    if (*slot != NULL) {
+        twoq_remove(s, slot);
+    }
+    chained_link(&s->table, slot, entry);
+    int queue = s->ghost_counts.count(hash) > 0 ? TWOQ_MAIN : TWOQ_IN;
+    twoq_append(s, entry, queue);
+    s->usage[queue] += charge;
+    s->stats[TWOQ_STAT_INSERTS]++;
+    if (queue == TWOQ_MAIN) {
+        s->stats[TWOQ_STAT_PROMOTIONS]++;
+    }
+    twoq_evict(s);
+    chained_grow(&s->table);
+    pthread_mutex_unlock(&s->mutex);
+    return entry;
+}
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
-        return;
+leveldb::Cache::Handle* TwoQueueCache::Lookup(const leveldb::Slice &key) {
+    uint32_t hash = hash_key(key.data(), key.size());
+    TwoQShard *s = shard(hash);
+
+    pthread_mutex_lock(&s->mutex);
+    TwoQEntry *entry = static_cast<TwoQEntry*>(*chained_slot(&s->table, hash, key.data(), key.size()));
+    if (entry != NULL) {
+        entry->refs++;
+        if (entry->queue == TWOQ_IN) {
+            s->usage[TWOQ_IN] -= entry->charge;
+            s->usage[TWOQ_MAIN] += entry->charge;
+            s->stats[TWOQ_STAT_PROMOTIONS]++;
+        }
+        twoq_unlink(entry);
+        twoq_append(s, entry, TWOQ_MAIN);
+        s->stats[TWOQ_STAT_HITS]++;
     }
-    if (logger_ptr == 0) {
-        error(env, "LevelDB logger handle is NULL");
-        return;
+    else {
+        s->stats[TWOQ_STAT_MISSES]++;
     }
+    pthread_mutex_unlock(&s->mutex);
+    return entry;
+}
 
-    leveldb_options_set_info_log(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        reinterpret_cast<leveldb_logger_t*>(logger_ptr));
+void TwoQueueCache::Release(Handle *handle) {
+    TwoQEntry *entry = static_cast<TwoQEntry*>(handle);
+    TwoQShard *s = shard(entry->hash);
+    pthread_mutex_lock(&s->mutex);
+    twoq_unref(entry);
+    pthread_mutex_unlock(&s->mutex);
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1write_1buffer_1size
-  (JNIEnv *env, jobject obj, jlong options_ptr, jlong size) {
+void* TwoQueueCache::Value(Handle *handle) {
+    return static_cast<TwoQEntry*>(handle)->value;
+}
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
-        return;
+void TwoQueueCache::Erase(const leveldb::Slice &key) {
+    uint32_t hash = hash_key(key.data(), key.size());
+    TwoQShard *s = shard(hash);
+    pthread_mutex_lock(&s->mutex);
+    ChainedEntry **slot = chained_slot(&s->table, hash, key.data(), key.size());
+    if (*slot != NULL) {
+        twoq_remove(s, slot);
     }
+    pthread_mutex_unlock(&s->mutex);
+}
 
-    assert(size > 0);
+uint64_t TwoQueueCache::NewId() {
+    pthread_mutex_lock(&id_mutex_);
+    uint64_t id = ++last_id_;
+    pthread_mutex_unlock(&id_mutex_);
+    return id;
+}
 
-    leveldb_options_set_write_buffer_size(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        (size_t)size);
+void TwoQueueCache::Stats(jlong *values, bool reset) {
+    memset(values, 0, TWOQ_STAT_COUNT * sizeof(jlong));
+    for (size_t i = 0; i < shard_count_; i++) {
+        TwoQShard *shard = &shards_[i];
+        pthread_mutex_lock(&shard->mutex);
+        for (int stat = 0; stat < TWOQ_STAT_ENTRIES; stat++) {
+            values[stat] += shard->stats[stat];
+        }
+        values[TWOQ_STAT_ENTRIES] += shard->table.entries;
+        values[TWOQ_STAT_BYTES] += shard->usage[TWOQ_IN] + shard->usage[TWOQ_MAIN];
+        values[TWOQ_STAT_CAPACITY] += shard->capacity;
+        if (reset) {
+            memset(shard->stats, 0, sizeof(shard->stats));
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1max_1open_1files
-  (JNIEnv *env, jobject obj, jlong options_ptr, jint value) {
+/*
+ * Creates a block cache of capacity bytes split into shards, each running
+ * the 2Q policy above. It is used and destroyed like an LRU cache.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1cache_1create_1scan_1resistant
+  (JNIEnv *env, jobject obj, jlong capacity, jint shards) {
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
-        return;
+    if (capacity <= 0) {
+        error(env, "LevelDB cache capacity must be positive");
+        return 0;
+    }
+    if (shards <= 0) {
+        error(env, "LevelDB cache shard count must be positive");
+        return 0;
     }
 
-    leveldb_options_set_max_open_files(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        value);
+    // leveldb_cache_t can only be allocated by the library, so take an
+    // empty LRU cache and replace what it wraps
+    leveldb_cache_t *cache = leveldb_cache_create_lru(0);
+    CacheLayout *layout = reinterpret_cast<CacheLayout*>(cache);
+    delete layout->rep;
+    layout->rep = new TwoQueueCache(capacity, shards);
+    return reinterpret_cast<jlong>(cache);
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1cache
-  (JNIEnv *env, jobject obj, jlong options_ptr, jlong cache_ptr) {
+/*
+ * Copies the statistics of a cache made by
+ * leveldb_cache_create_scan_resistant into stats, as many as fit, and
+ * optionally resets the counters. Hits and misses count the lookups leveldb
+ * makes before reading a block; promotions count blocks moved into the main
+ * LRU, on a hit in the FIFO or an insert while still a ghost.
+ */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1cache_1scan_1resistant_1stats
+  (JNIEnv *env, jobject obj, jlong cache_ptr, jlongArray stats, jboolean reset) {
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
-        return;
-    }
     if (cache_ptr == 0) {
         error(env, "LevelDB cache handle is NULL");
         return;
     }
+    if (stats == 0) {
+        error(env, "LevelDB statistics array is NULL");
+        return;
+    }
 
-    leveldb_options_set_cache(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        reinterpret_cast<leveldb_cache_t*>(cache_ptr));
+    CacheLayout *layout = reinterpret_cast<CacheLayout*>(cache_ptr);
+    jlong values[TWOQ_STAT_COUNT];
+    static_cast<TwoQueueCache*>(layout->rep)->Stats(values, reset);
+
+    jsize count = std::min((jsize)TWOQ_STAT_COUNT, env->GetArrayLength(stats));
+    env->SetLongArrayRegion(stats, 0, count, values);
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1block_1size
-  (JNIEnv *env, jobject obj, jlong options_ptr, jlong size) {
+/*
+ * Read pool. A fixed set of native threads that run the slices of parallel
+ * multi-gets. A request sorts its keys and splits them into up to fanout
+ * contiguous slices. Each slice is looked up through its own iterator as
+ * in multiget_sorted. The calling thread queues all but the last slice,
+ * looks that one up itself, and waits for the rest. Every slice reads
+ * under one snapshot, the caller's or one taken for the request, so the
+ * batch sees a single point in time.
+ */
+struct PoolTask {
+    void (*run)(void *arg);
+    void *arg;
+};
+
+struct ReadPool {
+    std::vector<pthread_t> threads;
+    std::deque<PoolTask> tasks;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool stopping;
+};
+
+static void* read_pool_main(void *arg) {
+    ReadPool *pool = static_cast<ReadPool*>(arg);
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (pool->tasks.empty() && !pool->stopping) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+        if (pool->tasks.empty()) {
+            break;
+        }
+        PoolTask task = pool->tasks.front();
+        pool->tasks.pop_front();
+        pthread_mutex_unlock(&pool->mutex);
+        task.run(task.arg);
+        pthread_mutex_lock(&pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
-        return;
+static void read_pool_stop(ReadPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+    for (size_t i = 0; i < pool->threads.size(); i++) {
+        pthread_join(pool->threads[i], NULL);
     }
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+    delete pool;
+}
 
-    assert(size > 0);
+struct MultigetJob {
+    leveldb_t *db;
+    const leveldb_readoptions_t *options;
+    std::vector<std::string> values;
+    std::vector<char> found;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    size_t pending;
+    std::string error;
+};
+
+struct MultigetSlice {
+    MultigetJob *job;
+    const KeyRef *keys;
+    size_t count;
+};
+
+static void multiget_slice_run(void *arg) {
+    MultigetSlice *slice = static_cast<MultigetSlice*>(arg);
+    MultigetJob *job = slice->job;
 
-    leveldb_options_set_block_size(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        (size_t)size);
+    char *errptr = NULL;
+    multiget_sorted(job->db, job->options, slice->keys, slice->count, job->values, job->found, &errptr);
+
+    pthread_mutex_lock(&job->mutex);
+    if (errptr != NULL && job->error.empty()) {
+        job->error = errptr;
+    }
+    if (--job->pending == 0) {
+        pthread_cond_signal(&job->cond);
+    }
+    pthread_mutex_unlock(&job->mutex);
+    free(errptr);
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1block_1restart_1interval
-  (JNIEnv *env, jobject obj, jlong options_ptr, jint value) {
+/*
+ * Looks keys up across the pool in up to fanout slices and encodes the
+ * results as multiget does. Returns false and sets msg on failure.
+ */
+static bool multiget_parallel(ReadPool *pool, leveldb_t *db, const leveldb_readoptions_t *options,
+                              std::vector<KeyRef> &keys, int fanout, std::vector<char> &result,
+                              std::string &msg) {
+    MultigetJob job;
+    job.db = db;
+    job.options = options;
+    job.values.resize(keys.size());
+    job.found.assign(keys.size(), 0);
+
+    const ReadOptionsLayout *layout = reinterpret_cast<const ReadOptionsLayout*>(options);
+    const leveldb_snapshot_t *snapshot = NULL;
+    leveldb_readoptions_t *snapshot_options = NULL;
+    {
+        BloomRef bloom(db);
+        if (layout->snapshot == NULL) {
+            snapshot = leveldb_create_snapshot(db);
+            snapshot_options = leveldb_readoptions_create();
+            leveldb_readoptions_set_verify_checksums(snapshot_options, layout->verify_checksums);
+            leveldb_readoptions_set_fill_cache(snapshot_options, layout->fill_cache);
+            leveldb_readoptions_set_snapshot(snapshot_options, snapshot);
+            job.options = snapshot_options;
+        }
+        // Checked after the snapshot is taken, and before a rebuild can
+        // swap the filter, so only keys the snapshot cannot see are dropped.
+        bloom_drop_absent(bloom.get(), options, keys);
+    }
+    std::sort(keys.begin(), keys.end(), key_ref_less);
+
+    size_t slices = std::min((size_t)(fanout > 0 ? fanout : pool->threads.size() + 1), keys.size());
+    std::vector<MultigetSlice> parts(slices);
+    size_t begin = 0;
+    for (size_t i = 0; i < slices; i++) {
+        size_t count = (keys.size() - begin) / (slices - i);
+        parts[i].job = &job;
+        parts[i].keys = &keys[begin];
+        parts[i].count = count;
+        begin += count;
+    }
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
-        return;
+    pthread_mutex_init(&job.mutex, NULL);
+    pthread_cond_init(&job.cond, NULL);
+    job.pending = slices;
+    if (slices > 1) {
+        pthread_mutex_lock(&pool->mutex);
+        for (size_t i = 0; i + 1 < slices; i++) {
+            PoolTask task = { multiget_slice_run, &parts[i] };
+            pool->tasks.push_back(task);
+        }
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->mutex);
     }
+    if (slices > 0) {
+        multiget_slice_run(&parts[slices - 1]);
+    }
+    pthread_mutex_lock(&job.mutex);
+    while (job.pending > 0) {
+        pthread_cond_wait(&job.cond, &job.mutex);
+    }
+    pthread_mutex_unlock(&job.mutex);
+    pthread_cond_destroy(&job.cond);
+    pthread_mutex_destroy(&job.mutex);
 
-    leveldb_options_set_block_restart_interval(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        value);
+    if (snapshot != NULL) {
+        leveldb_readoptions_destroy(snapshot_options);
+        leveldb_release_snapshot(db, snapshot);
+    }
+    if (!job.error.empty()) {
+        msg = job.error;
+        return false;
+    }
+    encode_multiget(job.values, job.found, result);
+    return true;
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1compression
-  (JNIEnv *env, jobject obj, jlong options_ptr, jint value) {
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1readpool_1create
+  (JNIEnv *env, jobject obj, jint threads) {
 
-    if (options_ptr == 0) {
-        error(env, "LevelDB options handle is NULL");
-        return;
+    if (threads <= 0) {
+        error(env, "LevelDB read pool thread count must be positive");
+        return 0;
     }
 
-    leveldb_options_set_compression(
-        reinterpret_cast<leveldb_options_t*>(options_ptr),
-        value);
+    ReadPool *pool = new ReadPool();
+    pool->stopping = false;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    for (jint i = 0; i < threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, read_pool_main, pool) != 0) {
+            read_pool_stop(pool);
+            error(env, "LevelDB read pool thread could not be started");
+            return 0;
+        }
+        pool->threads.push_back(thread);
+    }
+    return reinterpret_cast<jlong>(pool);
 }
 
-JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1create
-  (JNIEnv *env, jobject obj) {
+/* Stops the pool threads. No parallel multi-get may be running on it. */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1readpool_1destroy
+  (JNIEnv *env, jobject obj, jlong pool_ptr) {
 
-    leveldb_readoptions_t* retval = leveldb_readoptions_create();
-    return reinterpret_cast<jlong>(retval);
+    if (pool_ptr == 0) {
+        error(env, "LevelDB read pool handle is NULL");
+        return;
+    }
+
+    read_pool_stop(reinterpret_cast<ReadPool*>(pool_ptr));
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1destroy
-  (JNIEnv *env, jobject obj, jlong readoptions_ptr) {
+/*
+ * leveldb_multiget spread over the pool in up to fanout slices; a fanout
+ * of 0 uses one slice per pool thread plus the calling thread.
+ */
+JNIEXPORT jbyteArray JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1multiget_1parallel
+  (JNIEnv *env, jobject obj, jlong pool_ptr, jlong leveldb_ptr, jlong readoptions_ptr,
+   jobjectArray keys, jint fanout) {
 
+    if (pool_ptr == 0) {
+        error(env, "LevelDB read pool handle is NULL");
+        return NULL;
+    }
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return NULL;
+    }
     if (readoptions_ptr == 0) {
         error(env, "LevelDB read options handle is NULL");
-        return;
+        return NULL;
+    }
+    if (keys == 0) {
+        error(env, "LevelDB key array is NULL");
+        return NULL;
     }
 
-    leveldb_readoptions_destroy(
-        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr));
+    std::vector<char> key_bytes;
+    std::vector<KeyRef> refs;
+    if (!gather_keys(env, keys, key_bytes, refs)) return NULL;
+
+    std::vector<char> result;
+    std::string msg;
+
+    if (!multiget_parallel(
+            reinterpret_cast<ReadPool*>(pool_ptr),
+            reinterpret_cast<leveldb_t*>(leveldb_ptr),
+            reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+            refs, fanout, result, msg)) {
+        status_error(env, msg.c_str());
+        return NULL;
+    }
+
+    jbyteArray retval = env->NewByteArray(result.size());
+    if (retval == NULL) return NULL;
+    if (!result.empty()) {
+        env->SetByteArrayRegion(retval, 0, result.size(), (const jbyte *)&result[0]);
+    }
+    return retval;
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1set_1verify_1checksums
-  (JNIEnv *env, jobject obj, jlong readoptions_ptr, jboolean value) {
+/* leveldb_multiget_direct spread over the pool, as leveldb_multiget_parallel. */
+JNIEXPORT jint JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1multiget_1parallel_1direct
+  (JNIEnv *env, jobject obj, jlong pool_ptr, jlong leveldb_ptr, jlong readoptions_ptr,
+   jobject keys, jint keys_offset, jint keys_length, jint count,
+   jobject result, jint result_offset, jint result_length, jint fanout) {
 
+    if (pool_ptr == 0) {
+        error(env, "LevelDB read pool handle is NULL");
+        return -1;
+    }
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return -1;
+    }
     if (readoptions_ptr == 0) {
         error(env, "LevelDB read options handle is NULL");
-        return;
+        return -1;
+    }
+    if (keys == 0) {
+        error(env, "LevelDB key buffer is NULL");
+        return -1;
+    }
+    if (result == 0) {
+        error(env, "LevelDB result buffer is NULL");
+        return -1;
     }
 
-    unsigned char native_bool = value ? 1 : 0;
+    const char *key_bytes = direct_address(env, keys, keys_offset, keys_length);
+    if (key_bytes == NULL) return -1;
+    char *result_bytes = direct_address(env, result, result_offset, result_length);
+    if (result_bytes == NULL) return -1;
 
-    leveldb_readoptions_set_verify_checksums(
-        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
-        native_bool);
-}
+    std::vector<KeyRef> refs;
+    const char *invalid = parse_packed_keys(key_bytes, keys_length, count, refs);
+    if (invalid != NULL) {
+        error(env, invalid);
+        return -1;
+    }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1set_1fill_1cache
-  (JNIEnv *env, jobject obj, jlong readoptions_ptr, jboolean value) {
+    std::vector<char> packed;
+    std::string msg;
 
-    if (readoptions_ptr == 0) {
-        error(env, "LevelDB read options handle is NULL");
-        return;
+    if (!multiget_parallel(
+            reinterpret_cast<ReadPool*>(pool_ptr),
+            reinterpret_cast<leveldb_t*>(leveldb_ptr),
+            reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
+            refs, fanout, packed, msg)) {
+        status_error(env, msg.c_str());
+        return -1;
     }
 
-    unsigned char native_bool = value ? 1 : 0;
+    if (packed.size() <= (size_t)result_length && !packed.empty()) {
+        memcpy(result_bytes, &packed[0], packed.size());
+    }
+    return (jint)packed.size();
+}
 
-    leveldb_readoptions_set_fill_cache(
-        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
-        native_bool);
+/*
+ * Prefetching scan. A range scan whose iterator runs on its own native
+ * thread, which packs entries into a ring of depth chunks of about
+ * chunk_size bytes while the caller consumes earlier ones. Block reads and
+ * decoding thus overlap with work on the Java side. The thread waits while
+ * the ring is full and stops once the scan is exhausted or the iterator
+ * fails; a failure is reported after the chunks packed before it have been
+ * consumed. An entry larger than chunk_size gets a chunk of its own.
+ */
+static const int PREFETCH_STAT_CHUNKS = 0;
+static const int PREFETCH_STAT_ENTRIES = 1;
+static const int PREFETCH_STAT_CONSUMER_WAITS = 2;
+static const int PREFETCH_STAT_PRODUCER_WAITS = 3;
+static const int PREFETCH_STAT_COUNT = 4;
+
+struct PrefetchChunk {
+    std::vector<char> bytes;
+    size_t used;
+    jint count;
+    bool last;
+};
+
+/*
+ * Chunks head .. head + filled - 1 (mod ring size) are ready for the
+ * caller; the thread packs only into the slot after them, so neither side
+ * holds the mutex while copying.
+ */
+struct PrefetchScan {
+    leveldb_iterator_t *iter;
+    std::string start;
+    std::string end;
+    ScanBounds bounds;
+    jlong remaining;
+    std::vector<PrefetchChunk> ring;
+    size_t head;
+    size_t filled;
+    bool done;
+    bool stopping;
+    char *errptr;
+    jlong stats[PREFETCH_STAT_COUNT];
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t filled_cond;
+    pthread_cond_t free_cond;
+};
+
+static void* prefetch_main(void *arg) {
+    PrefetchScan *scan = static_cast<PrefetchScan*>(arg);
+
+    scan_seek(scan->iter, &scan->bounds);
+
+    pthread_mutex_lock(&scan->mutex);
+    while (true) {
+        while (scan->filled == scan->ring.size() && !scan->stopping) {
+            scan->stats[PREFETCH_STAT_PRODUCER_WAITS]++;
+            pthread_cond_wait(&scan->free_cond, &scan->mutex);
+        }
+        if (scan->stopping) {
+            break;
+        }
+        PrefetchChunk &chunk = scan->ring[(scan->head + scan->filled) % scan->ring.size()];
+        pthread_mutex_unlock(&scan->mutex);
+
+        jint max_entries = 0x7fffffff;
+        if (scan->remaining >= 0 && scan->remaining < max_entries) {
+            max_entries = (jint)scan->remaining;
+        }
+        size_t pending_size = 0;
+        chunk.count = pack_iter_entries(scan->iter, &scan->bounds, &chunk.bytes[0], chunk.bytes.size(),
+                                        max_entries, &pending_size, &chunk.used);
+        if (chunk.count == 0 && pending_size > 0) {
+            chunk.bytes.resize(pending_size);
+            chunk.count = pack_iter_entries(scan->iter, &scan->bounds, &chunk.bytes[0], chunk.bytes.size(),
+                                            1, &pending_size, &chunk.used);
+        }
+        if (scan->remaining >= 0) {
+            scan->remaining -= chunk.count;
+        }
+        char *errptr = NULL;
+        leveldb_iter_get_error(scan->iter, &errptr);
+        chunk.last = errptr == NULL && (scan->remaining == 0 || !scan_valid(scan->iter, &scan->bounds));
+
+        pthread_mutex_lock(&scan->mutex);
+        scan->filled++;
+        scan->stats[PREFETCH_STAT_CHUNKS]++;
+        scan->stats[PREFETCH_STAT_ENTRIES] += chunk.count;
+        if (errptr != NULL) {
+            scan->errptr = errptr;
+        }
+        scan->done = errptr != NULL || chunk.last;
+        pthread_cond_signal(&scan->filled_cond);
+        if (scan->done) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&scan->mutex);
+    return NULL;
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1set_1snapshot
-  (JNIEnv *env, jobject obj, jlong readoptions_ptr, jlong snapshot_ptr) {
+/*
+ * Creates a prefetching scan over [start_key, end_key) in the given
+ * direction, returning at most limit entries in total (limit <= 0 for no
+ * limit). A NULL key leaves that side unbounded. The thread starts
+ * packing at once.
+ */
+JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1prefetch_1create
+  (JNIEnv *env, jobject obj, jlong leveldb_ptr, jlong readoptions_ptr,
+   jbyteArray start_key, jbyteArray end_key, jint limit, jboolean reverse,
+   jint chunk_size, jint depth) {
 
+    if (leveldb_ptr == 0) {
+        error(env, "LevelDB database handle is NULL");
+        return 0;
+    }
     if (readoptions_ptr == 0) {
         error(env, "LevelDB read options handle is NULL");
-        return;
+        return 0;
+    }
+    if (chunk_size <= 0) {
+        error(env, "LevelDB prefetch chunk size must be positive");
+        return 0;
+    }
+    if (depth <= 0) {
+        error(env, "LevelDB prefetch depth must be positive");
+        return 0;
     }
 
-    leveldb_readoptions_set_snapshot(
-        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr),
-        reinterpret_cast<const leveldb_snapshot_t*>(snapshot_ptr));
+    PrefetchScan *scan = new PrefetchScan();
+    if (start_key != NULL) {
+        copy_array(env, start_key, scan->start);
+    }
+    if (end_key != NULL) {
+        copy_array(env, end_key, scan->end);
+    }
+    scan->bounds.start = start_key != NULL ? scan->start.data() : NULL;
+    scan->bounds.start_length = scan->start.size();
+    scan->bounds.end = end_key != NULL ? scan->end.data() : NULL;
+    scan->bounds.end_length = scan->end.size();
+    scan->bounds.prefix = NULL;
+    scan->bounds.prefix_length = 0;
+    scan->bounds.reverse = reverse;
+    scan->remaining = limit > 0 ? limit : -1;
+
+    scan->ring.resize(depth);
+    for (jint i = 0; i < depth; i++) {
+        scan->ring[i].bytes.resize(chunk_size);
+        scan->ring[i].used = 0;
+        scan->ring[i].count = 0;
+        scan->ring[i].last = false;
+    }
+    scan->head = 0;
+    scan->filled = 0;
+    scan->done = false;
+    scan->stopping = false;
+    scan->errptr = NULL;
+    memset(scan->stats, 0, sizeof(scan->stats));
+    pthread_mutex_init(&scan->mutex, NULL);
+    pthread_cond_init(&scan->filled_cond, NULL);
+    pthread_cond_init(&scan->free_cond, NULL);
+
+    scan->iter = leveldb_create_iterator(
+        reinterpret_cast<leveldb_t*>(leveldb_ptr),
+        reinterpret_cast<leveldb_readoptions_t*>(readoptions_ptr));
+
+    if (pthread_create(&scan->thread, NULL, prefetch_main, scan) != 0) {
+        leveldb_iter_destroy(scan->iter);
+        pthread_cond_destroy(&scan->free_cond);
+        pthread_cond_destroy(&scan->filled_cond);
+        pthread_mutex_destroy(&scan->mutex);
+        delete scan;
+        error(env, "LevelDB prefetch thread could not be started");
+        return 0;
+    }
+    return reinterpret_cast<jlong>(scan);
 }
 
-JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writeoptions_1create
-  (JNIEnv *env, jobject obj) {
+/*
+ * Copies the next prefetched chunk into the direct buffer region, waiting
+ * for it if necessary, with the entry layout and return convention of
+ * leveldb_iter_next_batch. If the chunk does not fit, 0 is returned, the
+ * chunk is kept, and its size is written as a 32-bit int at the start of
+ * the region when there is room for it.
+ */
+JNIEXPORT jint JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1prefetch_1next
+  (JNIEnv *env, jobject obj, jlong prefetch_ptr, jobject buffer, jint offset, jint length) {
 
-    leveldb_writeoptions_t* retval = leveldb_writeoptions_create();
-    return reinterpret_cast<jlong>(retval);
+    if (prefetch_ptr == 0) {
+        error(env, "LevelDB prefetch handle is NULL");
+        return 0;
+    }
+    if (buffer == 0) {
+        error(env, "LevelDB result buffer is NULL");
+        return 0;
+    }
+
+    char *dst = direct_address(env, buffer, offset, length);
+    if (dst == NULL) return 0;
+
+    PrefetchScan *scan = reinterpret_cast<PrefetchScan*>(prefetch_ptr);
+
+    pthread_mutex_lock(&scan->mutex);
+    if (scan->filled == 0 && !scan->done) {
+        scan->stats[PREFETCH_STAT_CONSUMER_WAITS]++;
+        do {
+            pthread_cond_wait(&scan->filled_cond, &scan->mutex);
+        } while (scan->filled == 0 && !scan->done);
+    }
+    if (scan->filled == 0) {
+        std::string msg = scan->errptr != NULL ? scan->errptr : "";
+        pthread_mutex_unlock(&scan->mutex);
+        if (!msg.empty()) {
+            status_error(env, msg.c_str());
+            return 0;
+        }
+        return -1;
+    }
+    PrefetchChunk &chunk = scan->ring[scan->head];
+    pthread_mutex_unlock(&scan->mutex);
+
+    if (chunk.used > (size_t)length) {
+        if (length >= 4) {
+            encode_int32(dst, chunk.used);
+        }
+        return 0;
+    }
+    if (chunk.used > 0) {
+        memcpy(dst, &chunk.bytes[0], chunk.used);
+    }
+    jint count = chunk.count;
+    bool last = chunk.last;
+
+    pthread_mutex_lock(&scan->mutex);
+    scan->head = (scan->head + 1) % scan->ring.size();
+    scan->filled--;
+    pthread_cond_signal(&scan->free_cond);
+    pthread_mutex_unlock(&scan->mutex);
+
+    return last ? -(count + 1) : count;
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writeoptions_1destroy
-  (JNIEnv *env, jobject obj, jlong writeoptions_ptr) {
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1prefetch_1stats
+  (JNIEnv *env, jobject obj, jlong prefetch_ptr, jlongArray stats, jboolean reset) {
 
-    if (writeoptions_ptr == 0) {
-        error(env, "LevelDB write options handle is NULL");
+    if (prefetch_ptr == 0) {
+        error(env, "LevelDB prefetch handle is NULL");
+        return;
+    }
+    if (stats == 0) {
+        error(env, "LevelDB statistics array is NULL");
         return;
     }
 
-    leveldb_writeoptions_destroy(
-        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr));
+    PrefetchScan *scan = reinterpret_cast<PrefetchScan*>(prefetch_ptr);
+    jlong values[PREFETCH_STAT_COUNT];
+
+    pthread_mutex_lock(&scan->mutex);
+    memcpy(values, scan->stats, sizeof(values));
+    if (reset) {
+        memset(scan->stats, 0, sizeof(scan->stats));
+    }
+    pthread_mutex_unlock(&scan->mutex);
+
+    jsize count = std::min((jsize)PREFETCH_STAT_COUNT, env->GetArrayLength(stats));
+    env->SetLongArrayRegion(stats, 0, count, values);
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1writeoptions_1set_1sync
-  (JNIEnv *env, jobject obj, jlong writeoptions_ptr, jboolean value) {
+/* Stops the thread, discarding chunks not yet consumed. */
+JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1prefetch_1destroy
+  (JNIEnv *env, jobject obj, jlong prefetch_ptr) {
 
-    if (writeoptions_ptr == 0) {
-        error(env, "LevelDB write options handle is NULL");
+    if (prefetch_ptr == 0) {
+        error(env, "LevelDB prefetch handle is NULL");
         return;
     }
 
-    unsigned char native_bool = value ? 1 : 0;
+    PrefetchScan *scan = reinterpret_cast<PrefetchScan*>(prefetch_ptr);
 
-    leveldb_writeoptions_set_sync(
-        reinterpret_cast<leveldb_writeoptions_t*>(writeoptions_ptr),
-        native_bool);
-}
+    pthread_mutex_lock(&scan->mutex);
+    scan->stopping = true;
+    pthread_cond_signal(&scan->free_cond);
+    pthread_mutex_unlock(&scan->mutex);
+    pthread_join(scan->thread, NULL);
 
-JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1cache_1create_1lru
-  (JNIEnv *env, jobject obj, jlong capacity) {
+    leveldb_iter_destroy(scan->iter);
+    free(scan->errptr);
+    pthread_cond_destroy(&scan->free_cond);
+    pthread_cond_destroy(&scan->filled_cond);
+    pthread_mutex_destroy(&scan->mutex);
+    delete scan;
+}
 
-    leveldb_cache_t* retval = leveldb_cache_create_lru(capacity);
-    return reinterpret_cast<jlong>(retval);
+/*
+ * Natives are bound with RegisterNatives when the library loads rather than
+ * by symbol lookup on first call. Keep this table in step with the native
+ * declarations in NativeInterface.java.
+ */
+static JNINativeMethod native_methods[] = {
+    {(char*)"leveldb_open", (char*)"(JLjava/lang/String;)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1open},
+    {(char*)"leveldb_close", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1close},
+    {(char*)"leveldb_put", (char*)"(JJ[B[B)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1put},
+    {(char*)"leveldb_delete", (char*)"(JJ[B)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1delete},
+    {(char*)"leveldb_write", (char*)"(JJJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1write},
+    {(char*)"leveldb_write_packed", (char*)"(JJLjava/nio/ByteBuffer;II)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1write_1packed},
+    {(char*)"leveldb_get", (char*)"(JJ[B)[B",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1get},
+    {(char*)"leveldb_put_direct", (char*)"(JJLjava/nio/ByteBuffer;IILjava/nio/ByteBuffer;II)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1put_1direct},
+    {(char*)"leveldb_delete_direct", (char*)"(JJLjava/nio/ByteBuffer;II)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1delete_1direct},
+    {(char*)"leveldb_get_direct", (char*)"(JJLjava/nio/ByteBuffer;IILjava/nio/ByteBuffer;II)I",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1get_1direct},
+    {(char*)"leveldb_get_into", (char*)"(JJ[B[BI)I",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1get_1into},
+    {(char*)"leveldb_multiget", (char*)"(JJ[[B)[B",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1multiget},
+    {(char*)"leveldb_multiget_direct", (char*)"(JJLjava/nio/ByteBuffer;IIILjava/nio/ByteBuffer;II)I",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1multiget_1direct},
+    {(char*)"leveldb_readpool_create", (char*)"(I)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1readpool_1create},
+    {(char*)"leveldb_readpool_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1readpool_1destroy},
+    {(char*)"leveldb_multiget_parallel", (char*)"(JJJ[[BI)[B",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1multiget_1parallel},
+    {(char*)"leveldb_multiget_parallel_direct", (char*)"(JJJLjava/nio/ByteBuffer;IIILjava/nio/ByteBuffer;III)I",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1multiget_1parallel_1direct},
+    {(char*)"leveldb_create_iterator", (char*)"(JJ)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1create_1iterator},
+    {(char*)"leveldb_create_snapshot", (char*)"(J)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1create_1snapshot},
+    {(char*)"leveldb_release_snapshot", (char*)"(JJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1release_1snapshot},
+    {(char*)"leveldb_property_value", (char*)"(JLjava/lang/String;)Ljava/lang/String;",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1property_1value},
+    {(char*)"leveldb_destroy_db", (char*)"(JLjava/lang/String;)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1destroy_1db},
+    {(char*)"leveldb_repair_db", (char*)"(JLjava/lang/String;)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1repair_1db},
+    {(char*)"leveldb_iter_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1destroy},
+    {(char*)"leveldb_iter_valid", (char*)"(J)Z",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1valid},
+    {(char*)"leveldb_iter_seek_to_first", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1seek_1to_1first},
+    {(char*)"leveldb_iter_seek_to_last", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1seek_1to_1last},
+    {(char*)"leveldb_iter_seek", (char*)"(J[B)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1seek},
+    {(char*)"leveldb_iter_next", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1next},
+    {(char*)"leveldb_iter_prev", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1prev},
+    {(char*)"leveldb_iter_key", (char*)"(J)[B",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1key},
+    {(char*)"leveldb_iter_value", (char*)"(J)[B",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1value},
+    {(char*)"leveldb_iter_get_error", (char*)"(J)Ljava/lang/String;",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1get_1error},
+    {(char*)"leveldb_iter_next_batch", (char*)"(JLjava/nio/ByteBuffer;III)I",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1next_1batch},
+    {(char*)"leveldb_view_create", (char*)"()Ljava/nio/ByteBuffer;",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1view_1create},
+    {(char*)"leveldb_view_reset", (char*)"(Ljava/nio/ByteBuffer;)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1view_1reset},
+    {(char*)"leveldb_iter_move_views", (char*)"(JILjava/nio/ByteBuffer;Ljava/nio/ByteBuffer;)Z",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1iter_1move_1views},
+    {(char*)"leveldb_scan_create", (char*)"(JJ[B[BIZ)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1scan_1create},
+    {(char*)"leveldb_scan_create_prefix", (char*)"(JJ[BI)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1scan_1create_1prefix},
+    {(char*)"leveldb_scan_next_page", (char*)"(JLjava/nio/ByteBuffer;II)I",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1scan_1next_1page},
+    {(char*)"leveldb_scan_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1scan_1destroy},
+    {(char*)"leveldb_prefix_count", (char*)"(JJ[B)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1prefix_1count},
+    {(char*)"leveldb_writebatch_create", (char*)"()J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1create},
+    {(char*)"leveldb_writebatch_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1destroy},
+    {(char*)"leveldb_writebatch_clear", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1clear},
+    {(char*)"leveldb_writebatch_put", (char*)"(J[B[B)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1put},
+    {(char*)"leveldb_writebatch_delete", (char*)"(J[B)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1delete},
+    {(char*)"leveldb_writebatch_put_direct", (char*)"(JLjava/nio/ByteBuffer;IILjava/nio/ByteBuffer;II)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1put_1direct},
+    {(char*)"leveldb_writebatch_delete_direct", (char*)"(JLjava/nio/ByteBuffer;II)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1delete_1direct},
+    {(char*)"leveldb_writebatch_append_packed", (char*)"(JLjava/nio/ByteBuffer;II)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1append_1packed},
+    {(char*)"leveldb_writebatch_dump", (char*)"(J)[B",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1dump},
+    {(char*)"leveldb_writebatch_dump_into", (char*)"(JLjava/nio/ByteBuffer;II)I",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1dump_1into},
+    {(char*)"leveldb_writebatch_to_bytes", (char*)"(J)[B",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1to_1bytes},
+    {(char*)"leveldb_writebatch_to_buffer", (char*)"(JLjava/nio/ByteBuffer;II)I",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1to_1buffer},
+    {(char*)"leveldb_writebatch_from_bytes", (char*)"([B)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1from_1bytes},
+    {(char*)"leveldb_writebatch_from_buffer", (char*)"(Ljava/nio/ByteBuffer;II)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writebatch_1from_1buffer},
+    {(char*)"leveldb_options_create", (char*)"()J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1create},
+    {(char*)"leveldb_options_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1destroy},
+    {(char*)"leveldb_options_set_create_if_missing", (char*)"(JZ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1create_1if_1missing},
+    {(char*)"leveldb_options_set_error_if_exists", (char*)"(JZ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1error_1if_1exists},
+    {(char*)"leveldb_options_set_paranoid_checks", (char*)"(JZ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1paranoid_1checks},
+    {(char*)"leveldb_options_set_env", (char*)"(JJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1env},
+    {(char*)"leveldb_options_set_info_log", (char*)"(JJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1info_1log},
+    {(char*)"leveldb_options_set_write_buffer_size", (char*)"(JJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1write_1buffer_1size},
+    {(char*)"leveldb_options_set_max_open_files", (char*)"(JI)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1max_1open_1files},
+    {(char*)"leveldb_options_set_cache", (char*)"(JJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1cache},
+    {(char*)"leveldb_options_set_block_size", (char*)"(JJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1block_1size},
+    {(char*)"leveldb_options_set_block_restart_interval", (char*)"(JI)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1block_1restart_1interval},
+    {(char*)"leveldb_options_set_compression", (char*)"(JI)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1options_1set_1compression},
+    {(char*)"leveldb_readoptions_create", (char*)"()J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1create},
+    {(char*)"leveldb_readoptions_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1destroy},
+    {(char*)"leveldb_readoptions_set_verify_checksums", (char*)"(JZ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1set_1verify_1checksums},
+    {(char*)"leveldb_readoptions_set_fill_cache", (char*)"(JZ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1set_1fill_1cache},
+    {(char*)"leveldb_readoptions_set_snapshot", (char*)"(JJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1readoptions_1set_1snapshot},
+    {(char*)"leveldb_writeoptions_create", (char*)"()J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writeoptions_1create},
+    {(char*)"leveldb_writeoptions_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writeoptions_1destroy},
+    {(char*)"leveldb_writeoptions_set_sync", (char*)"(JZ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1writeoptions_1set_1sync},
+    {(char*)"leveldb_cache_create_lru", (char*)"(J)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1cache_1create_1lru},
+    {(char*)"leveldb_cache_create_scan_resistant", (char*)"(JI)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1cache_1create_1scan_1resistant},
+    {(char*)"leveldb_cache_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1cache_1destroy},
+    {(char*)"leveldb_cache_scan_resistant_stats", (char*)"(J[JZ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1cache_1scan_1resistant_1stats},
+    {(char*)"leveldb_create_default_env", (char*)"()J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1create_1default_1env},
+    {(char*)"leveldb_env_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1env_1destroy},
+    {(char*)"leveldb_group_commit_create", (char*)"(JJ)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1group_1commit_1create},
+    {(char*)"leveldb_group_commit_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1group_1commit_1destroy},
+    {(char*)"leveldb_group_commit_write", (char*)"(JJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1group_1commit_1write},
+    {(char*)"leveldb_group_commit_put", (char*)"(J[B[B)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1group_1commit_1put},
+    {(char*)"leveldb_group_commit_delete", (char*)"(J[B)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1group_1commit_1delete},
+    {(char*)"leveldb_async_writer_create", (char*)"(JJ)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1async_1writer_1create},
+    {(char*)"leveldb_async_writer_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1async_1writer_1destroy},
+    {(char*)"leveldb_async_submit", (char*)"(JJ)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1async_1submit},
+    {(char*)"leveldb_async_completed", (char*)"(J)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1async_1completed},
+    {(char*)"leveldb_async_await", (char*)"(JJJ)Z",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1async_1await},
+    {(char*)"leveldb_bulkload_create", (char*)"(Ljava/lang/String;J)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1bulkload_1create},
+    {(char*)"leveldb_bulkload_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1bulkload_1destroy},
+    {(char*)"leveldb_bulkload_add", (char*)"(J[B[B)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1bulkload_1add},
+    {(char*)"leveldb_bulkload_add_packed", (char*)"(JLjava/nio/ByteBuffer;II)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1bulkload_1add_1packed},
+    {(char*)"leveldb_bulkload_finish", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1bulkload_1finish},
+    {(char*)"leveldb_ingest_create", (char*)"(Ljava/lang/String;JI)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1ingest_1create},
+    {(char*)"leveldb_ingest_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1ingest_1destroy},
+    {(char*)"leveldb_ingest_add", (char*)"(J[B[B)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1ingest_1add},
+    {(char*)"leveldb_ingest_add_packed", (char*)"(JLjava/nio/ByteBuffer;II)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1ingest_1add_1packed},
+    {(char*)"leveldb_ingest_finish", (char*)"(JJJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1ingest_1finish},
+    {(char*)"leveldb_ingest_finish_bulkload", (char*)"(JJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1ingest_1finish_1bulkload},
+    {(char*)"leveldb_admission_create", (char*)"(JIJ)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1admission_1create},
+    {(char*)"leveldb_admission_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1admission_1destroy},
+    {(char*)"leveldb_admission_set_rate", (char*)"(JJJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1admission_1set_1rate},
+    {(char*)"leveldb_admission_level0_files", (char*)"(J)I",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1admission_1level0_1files},
+    {(char*)"leveldb_admission_would_stall", (char*)"(J)Z",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1admission_1would_1stall},
+    {(char*)"leveldb_admission_acquire", (char*)"(JJ)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1admission_1acquire},
+    {(char*)"leveldb_atomic_create", (char*)"(JJI)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1create},
+    {(char*)"leveldb_atomic_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1destroy},
+    {(char*)"leveldb_atomic_add_int64", (char*)"(J[BJ)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1add_1int64},
+    {(char*)"leveldb_atomic_max_int64", (char*)"(J[BJ)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1max_1int64},
+    {(char*)"leveldb_atomic_append", (char*)"(J[B[B)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1append},
+    {(char*)"leveldb_atomic_apply_packed", (char*)"(JLjava/nio/ByteBuffer;II)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1apply_1packed},
+    {(char*)"leveldb_atomic_compare_and_set", (char*)"(J[B[B[B)Z",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1compare_1and_1set},
+    {(char*)"leveldb_atomic_put_if_absent", (char*)"(J[B[B)Z",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1put_1if_1absent},
+    {(char*)"leveldb_atomic_delete_if_equals", (char*)"(J[B[B)Z",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1delete_1if_1equals},
+    {(char*)"leveldb_atomic_conditional_packed", (char*)"(JLjava/nio/ByteBuffer;IILjava/nio/ByteBuffer;II)I",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1atomic_1conditional_1packed},
+    {(char*)"leveldb_batcher_create", (char*)"(JJJIJ)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1batcher_1create},
+    {(char*)"leveldb_batcher_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1batcher_1destroy},
+    {(char*)"leveldb_batcher_put", (char*)"(J[B[B)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1batcher_1put},
+    {(char*)"leveldb_batcher_delete", (char*)"(J[B)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1batcher_1delete},
+    {(char*)"leveldb_batcher_flush", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1batcher_1flush},
+    {(char*)"leveldb_batcher_stats", (char*)"(J[JZ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1batcher_1stats},
+    {(char*)"leveldb_rowcache_create", (char*)"(JJI)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1rowcache_1create},
+    {(char*)"leveldb_rowcache_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1rowcache_1destroy},
+    {(char*)"leveldb_rowcache_stats", (char*)"(J[JZ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1rowcache_1stats},
+    {(char*)"leveldb_bloom_create", (char*)"(JJI)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1bloom_1create},
+    {(char*)"leveldb_bloom_load", (char*)"(JLjava/lang/String;)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1bloom_1load},
+    {(char*)"leveldb_bloom_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1bloom_1destroy},
+    {(char*)"leveldb_bloom_rebuild", (char*)"(JJ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1bloom_1rebuild},
+    {(char*)"leveldb_bloom_stats", (char*)"(J[JZ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1bloom_1stats},
+    {(char*)"leveldb_bloom_save", (char*)"(JLjava/lang/String;)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1bloom_1save},
+    {(char*)"leveldb_prefetch_create", (char*)"(JJ[B[BIZII)J",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1prefetch_1create},
+    {(char*)"leveldb_prefetch_next", (char*)"(JLjava/nio/ByteBuffer;II)I",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1prefetch_1next},
+    {(char*)"leveldb_prefetch_stats", (char*)"(J[JZ)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1prefetch_1stats},
+    {(char*)"leveldb_prefetch_destroy", (char*)"(J)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1prefetch_1destroy},
+    {(char*)"leveldb_set_marshalling", (char*)"(I)V",
+        (void*)Java_org_voltdb_leveldb_NativeInterface_leveldb_1set_1marshalling},
+};
+
+static jclass global_class(JNIEnv *env, const char *class_name) {
+    jclass local = env->FindClass(class_name);
+    if (local == NULL) {
+        return NULL;
+    }
+    jclass global = (jclass)env->NewGlobalRef(local);
+    env->DeleteLocalRef(local);
+    return global;
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1cache_1destroy
-  (JNIEnv *env, jobject obj, jlong cache_ptr) {
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
+    JNIEnv *env = NULL;
+    if (vm->GetEnv((void**)&env, JNI_VERSION_1_4) != JNI_OK) {
+        return JNI_ERR;
+    }
 
-    if (cache_ptr == 0) {
-        error(env, "LevelDB cache handle is NULL");
-        return;
+    runtime_exception_class = global_class(env, "java/lang/RuntimeException");
+    if (runtime_exception_class == NULL) {
+        return JNI_ERR;
+    }
+    for (size_t i = 0; i < status_exception_count; i++) {
+        status_exceptions[i].cls = global_class(env, status_exceptions[i].class_name);
+        if (status_exceptions[i].cls == NULL) {
+            return JNI_ERR;
+        }
     }
 
-    leveldb_cache_destroy(
-        reinterpret_cast<leveldb_cache_t*>(cache_ptr));
-}
+    init_view_fields(env);
 
-JNIEXPORT jlong JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1create_1default_1env
-  (JNIEnv *env, jobject obj) {
+    jclass cls = env->FindClass("org/voltdb/leveldb/NativeInterface");
+    if (cls == NULL) {
+        return JNI_ERR;
+    }
+    jint rc = env->RegisterNatives(cls, native_methods,
+        sizeof(native_methods) / sizeof(native_methods[0]));
+    env->DeleteLocalRef(cls);
+    if (rc != JNI_OK) {
+        // fall back to resolving the exported symbols by name
+        env->ExceptionClear();
+    }
 
-    leveldb_env_t* retval = leveldb_create_default_env();
-    return reinterpret_cast<jlong>(retval);
+    return JNI_VERSION_1_4;
 }
 
-JNIEXPORT void JNICALL Java_org_voltdb_leveldb_NativeInterface_leveldb_1env_1destroy
-  (JNIEnv *env, jobject obj, jlong env_ptr) {
-
-    if (env_ptr == 0) {
-        error(env, "LevelDB env handle is NULL");
+JNIEXPORT void JNICALL JNI_OnUnload(JavaVM *vm, void *reserved) {
+    JNIEnv *env = NULL;
+    if (vm->GetEnv((void**)&env, JNI_VERSION_1_4) != JNI_OK) {
         return;
     }
 
-    leveldb_env_destroy(
-        reinterpret_cast<leveldb_env_t*>(env_ptr));
+    if (runtime_exception_class != NULL) {
+        env->DeleteGlobalRef(runtime_exception_class);
+        runtime_exception_class = NULL;
+    }
+    for (size_t i = 0; i < status_exception_count; i++) {
+        if (status_exceptions[i].cls != NULL) {
+            env->DeleteGlobalRef(status_exceptions[i].cls);
+            status_exceptions[i].cls = NULL;
+        }
+    }
 }
@@ -0,0 +1,112 @@
+/* Copyright (C) 2008-2011 VoltDB Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+package org.voltdb.leveldb;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Walks a LevelDB iterator exposing the current key and value as read-only
+ * views over the iterator's own memory. Each move is a single native call and
+ * nothing is copied or allocated per entry; the same two ByteBuffers are
+ * re-pointed at every entry.
+ *
+ * The views are only valid until the cursor moves again, or the iterator is
+ * destroyed. Callers that need to keep the bytes must copy them out first.
+ * A move that leaves the iterator invalid empties the views, and so does
+ * close, which must be called before the iterator is destroyed; reads
+ * through an empty view throw rather than touch freed memory.
+ */
+public class Cursor {
+
+    private final NativeInterface ni;
+    private final long iterator;
+    private final ByteBuffer key;
+    private final ByteBuffer value;
+    private boolean valid = false;
+    private boolean closed = false;
+
+    /** Wraps an iterator from leveldb_create_iterator; the caller still destroys it. */
+    public Cursor(NativeInterface ni, long iterator) {
+        this.ni = ni;
+        this.iterator = iterator;
+        this.key = ni.leveldb_view_create().asReadOnlyBuffer();
+        this.value = ni.leveldb_view_create().asReadOnlyBuffer();
+    }
+
+    public boolean seekToFirst() {
+        return move(NativeInterface.leveldb_iter_move_first);
+    }
+
+    public boolean seekToLast() {
+        return move(NativeInterface.leveldb_iter_move_last);
+    }
+
+    public boolean seek(byte[] target) {
+        if (closed) {
+            throw new IllegalStateException("Cursor is closed");
+        }
+        ni.leveldb_iter_seek(iterator, target);
+        return move(NativeInterface.leveldb_iter_move_none);
+    }
+
+    public boolean next() {
+        return move(NativeInterface.leveldb_iter_move_next);
+    }
+
+    public boolean prev() {
+        return move(NativeInterface.leveldb_iter_move_prev);
+    }
+
+    public boolean isValid() {
+        return valid;
+    }
+
+    /** The current key, valid until the next move. */
+    public ByteBuffer key() {
+        return key;
+    }
+
+    /** The current value, valid until the next move. */
+    public ByteBuffer value() {
+        return value;
+    }
+
+    /** Empties the views and detaches the cursor from its iterator. */
+    public void close() {
+        if (closed) {
+            return;
+        }
+        closed = true;
+        valid = false;
+        ni.leveldb_view_reset(key);
+        ni.leveldb_view_reset(value);
+    }
+
+    private boolean move(int move) {
+        if (closed) {
+            throw new IllegalStateException("Cursor is closed");
+        }
+        valid = ni.leveldb_iter_move_views(iterator, move, key, value);
+        return valid;
+    }
+}
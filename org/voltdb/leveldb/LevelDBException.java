@@ -0,0 +1,75 @@
+/* Copyright (C) 2008-2011 VoltDB Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+package org.voltdb.leveldb;
+
+/**
+ * Thrown when a LevelDB operation fails with a status. The subclasses match
+ * the status codes LevelDB reports; the message is the full status string.
+ */
+public class LevelDBException extends RuntimeException {
+    private static final long serialVersionUID = 1L;
+
+    public LevelDBException(String message) {
+        super(message);
+    }
+
+    public static class NotFound extends LevelDBException {
+        private static final long serialVersionUID = 1L;
+
+        public NotFound(String message) {
+            super(message);
+        }
+    }
+
+    public static class Corruption extends LevelDBException {
+        private static final long serialVersionUID = 1L;
+
+        public Corruption(String message) {
+            super(message);
+        }
+    }
+
+    public static class NotSupported extends LevelDBException {
+        private static final long serialVersionUID = 1L;
+
+        public NotSupported(String message) {
+            super(message);
+        }
+    }
+
+    public static class InvalidArgument extends LevelDBException {
+        private static final long serialVersionUID = 1L;
+
+        public InvalidArgument(String message) {
+            super(message);
+        }
+    }
+
+    public static class IOError extends LevelDBException {
+        private static final long serialVersionUID = 1L;
+
+        public IOError(String message) {
+            super(message);
+        }
+    }
+}
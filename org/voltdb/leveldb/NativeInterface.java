@@ -22,6 +22,8 @@
 
 package org.voltdb.leveldb;
 
+import java.nio.ByteBuffer;
+
 public class NativeInterface {
 
     public NativeInterface() {
@@ -33,8 +35,58 @@ public class NativeInterface {
     native void leveldb_put(long db, long options, byte[] key, byte[] value);
     native void leveldb_delete(long db, long options, byte[] key);
     native void leveldb_write(long db, long options, long batch);
+    /* Applies the operations encoded by a WriteBatchBuffer in one write. */
+    native void leveldb_write_packed(long db, long options, ByteBuffer ops, int offset, int length);
     native byte[] leveldb_get(long db, long options, byte[] key);
 
+    /* Direct ByteBuffer variants. Keys and values are read from (and written
+       into) [offset, offset + length) of the buffer's native memory without a
+       copy through the Java heap. The buffers must be allocated direct. */
+
+    native void leveldb_put_direct(long db, long options,
+            ByteBuffer key, int keyoffset, int keylen,
+            ByteBuffer value, int valueoffset, int valuelen);
+    native void leveldb_delete_direct(long db, long options,
+            ByteBuffer key, int keyoffset, int keylen);
+    /* Returns the value length, or -1 if the key is not found. Nothing is
+       copied if the value is longer than valuelen. */
+    native int leveldb_get_direct(long db, long options,
+            ByteBuffer key, int keyoffset, int keylen,
+            ByteBuffer value, int valueoffset, int valuelen);
+
+    /* Copies the value into value[offset..] and returns its length, or -1 if
+       the key is not found. If the value does not fit nothing is copied and
+       the returned length tells the caller how much space to provide. */
+    native int leveldb_get_into(long db, long options, byte[] key, byte[] value, int offset);
+
+    /* Multi-get. All keys are looked up in one call through a single forward
+       iterator pass. The result holds one entry per key, in request order: a
+       flag byte (1 if found), then for found keys a big-endian int length and
+       the value bytes. */
+
+    native byte[] leveldb_multiget(long db, long options, byte[][] keys);
+    /* keys holds count entries of a big-endian int length and the key bytes.
+       Returns the encoded result length; nothing is copied if it exceeds
+       resultlen. */
+    native int leveldb_multiget_direct(long db, long options,
+            ByteBuffer keys, int keysoffset, int keyslen, int count,
+            ByteBuffer result, int resultoffset, int resultlen);
+
+    /* Parallel multi-get. The keys are split into up to fanout slices that
+       are looked up at once on a pool of native threads and the calling
+       thread; a fanout of 0 uses every pool thread. All slices read under
+       the snapshot of options, or one taken for the call if it has none.
+       Results are encoded as for leveldb_multiget. Useful when the keys are
+       not cached and the disks serve concurrent random reads well. */
+
+    native long leveldb_readpool_create(int threads);
+    /* No parallel multi-get may be running on the pool. */
+    native void leveldb_readpool_destroy(long pool);
+    native byte[] leveldb_multiget_parallel(long pool, long db, long options, byte[][] keys, int fanout);
+    native int leveldb_multiget_parallel_direct(long pool, long db, long options,
+            ByteBuffer keys, int keysoffset, int keyslen, int count,
+            ByteBuffer result, int resultoffset, int resultlen, int fanout);
+
     native long leveldb_create_iterator(long db, long options);
     native long leveldb_create_snapshot(long db);
     native void leveldb_release_snapshot(long db, long snapshot);
@@ -51,13 +103,54 @@ public class NativeInterface {
     native boolean leveldb_iter_valid(long iterator);
     native void leveldb_iter_seek_to_first(long iterator);
     native void leveldb_iter_seek_to_last(long iterator);
-    native void leveldb_iter_seek(long iterator, String k, long klen);
+    native void leveldb_iter_seek(long iterator, byte[] key);
     native void leveldb_iter_next(long iterator);
     native void leveldb_iter_prev(long iterator);
     native byte[] leveldb_iter_key(long iterator);
     native byte[] leveldb_iter_value(long iterator);
     native String leveldb_iter_get_error(long iterator);
 
+    /* Packs up to maxentries entries from the current position into
+       buffer[offset, offset + length), each as a big-endian int key length,
+       the key, an int value length and the value, and advances the iterator
+       past them. Returns the number of entries packed, or -(count + 1) once
+       the iterator is exhausted. Returns 0 if the current entry alone does
+       not fit, with its encoded size stored as an int at offset when the
+       buffer has room for it. Throws a LevelDBException if the iterator
+       stopped on an error such as a corrupt block. */
+    native int leveldb_iter_next_batch(long iterator, ByteBuffer buffer, int offset, int length,
+            int maxentries);
+
+    /* Views are direct ByteBuffers that leveldb_iter_move_views re-points at
+       the iterator's current key and value without copying or allocating.
+       A view is valid until the iterator next moves; reset empties it, so
+       reads throw. See Cursor. */
+
+    static final int leveldb_iter_move_none = 0;
+    static final int leveldb_iter_move_next = 1;
+    static final int leveldb_iter_move_prev = 2;
+    static final int leveldb_iter_move_first = 3;
+    static final int leveldb_iter_move_last = 4;
+    native ByteBuffer leveldb_view_create();
+    native void leveldb_view_reset(ByteBuffer view);
+    native boolean leveldb_iter_move_views(long iterator, int move, ByteBuffer keyview, ByteBuffer valueview);
+
+    /* Range scan */
+
+    /* Scans [startkey, endkey) forwards, or backwards if reverse is set,
+       returning at most limit entries (limit <= 0 for no limit). A null key
+       leaves that side of the range open. */
+    native long leveldb_scan_create(long db, long options, byte[] startkey, byte[] endkey,
+            int limit, boolean reverse);
+    /* Scans the keys starting with prefix, returning at most limit entries. */
+    native long leveldb_scan_create_prefix(long db, long options, byte[] prefix, int limit);
+    /* Packs the next page of the scan as leveldb_iter_next_batch does. */
+    native int leveldb_scan_next_page(long scan, ByteBuffer buffer, int offset, int length);
+    native void leveldb_scan_destroy(long scan);
+
+    /* Counts the keys starting with prefix without copying them to Java. */
+    native long leveldb_prefix_count(long db, long options, byte[] prefix);
+
     /* Write batch */
 
     native long leveldb_writebatch_create();
@@ -65,6 +158,28 @@ public class NativeInterface {
     native void leveldb_writebatch_clear(long writebatch);
     native void leveldb_writebatch_put(long writebatch, byte[] key, byte[] val);
     native void leveldb_writebatch_delete(long writebatch, byte[] key);
+    native void leveldb_writebatch_put_direct(long writebatch,
+            ByteBuffer key, int keyoffset, int keylen,
+            ByteBuffer value, int valueoffset, int valuelen);
+    native void leveldb_writebatch_delete_direct(long writebatch,
+            ByteBuffer key, int keyoffset, int keylen);
+    /* Appends the operations encoded by a WriteBatchBuffer to writebatch,
+     * or none of them if the buffer is malformed. */
+    native void leveldb_writebatch_append_packed(long writebatch, ByteBuffer ops, int offset, int length);
+    /* leveldb_writebatch_iterate as a single call: the operations in the
+       packed format written by WriteBatchBuffer. dump_into returns the size
+       and writes nothing if it does not fit. */
+    native byte[] leveldb_writebatch_dump(long writebatch);
+    native int leveldb_writebatch_dump_into(long writebatch, ByteBuffer buffer, int offset, int length);
+    /* The native batch encoding, for shipping a batch to a replica that
+       applies it with one leveldb_write. to_buffer returns the encoded size
+       and writes nothing if it does not fit. from_bytes and from_buffer
+       create a new batch and throw LevelDBException.Corruption if the
+       encoding is malformed. */
+    native byte[] leveldb_writebatch_to_bytes(long writebatch);
+    native int leveldb_writebatch_to_buffer(long writebatch, ByteBuffer buffer, int offset, int length);
+    native long leveldb_writebatch_from_bytes(byte[] rep);
+    native long leveldb_writebatch_from_buffer(ByteBuffer buffer, int offset, int length);
 
     /* Options */
 
@@ -102,10 +217,245 @@ public class NativeInterface {
     /* Cache */
 
     native long leveldb_cache_create_lru(long capacity);
+    /* A sharded 2Q cache: blocks read once pass through a small FIFO, so a
+       full scan does not evict blocks that are read repeatedly. Its stats
+       fill an array indexed by the leveldb_cache_stat_ constants. */
+    native long leveldb_cache_create_scan_resistant(long capacity, int shards);
     native void leveldb_cache_destroy(long cache);
 
+    static final int leveldb_cache_stat_hits = 0;
+    static final int leveldb_cache_stat_misses = 1;
+    static final int leveldb_cache_stat_inserts = 2;
+    static final int leveldb_cache_stat_promotions = 3;
+    static final int leveldb_cache_stat_evictions = 4;
+    static final int leveldb_cache_stat_entries = 5;
+    static final int leveldb_cache_stat_bytes = 6;
+    static final int leveldb_cache_stat_capacity = 7;
+    static final int leveldb_cache_stat_count = 8;
+
+    native void leveldb_cache_scan_resistant_stats(long cache, long[] stats, boolean reset);
+
     /* Env */
 
     native long leveldb_create_default_env();
     native void leveldb_env_destroy(long env);
+
+    /* Group commit. Concurrent writers through one committer are merged into
+       shared leveldb_write calls, so synchronous writers share fsyncs. Each
+       call returns once its own writes are durable. */
+
+    native long leveldb_group_commit_create(long db, long writeoptions);
+    native void leveldb_group_commit_destroy(long groupcommit);
+    native void leveldb_group_commit_write(long groupcommit, long writebatch);
+    native void leveldb_group_commit_put(long groupcommit, byte[] key, byte[] value);
+    native void leveldb_group_commit_delete(long groupcommit, byte[] key);
+
+    /* Asynchronous writes. Submitted batches are applied in order by a native
+       writer thread; submit returns a ticket at once and the writer owns and
+       destroys the batch. Tickets are consecutive, so completed() >= N means
+       every batch up to N is written. After a failed write the writer
+       discards later batches, await reports the failure and submit throws
+       it, still destroying the batch it was given. */
+
+    native long leveldb_async_writer_create(long db, long writeoptions);
+    native void leveldb_async_writer_destroy(long asyncwriter);
+    native long leveldb_async_submit(long asyncwriter, long writebatch);
+    native long leveldb_async_completed(long asyncwriter);
+    /* Returns false if timeoutmillis (negative for no limit) passes first. */
+    native boolean leveldb_async_await(long asyncwriter, long ticket, long timeoutmillis);
+
+    /* Sorted bulk load into a new database. Keys must be strictly increasing
+       and are written straight into table files of about filesize bytes at
+       the bottom level, bypassing the log, the memtable and compactions.
+       After finish the database can be opened with leveldb_open; destroying
+       an unfinished load removes its files. add_packed takes entries laid
+       out as leveldb_iter_next_batch writes them. Only the default
+       comparator is supported and tables are written uncompressed. */
+
+    native long leveldb_bulkload_create(String name, long filesize);
+    native void leveldb_bulkload_destroy(long bulkload);
+    native void leveldb_bulkload_add(long bulkload, byte[] key, byte[] value);
+    native void leveldb_bulkload_add_packed(long bulkload, ByteBuffer entries, int offset, int length);
+    native void leveldb_bulkload_finish(long bulkload);
+
+    /* External-sort ingestion of unsorted entries. Entries are gathered into
+       runs that threads workers sort and spill to tmpdir, keeping about
+       memorylimit bytes in memory. finish merges the runs into db through
+       large writes; finish_bulkload feeds them to a bulk load instead. The
+       merge stays within memorylimit and reads at most 64 runs at once,
+       merging them in groups first when there are more. When
+       a key is added more than once the last value wins. add_packed takes
+       entries laid out as leveldb_iter_next_batch writes them. */
+
+    native long leveldb_ingest_create(String tmpdir, long memorylimit, int threads);
+    native void leveldb_ingest_destroy(long ingest);
+    native void leveldb_ingest_add(long ingest, byte[] key, byte[] value);
+    native void leveldb_ingest_add_packed(long ingest, ByteBuffer entries, int offset, int length);
+    native void leveldb_ingest_finish(long ingest, long db, long writeoptions);
+    native void leveldb_ingest_finish_bulkload(long ingest, long bulkload);
+
+    /* Write admission control. The level-0 file count is polled at most every
+       pollmillis. would_stall reports, without blocking, whether leveldb
+       would delay a write now. With a rate set, acquire meters written bytes
+       through a token bucket whose rate shrinks linearly from throttlefiles
+       level-0 files to zero at leveldb's stop trigger, and returns the
+       microseconds it waited. */
+
+    native long leveldb_admission_create(long db, int throttlefiles, long pollmillis);
+    native void leveldb_admission_destroy(long admission);
+    native void leveldb_admission_set_rate(long admission, long bytespersecond, long burstbytes);
+    native int leveldb_admission_level0_files(long admission);
+    native boolean leveldb_admission_would_stall(long admission);
+    native long leveldb_admission_acquire(long admission, long bytes);
+
+    /* Atomic read-modify-write. Operations through one atomic handle are
+       serialized per key by a striped lock table and applied with one
+       read and one write; writes that bypass the handle are not serialized
+       with them. Counters are 8-byte big-endian longs and a missing key
+       counts as 0. add_int64 and max_int64 return the new value. */
+
+    static final int leveldb_atomic_add = 0;
+    static final int leveldb_atomic_append = 1;
+    static final int leveldb_atomic_max = 2;
+
+    native long leveldb_atomic_create(long db, long writeoptions, int stripes);
+    native void leveldb_atomic_destroy(long atomic);
+    native long leveldb_atomic_add_int64(long atomic, byte[] key, long delta);
+    native long leveldb_atomic_max_int64(long atomic, byte[] key, long value);
+    native void leveldb_atomic_append(long atomic, byte[] key, byte[] bytes);
+    /* Applies packed operations, each a tag byte, an int key length and the
+       key, and an int operand length and the operand, as a single write.
+       If any operation fails nothing is written. */
+    native void leveldb_atomic_apply_packed(long atomic, ByteBuffer ops, int offset, int length);
+
+    /* Conditional writes through the same atomic handle and lock stripes.
+       Each returns whether it was applied. */
+
+    static final int leveldb_atomic_compare_and_set = 3;
+    static final int leveldb_atomic_put_if_absent = 4;
+    static final int leveldb_atomic_delete_if_equals = 5;
+
+    native boolean leveldb_atomic_compare_and_set(long atomic, byte[] key, byte[] expected, byte[] value);
+    native boolean leveldb_atomic_put_if_absent(long atomic, byte[] key, byte[] value);
+    native boolean leveldb_atomic_delete_if_equals(long atomic, byte[] key, byte[] expected);
+    /* Applies packed conditional operations in order and writes the ones
+       that held as a single write. Each is a tag byte followed by int
+       length-prefixed fields: the key, the expected value (except for
+       put_if_absent) and the new value (except for delete_if_equals). One
+       byte per operation, 1 if applied, goes to results[resultsoffset..].
+       Returns the number applied. */
+    native int leveldb_atomic_conditional_packed(long atomic, ByteBuffer ops, int offset, int length,
+            ByteBuffer results, int resultsoffset, int resultslength);
+
+    /* Auto-flushing batcher. Puts and deletes are written with leveldb_write
+       once maxbytes or maxops is reached, or maxdelaymillis after the first
+       pending operation; 0 leaves a bound unset. Writes run without blocking
+       callers that keep adding. A failed flush keeps its operations, to be
+       retried by the next flush, and is thrown by the next call; destroy
+       reports how many could not be written. stats fills an array indexed
+       by the leveldb_batcher_stat_ constants; latencies are in microseconds
+       and the percentiles are rounded up to a power of two. */
+
+    static final int leveldb_batcher_stat_flushes = 0;
+    static final int leveldb_batcher_stat_ops = 1;
+    static final int leveldb_batcher_stat_bytes = 2;
+    static final int leveldb_batcher_stat_total_micros = 3;
+    static final int leveldb_batcher_stat_max_micros = 4;
+    static final int leveldb_batcher_stat_p50_micros = 5;
+    static final int leveldb_batcher_stat_p99_micros = 6;
+    static final int leveldb_batcher_stat_count = 7;
+
+    native long leveldb_batcher_create(long db, long writeoptions, long maxbytes, int maxops,
+            long maxdelaymillis);
+    /* Flushes what is pending before freeing the batcher. */
+    native void leveldb_batcher_destroy(long batcher);
+    native void leveldb_batcher_put(long batcher, byte[] key, byte[] value);
+    native void leveldb_batcher_delete(long batcher, byte[] key);
+    native void leveldb_batcher_flush(long batcher);
+    native void leveldb_batcher_stats(long batcher, long[] stats, boolean reset);
+
+    /* Row cache. Caches values of point reads (get, get_direct, get_into)
+       of one database in a sharded LRU of at most capacity bytes. Writes
+       through this library drop the keys they wrote, and reads under a
+       snapshot bypass the cache. Attach it before the database is shared
+       between threads; closing the database detaches it. stats fills an
+       array indexed by the leveldb_rowcache_stat_ constants. */
+
+    static final int leveldb_rowcache_stat_hits = 0;
+    static final int leveldb_rowcache_stat_misses = 1;
+    static final int leveldb_rowcache_stat_bypasses = 2;
+    static final int leveldb_rowcache_stat_inserts = 3;
+    static final int leveldb_rowcache_stat_evictions = 4;
+    static final int leveldb_rowcache_stat_invalidations = 5;
+    static final int leveldb_rowcache_stat_entries = 6;
+    static final int leveldb_rowcache_stat_bytes = 7;
+    static final int leveldb_rowcache_stat_capacity = 8;
+    static final int leveldb_rowcache_stat_count = 9;
+
+    native long leveldb_rowcache_create(long db, long capacity, int shards);
+    native void leveldb_rowcache_destroy(long rowcache);
+    native void leveldb_rowcache_stats(long rowcache, long[] stats, boolean reset);
+
+    /* Bloom filter. Lets get, get_direct, get_into and the multi-gets of one
+       database answer keys that were never written without reading any
+       table. Writes through this library add their keys; deleted keys stay
+       until leveldb_bloom_rebuild, which callers run periodically (the
+       deletes statistic says how many have built up). Reads under a
+       snapshot bypass the filter. create and rebuild scan the latest state
+       of the database, taking only verify_checksums from readoptions; load
+       attaches one saved by leveldb_bloom_save, which is only valid if the
+       database has not been written since, and deletes the file so a crash
+       cannot leave a stale one behind. Save again before closing. stats
+       fills an array indexed by the leveldb_bloom_stat_ constants. */
+
+    static final int leveldb_bloom_stat_negatives = 0;
+    static final int leveldb_bloom_stat_passes = 1;
+    static final int leveldb_bloom_stat_false_positives = 2;
+    static final int leveldb_bloom_stat_keys = 3;
+    static final int leveldb_bloom_stat_deletes = 4;
+    static final int leveldb_bloom_stat_rebuilds = 5;
+    static final int leveldb_bloom_stat_bits = 6;
+    static final int leveldb_bloom_stat_count = 7;
+
+    native long leveldb_bloom_create(long db, long readoptions, int bitsperkey);
+    native long leveldb_bloom_load(long db, String name);
+    native void leveldb_bloom_destroy(long bloom);
+    native void leveldb_bloom_rebuild(long bloom, long readoptions);
+    native void leveldb_bloom_stats(long bloom, long[] stats, boolean reset);
+    native void leveldb_bloom_save(long bloom, String name);
+
+    /* Prefetching scan. A range scan, as leveldb_scan_create, whose iterator
+       runs on a native thread that packs up to depth chunks of about
+       chunksize bytes ahead of the caller, so reading and decoding blocks
+       overlaps with processing the previous chunk. next copies one chunk
+       into buffer[offset, offset + length) and returns as
+       leveldb_iter_next_batch does; a buffer of chunksize bytes holds any
+       chunk except one made of a single larger entry. An iterator error is
+       thrown once the chunks before it have been read. stats fills an array
+       indexed by the leveldb_prefetch_stat_ constants; many consumer waits
+       mean the scan cannot keep up, many producer waits that the caller
+       cannot. */
+
+    static final int leveldb_prefetch_stat_chunks = 0;
+    static final int leveldb_prefetch_stat_entries = 1;
+    static final int leveldb_prefetch_stat_consumer_waits = 2;
+    static final int leveldb_prefetch_stat_producer_waits = 3;
+    static final int leveldb_prefetch_stat_count = 4;
+
+    native long leveldb_prefetch_create(long db, long options, byte[] startkey, byte[] endkey,
+            int limit, boolean reverse, int chunksize, int depth);
+    native int leveldb_prefetch_next(long prefetch, ByteBuffer buffer, int offset, int length);
+    native void leveldb_prefetch_stats(long prefetch, long[] stats, boolean reset);
+    native void leveldb_prefetch_destroy(long prefetch);
+
+    /* Marshalling. Selects how byte[] keys and values are read by the
+       natives. The default copies small arrays into per-thread scratch memory
+       and reads large ones in place for bounded operations. The others force
+       one strategy for every call and exist for benchmarking. */
+
+    static final int leveldb_marshal_auto = 0;
+    static final int leveldb_marshal_copy = 1;
+    static final int leveldb_marshal_critical = 2;
+    static final int leveldb_marshal_elements = 3;
+    native void leveldb_set_marshalling(int strategy);
 }
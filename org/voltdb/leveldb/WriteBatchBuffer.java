@@ -0,0 +1,107 @@
+/* Copyright (C) 2008-2011 VoltDB Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+package org.voltdb.leveldb;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Accumulates puts and deletes in a direct ByteBuffer so a whole batch can be
+ * handed to LevelDB in a single native call, instead of one call per
+ * leveldb_writebatch_put / leveldb_writebatch_delete.
+ *
+ * Each operation is encoded as a tag byte, a big-endian int key length and
+ * the key, and for puts a big-endian int value length and the value.
+ */
+public class WriteBatchBuffer {
+
+    static final byte OP_DELETE = 0;
+    static final byte OP_PUT = 1;
+
+    private ByteBuffer buffer;
+    private int count = 0;
+
+    public WriteBatchBuffer() {
+        this(4096);
+    }
+
+    public WriteBatchBuffer(int initialCapacity) {
+        buffer = ByteBuffer.allocateDirect(Math.max(initialCapacity, 16));
+    }
+
+    public void put(byte[] key, byte[] value) {
+        ensureRemaining(9 + key.length + value.length);
+        buffer.put(OP_PUT);
+        buffer.putInt(key.length);
+        buffer.put(key);
+        buffer.putInt(value.length);
+        buffer.put(value);
+        count++;
+    }
+
+    public void delete(byte[] key) {
+        ensureRemaining(5 + key.length);
+        buffer.put(OP_DELETE);
+        buffer.putInt(key.length);
+        buffer.put(key);
+        count++;
+    }
+
+    public void clear() {
+        buffer.clear();
+        count = 0;
+    }
+
+    /** Number of operations in the batch. */
+    public int count() {
+        return count;
+    }
+
+    /** Encoded size of the batch in bytes. */
+    public int size() {
+        return buffer.position();
+    }
+
+    /** Atomically applies the batch to db with a single native call. */
+    public void write(NativeInterface ni, long db, long writeoptions) {
+        ni.leveldb_write_packed(db, writeoptions, buffer, 0, buffer.position());
+    }
+
+    /** Appends the batch to a native leveldb_writebatch_t. */
+    public void appendTo(NativeInterface ni, long writebatch) {
+        ni.leveldb_writebatch_append_packed(writebatch, buffer, 0, buffer.position());
+    }
+
+    private void ensureRemaining(int needed) {
+        if (buffer.remaining() >= needed) {
+            return;
+        }
+        int capacity = buffer.capacity();
+        while (capacity - buffer.position() < needed) {
+            capacity *= 2;
+        }
+        ByteBuffer grown = ByteBuffer.allocateDirect(capacity);
+        buffer.flip();
+        grown.put(buffer);
+        buffer = grown;
+    }
+}
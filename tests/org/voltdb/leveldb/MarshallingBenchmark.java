@@ -0,0 +1,151 @@
+/* Copyright (C) 2008-2011 VoltDB Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+package org.voltdb.leveldb;
+
+import java.io.BufferedReader;
+import java.io.FileReader;
+import java.io.IOException;
+import java.lang.management.GarbageCollectorMXBean;
+import java.lang.management.ManagementFactory;
+import java.util.Random;
+
+/**
+ * Compares the byte[] marshalling strategies of the native layer. For each
+ * strategy it runs puts and gets of small and large values from several
+ * threads and reports throughput, growth of the process RSS and the time
+ * and number of collections the JVM spent in GC meanwhile.
+ *
+ * Run with "make bench".
+ */
+public class MarshallingBenchmark {
+
+    static final String[] STRATEGY_NAMES = new String[] { "auto", "copy", "critical", "elements" };
+
+    static final int THREADS = 4;
+    static final int OPS_PER_THREAD = 50000;
+
+    public static void main(String[] args) throws Exception {
+        NativeInterface ni = new NativeInterface();
+
+        System.out.printf("%-10s %-7s %12s %12s %10s %8s%n",
+                "strategy", "value", "ops/sec", "rss delta kb", "gc ms", "gc count");
+        for (int strategy = 0; strategy < STRATEGY_NAMES.length; strategy++) {
+            for (int valueSize : new int[] { 100, 64 * 1024 }) {
+                run(ni, strategy, valueSize);
+            }
+        }
+        ni.leveldb_set_marshalling(NativeInterface.leveldb_marshal_auto);
+    }
+
+    static void run(final NativeInterface ni, int strategy, final int valueSize) throws Exception {
+        ni.leveldb_set_marshalling(strategy);
+
+        final long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        final long writeoptions = ni.leveldb_writeoptions_create();
+        final long readoptions = ni.leveldb_readoptions_create();
+        final long db = ni.leveldb_open(options, "benchfile.leveldb");
+
+        System.gc();
+        long rssBefore = residentKb();
+        long gcTimeBefore = gcTime();
+        long gcCountBefore = gcCount();
+        long start = System.nanoTime();
+
+        Thread[] threads = new Thread[THREADS];
+        for (int t = 0; t < THREADS; t++) {
+            final int seed = t;
+            threads[t] = new Thread() {
+                @Override
+                public void run() {
+                    Random random = new Random(seed);
+                    byte[] value = new byte[valueSize];
+                    random.nextBytes(value);
+                    for (int i = 0; i < OPS_PER_THREAD; i++) {
+                        byte[] key = ("key" + seed + "-" + random.nextInt(1000)).getBytes();
+                        if (i % 2 == 0) {
+                            ni.leveldb_put(db, writeoptions, key, value);
+                        }
+                        else {
+                            ni.leveldb_get(db, readoptions, key);
+                        }
+                    }
+                }
+            };
+            threads[t].start();
+        }
+        for (Thread thread : threads) {
+            thread.join();
+        }
+
+        double seconds = (System.nanoTime() - start) / 1e9;
+        System.out.printf("%-10s %-7d %12.0f %12d %10d %8d%n",
+                STRATEGY_NAMES[strategy], valueSize,
+                THREADS * OPS_PER_THREAD / seconds,
+                residentKb() - rssBefore,
+                gcTime() - gcTimeBefore,
+                gcCount() - gcCountBefore);
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "benchfile.leveldb");
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    /* Resident set size from /proc, or 0 where that is unavailable. */
+    static long residentKb() {
+        try {
+            BufferedReader reader = new BufferedReader(new FileReader("/proc/self/status"));
+            try {
+                String line;
+                while ((line = reader.readLine()) != null) {
+                    if (line.startsWith("VmRSS:")) {
+                        return Long.parseLong(line.replaceAll("[^0-9]", ""));
+                    }
+                }
+            }
+            finally {
+                reader.close();
+            }
+        }
+        catch (IOException e) {}
+        return 0;
+    }
+
+    static long gcTime() {
+        long total = 0;
+        for (GarbageCollectorMXBean gc : ManagementFactory.getGarbageCollectorMXBeans()) {
+            total += Math.max(0, gc.getCollectionTime());
+        }
+        return total;
+    }
+
+    static long gcCount() {
+        long total = 0;
+        for (GarbageCollectorMXBean gc : ManagementFactory.getGarbageCollectorMXBeans()) {
+            total += Math.max(0, gc.getCollectionCount());
+        }
+        return total;
+    }
+}
@@ -22,7 +22,13 @@
 
 package org.voltdb.leveldb;
 
+import java.io.File;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
+import java.util.ArrayList;
 import java.util.Arrays;
+import java.util.List;
 
 import junit.framework.TestCase;
 
@@ -103,4 +109,1266 @@ public class TestNative extends TestCase {
         ni.leveldb_writeoptions_destroy(writeoptions);
     }
 
+    public void testDirectBuffers() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+
+        ByteBuffer key = ByteBuffer.allocateDirect(16);
+        ByteBuffer value = ByteBuffer.allocateDirect(64);
+        key.put("key".getBytes());
+        value.put("value".getBytes());
+        ni.leveldb_put_direct(db, writeoptions, key, 0, 3, value, 0, 5);
+
+        // visible through the array interface too
+        assertTrue(Arrays.equals("value".getBytes(), ni.leveldb_get(db, readoptions, "key".getBytes())));
+
+        ByteBuffer out = ByteBuffer.allocateDirect(64);
+        assertEquals(5, ni.leveldb_get_direct(db, readoptions, key, 0, 3, out, 10, 20));
+        byte[] bytes = new byte[5];
+        out.position(10);
+        out.get(bytes);
+        assertTrue(Arrays.equals("value".getBytes(), bytes));
+
+        // too small: reports the needed length
+        assertEquals(5, ni.leveldb_get_direct(db, readoptions, key, 0, 3, out, 0, 2));
+
+        byte[] reused = new byte[8];
+        assertEquals(5, ni.leveldb_get_into(db, readoptions, "key".getBytes(), reused, 2));
+        assertTrue(Arrays.equals("value".getBytes(), Arrays.copyOfRange(reused, 2, 7)));
+        assertEquals(5, ni.leveldb_get_into(db, readoptions, "key".getBytes(), reused, 4));
+        assertEquals(-1, ni.leveldb_get_into(db, readoptions, "nokey".getBytes(), reused, 0));
+
+        long batch = ni.leveldb_writebatch_create();
+        ni.leveldb_writebatch_delete_direct(batch, key, 0, 3);
+        ni.leveldb_writebatch_put_direct(batch, key, 0, 2, value, 1, 4);
+        ni.leveldb_write(db, writeoptions, batch);
+        ni.leveldb_writebatch_destroy(batch);
+        assertEquals(-1, ni.leveldb_get_direct(db, readoptions, key, 0, 3, out, 0, 64));
+        assertEquals(4, ni.leveldb_get_direct(db, readoptions, key, 0, 2, out, 0, 64));
+
+        ni.leveldb_delete_direct(db, writeoptions, key, 0, 2);
+        assertEquals(-1, ni.leveldb_get_direct(db, readoptions, key, 0, 2, out, 0, 64));
+
+        try {
+            ni.leveldb_put_direct(db, writeoptions, ByteBuffer.allocate(3), 0, 3, value, 0, 5);
+            fail(); // heap buffers are rejected
+        }
+        catch (RuntimeException e) {}
+        try {
+            ni.leveldb_put_direct(db, writeoptions, key, 10, 10, value, 0, 5);
+            fail(); // out of bounds
+        }
+        catch (RuntimeException e) {}
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testMultiGet() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+
+        for (int i = 0; i < 100; i += 2) {
+            ni.leveldb_put(db, writeoptions, String.valueOf(i).getBytes(), ("v" + i).getBytes());
+        }
+
+        int[] lookups = new int[] { 98, 3, 0, 42, 42, 1000, 7, 10 };
+        byte[][] keys = new byte[lookups.length][];
+        for (int i = 0; i < lookups.length; i++) {
+            keys[i] = String.valueOf(lookups[i]).getBytes();
+        }
+
+        ByteBuffer result = ByteBuffer.wrap(ni.leveldb_multiget(db, readoptions, keys));
+        for (int i = 0; i < lookups.length; i++) {
+            boolean expected = lookups[i] % 2 == 0 && lookups[i] < 100;
+            assertEquals(expected, result.get() == 1);
+            if (expected) {
+                byte[] value = new byte[result.getInt()];
+                result.get(value);
+                assertEquals("v" + lookups[i], new String(value));
+            }
+        }
+        assertFalse(result.hasRemaining());
+
+        ByteBuffer packed = ByteBuffer.allocateDirect(256);
+        for (byte[] key : keys) {
+            packed.putInt(key.length);
+            packed.put(key);
+        }
+        ByteBuffer out = ByteBuffer.allocateDirect(256);
+        int len = ni.leveldb_multiget_direct(db, readoptions, packed, 0, packed.position(), keys.length, out, 0, 256);
+        assertEquals(result.capacity(), len);
+        for (int i = 0; i < len; i++) {
+            assertEquals(result.get(i), out.get(i));
+        }
+        assertEquals(len, ni.leveldb_multiget_direct(db, readoptions, packed, 0, packed.position(), keys.length, out, 0, 4));
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testWriteBatchBuffer() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        ni.leveldb_put(db, writeoptions, "gone".getBytes(), "soon".getBytes());
+
+        // small initial capacity forces the buffer to grow
+        WriteBatchBuffer batch = new WriteBatchBuffer(16);
+        for (int i = 0; i < 1000; i++) {
+            batch.put(String.valueOf(i).getBytes(), ("the number " + i).getBytes());
+        }
+        batch.delete("gone".getBytes());
+        assertEquals(1001, batch.count());
+        batch.write(ni, db, writeoptions);
+
+        for (int i = 0; i < 1000; i += 7) {
+            byte[] value = ni.leveldb_get(db, readoptions, String.valueOf(i).getBytes());
+            assertEquals("the number " + i, new String(value));
+        }
+        assertEquals(-1, ni.leveldb_get_into(db, readoptions, "gone".getBytes(), new byte[8], 0));
+
+        batch.clear();
+        assertEquals(0, batch.size());
+        batch.delete("0".getBytes());
+        batch.put("new".getBytes(), "entry".getBytes());
+        long writebatch = ni.leveldb_writebatch_create();
+        batch.appendTo(ni, writebatch);
+
+        // a malformed buffer appends none of its operations
+        ByteBuffer truncated = ByteBuffer.allocateDirect(64);
+        truncated.put((byte)1).putInt(3).put("bad".getBytes()).putInt(2).put("ok".getBytes());
+        truncated.put((byte)1).putInt(3).put("bad".getBytes()).putInt(100);
+        try {
+            ni.leveldb_writebatch_append_packed(writebatch, truncated, 0, truncated.position());
+            fail();
+        }
+        catch (RuntimeException e) {}
+        assertEquals(batch.size(), ni.leveldb_writebatch_dump(writebatch).length);
+
+        ni.leveldb_write(db, writeoptions, writebatch);
+        ni.leveldb_writebatch_destroy(writebatch);
+        assertEquals(-1, ni.leveldb_get_into(db, readoptions, "0".getBytes(), new byte[32], 0));
+        assertTrue(Arrays.equals("entry".getBytes(), ni.leveldb_get(db, readoptions, "new".getBytes())));
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testIterNextBatch() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+
+        for (int i = 0; i < 1000; i++) {
+            String key = String.format("%04d", i);
+            ni.leveldb_put(db, writeoptions, key.getBytes(), ("value " + key).getBytes());
+        }
+
+        long iter = ni.leveldb_create_iterator(db, readoptions);
+        ni.leveldb_iter_seek_to_first(iter);
+        ByteBuffer buffer = ByteBuffer.allocateDirect(1024);
+        int seen = 0;
+        boolean exhausted = false;
+        while (!exhausted) {
+            int count = ni.leveldb_iter_next_batch(iter, buffer, 0, buffer.capacity(), 100);
+            if (count < 0) {
+                count = -count - 1;
+                exhausted = true;
+            }
+            assertTrue(count <= 100);
+            buffer.clear();
+            for (int i = 0; i < count; i++) {
+                byte[] key = new byte[buffer.getInt()];
+                buffer.get(key);
+                byte[] value = new byte[buffer.getInt()];
+                buffer.get(value);
+                assertEquals(String.format("%04d", seen), new String(key));
+                assertEquals("value " + new String(key), new String(value));
+                seen++;
+            }
+        }
+        assertEquals(1000, seen);
+
+        // an entry too large for the buffer reports its size
+        ni.leveldb_iter_seek_to_first(iter);
+        assertEquals(0, ni.leveldb_iter_next_batch(iter, buffer, 0, 10, 100));
+        assertEquals(8 + 4 + 10, buffer.getInt(0));
+        ni.leveldb_iter_destroy(iter);
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testIterNextBatchCorruption() throws IOException {
+        NativeInterface ni = new NativeInterface();
+
+        long bulkload = ni.leveldb_bulkload_create("testfile.leveldb", 1024 * 1024);
+        for (int i = 0; i < 10000; i++) {
+            ni.leveldb_bulkload_add(bulkload, String.format("key%05d", i).getBytes(), ("value" + i).getBytes());
+        }
+        ni.leveldb_bulkload_finish(bulkload);
+        ni.leveldb_bulkload_destroy(bulkload);
+
+        // Overwrite part of a data block; the index and footer stay intact.
+        for (File file : new File("testfile.leveldb").listFiles()) {
+            if (file.getName().endsWith(".sst")) {
+                RandomAccessFile table = new RandomAccessFile(file, "rw");
+                table.seek(table.length() / 4);
+                table.write(new byte[64]);
+                table.close();
+            }
+        }
+
+        long options = ni.leveldb_options_create();
+        long readoptions = ni.leveldb_readoptions_create();
+        ni.leveldb_readoptions_set_verify_checksums(readoptions, true);
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        long iter = ni.leveldb_create_iterator(db, readoptions);
+        ni.leveldb_iter_seek_to_first(iter);
+        ByteBuffer buffer = ByteBuffer.allocateDirect(64 * 1024);
+        try {
+            while (ni.leveldb_iter_next_batch(iter, buffer, 0, buffer.capacity(), 1000) >= 0) {
+            }
+            fail(); // a corrupt block must not read as exhaustion
+        }
+        catch (LevelDBException.Corruption e) {
+            assertTrue(e.getMessage().startsWith("Corruption: "));
+        }
+        ni.leveldb_iter_destroy(iter);
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+    }
+
+    private List<String> scanKeys(NativeInterface ni, long scan, int pageSize) {
+        List<String> keys = new ArrayList<String>();
+        ByteBuffer buffer = ByteBuffer.allocateDirect(pageSize);
+        boolean exhausted = false;
+        while (!exhausted) {
+            int count = ni.leveldb_scan_next_page(scan, buffer, 0, buffer.capacity());
+            if (count < 0) {
+                count = -count - 1;
+                exhausted = true;
+            }
+            buffer.clear();
+            for (int i = 0; i < count; i++) {
+                byte[] key = new byte[buffer.getInt()];
+                buffer.get(key);
+                int valueLength = buffer.getInt();
+                buffer.position(buffer.position() + valueLength);
+                keys.add(new String(key));
+            }
+        }
+        ni.leveldb_scan_destroy(scan);
+        return keys;
+    }
+
+    public void testRangeScan() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+
+        for (int i = 0; i < 1000; i += 2) {
+            byte[] key = String.format("%04d", i).getBytes();
+            ni.leveldb_put(db, writeoptions, key, key);
+        }
+
+        // small pages force several round trips
+        List<String> keys = scanKeys(ni, ni.leveldb_scan_create(db, readoptions,
+                "0100".getBytes(), "0200".getBytes(), 0, false), 100);
+        assertEquals(50, keys.size());
+        assertEquals("0100", keys.get(0));
+        assertEquals("0198", keys.get(49));
+
+        keys = scanKeys(ni, ni.leveldb_scan_create(db, readoptions,
+                "0101".getBytes(), "0199".getBytes(), 0, true), 4096);
+        assertEquals(49, keys.size());
+        assertEquals("0198", keys.get(0));
+        assertEquals("0102", keys.get(48));
+
+        keys = scanKeys(ni, ni.leveldb_scan_create(db, readoptions,
+                "0100".getBytes(), null, 10, false), 4096);
+        assertEquals(10, keys.size());
+        assertEquals("0118", keys.get(9));
+
+        keys = scanKeys(ni, ni.leveldb_scan_create(db, readoptions, null, null, 0, true), 4096);
+        assertEquals(500, keys.size());
+        assertEquals("0998", keys.get(0));
+
+        keys = scanKeys(ni, ni.leveldb_scan_create(db, readoptions,
+                "2000".getBytes(), null, 0, false), 4096);
+        assertTrue(keys.isEmpty());
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testPrefixScanAndCount() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+
+        String[] tenants = new String[] { "a", "b", "bb", "c" };
+        for (String tenant : tenants) {
+            for (int i = 0; i < 30; i++) {
+                byte[] key = String.format("%s/%02d", tenant, i).getBytes();
+                ni.leveldb_put(db, writeoptions, key, key);
+            }
+        }
+
+        assertEquals(30, ni.leveldb_prefix_count(db, readoptions, "b/".getBytes()));
+        assertEquals(60, ni.leveldb_prefix_count(db, readoptions, "b".getBytes()));
+        assertEquals(0, ni.leveldb_prefix_count(db, readoptions, "z".getBytes()));
+
+        List<String> keys = scanKeys(ni, ni.leveldb_scan_create_prefix(db, readoptions,
+                "bb/".getBytes(), 0), 64);
+        assertEquals(30, keys.size());
+        assertEquals("bb/00", keys.get(0));
+        assertEquals("bb/29", keys.get(29));
+
+        keys = scanKeys(ni, ni.leveldb_scan_create_prefix(db, readoptions, "c".getBytes(), 5), 4096);
+        assertEquals(5, keys.size());
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testCursorViews() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+
+        for (int i = 0; i < 100; i++) {
+            byte[] key = String.format("%03d", i).getBytes();
+            ni.leveldb_put(db, writeoptions, key, ("value " + i).getBytes());
+        }
+
+        long iter = ni.leveldb_create_iterator(db, readoptions);
+        Cursor cursor = new Cursor(ni, iter);
+        ByteBuffer key = cursor.key();
+        int seen = 0;
+        for (boolean valid = cursor.seekToFirst(); valid; valid = cursor.next()) {
+            // the same buffer objects are reused for every entry
+            assertSame(key, cursor.key());
+            assertTrue(cursor.key().isReadOnly());
+            byte[] keyBytes = new byte[cursor.key().remaining()];
+            cursor.key().get(keyBytes);
+            byte[] valueBytes = new byte[cursor.value().remaining()];
+            cursor.value().get(valueBytes);
+            assertEquals(String.format("%03d", seen), new String(keyBytes));
+            assertEquals("value " + seen, new String(valueBytes));
+            seen++;
+        }
+        assertEquals(100, seen);
+        assertEquals(0, cursor.key().remaining());
+
+        assertTrue(cursor.seek("050".getBytes()));
+        assertEquals('5', cursor.key().get(1));
+        assertTrue(cursor.prev());
+        assertEquals('4', cursor.key().get(1));
+        assertTrue(cursor.seekToLast());
+        assertEquals('9', cursor.key().get(2));
+        assertFalse(cursor.next());
+
+        // a closed cursor's views no longer reach the iterator
+        assertTrue(cursor.seekToFirst());
+        cursor.close();
+        ni.leveldb_iter_destroy(iter);
+        assertEquals(0, key.capacity());
+        key.clear();
+        assertEquals(0, key.remaining());
+        try {
+            key.get(0);
+            fail();
+        }
+        catch (IndexOutOfBoundsException e) {}
+        try {
+            cursor.next();
+            fail();
+        }
+        catch (IllegalStateException e) {}
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testStatusExceptions() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+
+        try {
+            ni.leveldb_open(options, "testfile-missing.leveldb");
+            fail(); // create_if_missing is off
+        }
+        catch (LevelDBException.InvalidArgument e) {
+            assertTrue(e.getMessage().startsWith("Invalid argument: "));
+        }
+
+        ni.leveldb_options_set_create_if_missing(options, true);
+        try {
+            ni.leveldb_open(options, "no-such-directory/nested/testfile.leveldb");
+            fail();
+        }
+        catch (LevelDBException.IOError e) {
+            assertTrue(e.getMessage().startsWith("IO error: "));
+        }
+
+        ni.leveldb_options_destroy(options);
+    }
+
+    public void testMarshallingStrategies() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+
+        byte[] large = new byte[100000];
+        large[5] = 42;
+        int[] strategies = new int[] {
+            NativeInterface.leveldb_marshal_auto,
+            NativeInterface.leveldb_marshal_copy,
+            NativeInterface.leveldb_marshal_critical,
+            NativeInterface.leveldb_marshal_elements
+        };
+        try {
+            for (int strategy : strategies) {
+                ni.leveldb_set_marshalling(strategy);
+                byte[] key = ("key" + strategy).getBytes();
+                ni.leveldb_put(db, writeoptions, key, "small".getBytes());
+                assertTrue(Arrays.equals("small".getBytes(), ni.leveldb_get(db, readoptions, key)));
+                ni.leveldb_put(db, writeoptions, key, large);
+                assertTrue(Arrays.equals(large, ni.leveldb_get(db, readoptions, key)));
+
+                long batch = ni.leveldb_writebatch_create();
+                ni.leveldb_writebatch_put(batch, "batched".getBytes(), large);
+                ni.leveldb_writebatch_delete(batch, key);
+                ni.leveldb_write(db, writeoptions, batch);
+                ni.leveldb_writebatch_destroy(batch);
+                assertTrue(Arrays.equals(large, ni.leveldb_get(db, readoptions, "batched".getBytes())));
+                assertEquals(-1, ni.leveldb_get_into(db, readoptions, key, new byte[8], 0));
+            }
+        }
+        finally {
+            ni.leveldb_set_marshalling(NativeInterface.leveldb_marshal_auto);
+        }
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testGroupCommit() throws InterruptedException {
+        final NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        ni.leveldb_writeoptions_set_sync(writeoptions, true);
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        final long groupcommit = ni.leveldb_group_commit_create(db, writeoptions);
+
+        Thread[] writers = new Thread[8];
+        for (int t = 0; t < writers.length; t++) {
+            final int id = t;
+            writers[t] = new Thread() {
+                @Override
+                public void run() {
+                    for (int i = 0; i < 200; i++) {
+                        byte[] key = (id + "-" + i).getBytes();
+                        ni.leveldb_group_commit_put(groupcommit, key, key);
+                    }
+                }
+            };
+            writers[t].start();
+        }
+        for (Thread writer : writers) {
+            writer.join();
+        }
+
+        for (int t = 0; t < writers.length; t++) {
+            for (int i = 0; i < 200; i++) {
+                byte[] key = (t + "-" + i).getBytes();
+                assertTrue(Arrays.equals(key, ni.leveldb_get(db, readoptions, key)));
+            }
+        }
+
+        long batch = ni.leveldb_writebatch_create();
+        ni.leveldb_writebatch_put(batch, "batched".getBytes(), "value".getBytes());
+        ni.leveldb_writebatch_delete(batch, "0-0".getBytes());
+        ni.leveldb_group_commit_write(groupcommit, batch);
+        ni.leveldb_writebatch_destroy(batch);
+        assertTrue(Arrays.equals("value".getBytes(), ni.leveldb_get(db, readoptions, "batched".getBytes())));
+        assertEquals(-1, ni.leveldb_get_into(db, readoptions, "0-0".getBytes(), new byte[8], 0));
+
+        ni.leveldb_group_commit_destroy(groupcommit);
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testAsyncWrites() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        long writer = ni.leveldb_async_writer_create(db, writeoptions);
+
+        long ticket = 0;
+        for (int i = 0; i < 1000; i++) {
+            long batch = ni.leveldb_writebatch_create();
+            ni.leveldb_writebatch_put(batch, ("key" + i).getBytes(), ("value" + i).getBytes());
+            long next = ni.leveldb_async_submit(writer, batch);
+            assertEquals(ticket + 1, next);
+            ticket = next;
+        }
+
+        assertTrue(ni.leveldb_async_await(writer, ticket, -1));
+        assertEquals(ticket, ni.leveldb_async_completed(writer));
+        assertFalse(ni.leveldb_async_await(writer, ticket + 1, 10));
+        for (int i = 0; i < 1000; i++) {
+            assertTrue(Arrays.equals(("value" + i).getBytes(),
+                    ni.leveldb_get(db, readoptions, ("key" + i).getBytes())));
+        }
+
+        long batch = ni.leveldb_writebatch_create();
+        ni.leveldb_writebatch_delete(batch, "key0".getBytes());
+        ni.leveldb_async_submit(writer, batch);
+        ni.leveldb_async_writer_destroy(writer);
+        assertEquals(-1, ni.leveldb_get_into(db, readoptions, "key0".getBytes(), new byte[8], 0));
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testWriteBatchSerialization() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        ni.leveldb_put(db, writeoptions, "b".getBytes(), "old".getBytes());
+
+        long batch = ni.leveldb_writebatch_create();
+        ni.leveldb_writebatch_put(batch, "a".getBytes(), "1".getBytes());
+        ni.leveldb_writebatch_delete(batch, "b".getBytes());
+        byte[] rep = ni.leveldb_writebatch_to_bytes(batch);
+        ni.leveldb_writebatch_destroy(batch);
+
+        ByteBuffer buffer = ByteBuffer.allocateDirect(64);
+        long replica = ni.leveldb_writebatch_from_bytes(rep);
+        assertEquals(rep.length, ni.leveldb_writebatch_to_buffer(replica, buffer, 0, 4));
+        assertEquals(rep.length, ni.leveldb_writebatch_to_buffer(replica, buffer, 0, 64));
+        ni.leveldb_writebatch_destroy(replica);
+
+        replica = ni.leveldb_writebatch_from_buffer(buffer, 0, rep.length);
+        assertTrue(Arrays.equals(rep, ni.leveldb_writebatch_to_bytes(replica)));
+        ni.leveldb_write(db, writeoptions, replica);
+        ni.leveldb_writebatch_destroy(replica);
+        assertTrue(Arrays.equals("1".getBytes(), ni.leveldb_get(db, readoptions, "a".getBytes())));
+        assertEquals(-1, ni.leveldb_get_into(db, readoptions, "b".getBytes(), new byte[8], 0));
+
+        try {
+            ni.leveldb_writebatch_from_bytes(Arrays.copyOf(rep, rep.length - 1));
+            fail();
+        }
+        catch (LevelDBException.Corruption e) {
+            assertTrue(e.getMessage().startsWith("Corruption: "));
+        }
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testWriteBatchDump() {
+        NativeInterface ni = new NativeInterface();
+
+        long batch = ni.leveldb_writebatch_create();
+        ni.leveldb_writebatch_put(batch, "key".getBytes(), "value".getBytes());
+        ni.leveldb_writebatch_delete(batch, "gone".getBytes());
+
+        ByteBuffer dump = ByteBuffer.wrap(ni.leveldb_writebatch_dump(batch));
+        assertEquals(WriteBatchBuffer.OP_PUT, dump.get());
+        assertEquals(3, dump.getInt());
+        dump.position(dump.position() + 3);
+        assertEquals(5, dump.getInt());
+        dump.position(dump.position() + 5);
+        assertEquals(WriteBatchBuffer.OP_DELETE, dump.get());
+        assertEquals(4, dump.getInt());
+        dump.position(dump.position() + 4);
+        assertFalse(dump.hasRemaining());
+
+        ByteBuffer buffer = ByteBuffer.allocateDirect(64);
+        assertEquals(dump.capacity(), ni.leveldb_writebatch_dump_into(batch, buffer, 0, 8));
+        assertEquals(dump.capacity(), ni.leveldb_writebatch_dump_into(batch, buffer, 0, 64));
+
+        long copy = ni.leveldb_writebatch_create();
+        ni.leveldb_writebatch_append_packed(copy, buffer, 0, dump.capacity());
+        assertTrue(Arrays.equals(ni.leveldb_writebatch_to_bytes(batch), ni.leveldb_writebatch_to_bytes(copy)));
+
+        ni.leveldb_writebatch_destroy(copy);
+        ni.leveldb_writebatch_destroy(batch);
+    }
+
+    public void testBulkLoad() {
+        NativeInterface ni = new NativeInterface();
+
+        long bulkload = ni.leveldb_bulkload_create("testfile.leveldb", 64 * 1024);
+        for (int i = 0; i < 10000; i++) {
+            ni.leveldb_bulkload_add(bulkload, String.format("key%05d", i).getBytes(), ("value" + i).getBytes());
+        }
+        try {
+            ni.leveldb_bulkload_add(bulkload, "key00000".getBytes(), "value".getBytes());
+            fail(); // out of order
+        }
+        catch (LevelDBException.InvalidArgument e) {
+        }
+        ni.leveldb_bulkload_destroy(bulkload);
+
+        bulkload = ni.leveldb_bulkload_create("testfile.leveldb", 64 * 1024);
+        ByteBuffer entries = ByteBuffer.allocateDirect(1024 * 1024);
+        for (int i = 0; i < 10000; i++) {
+            byte[] key = String.format("key%05d", i).getBytes();
+            byte[] value = ("value" + i).getBytes();
+            entries.putInt(key.length).put(key).putInt(value.length).put(value);
+        }
+        ni.leveldb_bulkload_add_packed(bulkload, entries, 0, entries.position());
+        ni.leveldb_bulkload_finish(bulkload);
+        try {
+            ni.leveldb_bulkload_finish(bulkload);
+            fail(); // already finished
+        }
+        catch (LevelDBException.InvalidArgument e) {
+        }
+        ni.leveldb_bulkload_destroy(bulkload);
+
+        long options = ni.leveldb_options_create();
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+        ni.leveldb_readoptions_set_verify_checksums(readoptions, true);
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        for (int i = 0; i < 10000; i++) {
+            assertTrue(Arrays.equals(("value" + i).getBytes(),
+                    ni.leveldb_get(db, readoptions, String.format("key%05d", i).getBytes())));
+        }
+        ni.leveldb_put(db, writeoptions, "key00000".getBytes(), "new".getBytes());
+        assertTrue(Arrays.equals("new".getBytes(), ni.leveldb_get(db, readoptions, "key00000".getBytes())));
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testIngest() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+
+        // A small memory limit forces several spilled runs.
+        long ingest = ni.leveldb_ingest_create(System.getProperty("java.io.tmpdir"), 64 * 1024, 2);
+        for (int i = 0; i < 20000; i++) {
+            int k = (i * 7919) % 10000;
+            ni.leveldb_ingest_add(ingest, String.format("key%05d", k).getBytes(), ("value" + i).getBytes());
+        }
+        ni.leveldb_ingest_finish(ingest, db, writeoptions);
+        ni.leveldb_ingest_destroy(ingest);
+
+        long iterator = ni.leveldb_create_iterator(db, readoptions);
+        ni.leveldb_iter_seek_to_first(iterator);
+        for (int k = 0; k < 10000; k++) {
+            assertTrue(ni.leveldb_iter_valid(iterator));
+            assertTrue(Arrays.equals(String.format("key%05d", k).getBytes(), ni.leveldb_iter_key(iterator)));
+            ni.leveldb_iter_next(iterator);
+        }
+        assertFalse(ni.leveldb_iter_valid(iterator));
+        ni.leveldb_iter_destroy(iterator);
+
+        // The later of the two values added for each key wins.
+        for (int i = 10000; i < 20000; i++) {
+            int k = (i * 7919) % 10000;
+            assertTrue(Arrays.equals(("value" + i).getBytes(),
+                    ni.leveldb_get(db, readoptions, String.format("key%05d", k).getBytes())));
+        }
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testAdmissionControl() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        long admission = ni.leveldb_admission_create(db, 4, 10);
+
+        assertEquals(0, ni.leveldb_admission_level0_files(admission));
+        assertFalse(ni.leveldb_admission_would_stall(admission));
+        assertTrue(ni.leveldb_admission_acquire(admission, 1 << 30) < 1000); // no throttle
+
+        ni.leveldb_admission_set_rate(admission, 1024 * 1024, 64 * 1024);
+        for (int i = 0; i < 16; i++) {
+            ni.leveldb_admission_acquire(admission, 16 * 1024);
+            ni.leveldb_put(db, writeoptions, ("key" + i).getBytes(), new byte[16 * 1024]);
+        }
+        // The bucket is drained by now, so a whole burst has to wait.
+        assertTrue(ni.leveldb_admission_acquire(admission, 64 * 1024) > 0);
+
+        ni.leveldb_admission_destroy(admission);
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testAtomicOps() throws InterruptedException {
+        final NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        final long atomic = ni.leveldb_atomic_create(db, writeoptions, 64);
+
+        Thread[] writers = new Thread[4];
+        for (int t = 0; t < writers.length; t++) {
+            final int id = t;
+            writers[t] = new Thread() {
+                @Override
+                public void run() {
+                    for (int i = 0; i < 500; i++) {
+                        ni.leveldb_atomic_add_int64(atomic, "counter".getBytes(), 1);
+                        ni.leveldb_atomic_max_int64(atomic, "max".getBytes(), id * 1000 + i);
+                    }
+                }
+            };
+            writers[t].start();
+        }
+        for (Thread writer : writers) {
+            writer.join();
+        }
+        assertEquals(2000, ByteBuffer.wrap(ni.leveldb_get(db, readoptions, "counter".getBytes())).getLong());
+        assertEquals(3499, ni.leveldb_atomic_max_int64(atomic, "max".getBytes(), 0));
+
+        ni.leveldb_atomic_append(atomic, "log".getBytes(), "a".getBytes());
+        ni.leveldb_atomic_append(atomic, "log".getBytes(), "b".getBytes());
+        assertTrue(Arrays.equals("ab".getBytes(), ni.leveldb_get(db, readoptions, "log".getBytes())));
+        try {
+            ni.leveldb_atomic_add_int64(atomic, "log".getBytes(), 1);
+            fail();
+        }
+        catch (LevelDBException.InvalidArgument e) {
+        }
+
+        ByteBuffer ops = ByteBuffer.allocateDirect(256);
+        for (int i = 0; i < 2; i++) {
+            ops.put((byte)NativeInterface.leveldb_atomic_add);
+            ops.putInt(7).put("counter".getBytes()).putInt(8).putLong(-500);
+        }
+        ops.put((byte)NativeInterface.leveldb_atomic_append);
+        ops.putInt(3).put("log".getBytes()).putInt(1).put("c".getBytes());
+        ni.leveldb_atomic_apply_packed(atomic, ops, 0, ops.position());
+        assertEquals(1000, ni.leveldb_atomic_add_int64(atomic, "counter".getBytes(), 0));
+        assertTrue(Arrays.equals("abc".getBytes(), ni.leveldb_get(db, readoptions, "log".getBytes())));
+
+        ni.leveldb_atomic_destroy(atomic);
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testConditionalWrites() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        long atomic = ni.leveldb_atomic_create(db, writeoptions, 64);
+
+        assertTrue(ni.leveldb_atomic_put_if_absent(atomic, "key".getBytes(), "v1".getBytes()));
+        assertFalse(ni.leveldb_atomic_put_if_absent(atomic, "key".getBytes(), "v2".getBytes()));
+        assertFalse(ni.leveldb_atomic_compare_and_set(atomic, "key".getBytes(), "v2".getBytes(), "v3".getBytes()));
+        assertTrue(ni.leveldb_atomic_compare_and_set(atomic, "key".getBytes(), "v1".getBytes(), "v3".getBytes()));
+        assertTrue(Arrays.equals("v3".getBytes(), ni.leveldb_get(db, readoptions, "key".getBytes())));
+        assertFalse(ni.leveldb_atomic_delete_if_equals(atomic, "key".getBytes(), "v1".getBytes()));
+        assertTrue(ni.leveldb_atomic_delete_if_equals(atomic, "key".getBytes(), "v3".getBytes()));
+        assertEquals(-1, ni.leveldb_get_into(db, readoptions, "key".getBytes(), new byte[8], 0));
+
+        ByteBuffer ops = ByteBuffer.allocateDirect(256);
+        ops.put((byte)NativeInterface.leveldb_atomic_put_if_absent);
+        ops.putInt(1).put("a".getBytes()).putInt(1).put("1".getBytes());
+        ops.put((byte)NativeInterface.leveldb_atomic_compare_and_set);
+        ops.putInt(1).put("a".getBytes()).putInt(1).put("1".getBytes()).putInt(1).put("2".getBytes());
+        ops.put((byte)NativeInterface.leveldb_atomic_delete_if_equals);
+        ops.putInt(1).put("b".getBytes()).putInt(1).put("x".getBytes());
+        ByteBuffer results = ByteBuffer.allocateDirect(3);
+        assertEquals(2, ni.leveldb_atomic_conditional_packed(atomic, ops, 0, ops.position(), results, 0, 3));
+        assertEquals(1, results.get(0));
+        assertEquals(1, results.get(1));
+        assertEquals(0, results.get(2));
+        assertTrue(Arrays.equals("2".getBytes(), ni.leveldb_get(db, readoptions, "a".getBytes())));
+
+        ni.leveldb_atomic_destroy(atomic);
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testBatcher() throws InterruptedException {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+
+        long batcher = ni.leveldb_batcher_create(db, writeoptions, 0, 100, 0);
+        for (int i = 0; i < 250; i++) {
+            ni.leveldb_batcher_put(batcher, ("key" + i).getBytes(), "value".getBytes());
+        }
+        assertTrue(Arrays.equals("value".getBytes(), ni.leveldb_get(db, readoptions, "key199".getBytes())));
+        assertEquals(-1, ni.leveldb_get_into(db, readoptions, "key200".getBytes(), new byte[8], 0));
+
+        long[] stats = new long[NativeInterface.leveldb_batcher_stat_count];
+        ni.leveldb_batcher_stats(batcher, stats, true);
+        assertEquals(2, stats[NativeInterface.leveldb_batcher_stat_flushes]);
+        assertEquals(200, stats[NativeInterface.leveldb_batcher_stat_ops]);
+        assertTrue(stats[NativeInterface.leveldb_batcher_stat_p99_micros] <= 2 * stats[NativeInterface.leveldb_batcher_stat_max_micros] + 1);
+
+        ni.leveldb_batcher_delete(batcher, "key0".getBytes());
+        ni.leveldb_batcher_destroy(batcher);
+        assertTrue(Arrays.equals("value".getBytes(), ni.leveldb_get(db, readoptions, "key249".getBytes())));
+        assertEquals(-1, ni.leveldb_get_into(db, readoptions, "key0".getBytes(), new byte[8], 0));
+
+        batcher = ni.leveldb_batcher_create(db, writeoptions, 0, 0, 20);
+        ni.leveldb_batcher_put(batcher, "delayed".getBytes(), "value".getBytes());
+        Thread.sleep(200);
+        assertTrue(Arrays.equals("value".getBytes(), ni.leveldb_get(db, readoptions, "delayed".getBytes())));
+        ni.leveldb_batcher_destroy(batcher);
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testRowCache() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+        long snapshotoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        long rowcache = ni.leveldb_rowcache_create(db, 1 << 20, 4);
+        long[] stats = new long[NativeInterface.leveldb_rowcache_stat_count];
+
+        ni.leveldb_put(db, writeoptions, "key".getBytes(), "value1".getBytes());
+        assertTrue(Arrays.equals("value1".getBytes(), ni.leveldb_get(db, readoptions, "key".getBytes())));
+        assertTrue(Arrays.equals("value1".getBytes(), ni.leveldb_get(db, readoptions, "key".getBytes())));
+        ni.leveldb_rowcache_stats(rowcache, stats, false);
+        assertEquals(1, stats[NativeInterface.leveldb_rowcache_stat_hits]);
+        assertEquals(1, stats[NativeInterface.leveldb_rowcache_stat_misses]);
+        assertEquals(1, stats[NativeInterface.leveldb_rowcache_stat_entries]);
+
+        // a snapshot read must not see the cached latest value
+        long snapshot = ni.leveldb_create_snapshot(db);
+        ni.leveldb_readoptions_set_snapshot(snapshotoptions, snapshot);
+        ni.leveldb_put(db, writeoptions, "key".getBytes(), "value2".getBytes());
+        assertTrue(Arrays.equals("value2".getBytes(), ni.leveldb_get(db, readoptions, "key".getBytes())));
+        assertTrue(Arrays.equals("value1".getBytes(), ni.leveldb_get(db, snapshotoptions, "key".getBytes())));
+        ni.leveldb_release_snapshot(db, snapshot);
+
+        long batch = ni.leveldb_writebatch_create();
+        ni.leveldb_writebatch_delete(batch, "key".getBytes());
+        ni.leveldb_write(db, writeoptions, batch);
+        ni.leveldb_writebatch_destroy(batch);
+        assertEquals(-1, ni.leveldb_get_into(db, readoptions, "key".getBytes(), new byte[8], 0));
+
+        ni.leveldb_rowcache_stats(rowcache, stats, true);
+        assertEquals(1, stats[NativeInterface.leveldb_rowcache_stat_bypasses]);
+        assertEquals(2, stats[NativeInterface.leveldb_rowcache_stat_invalidations]);
+        assertEquals(0, stats[NativeInterface.leveldb_rowcache_stat_entries]);
+        assertEquals(1 << 20, stats[NativeInterface.leveldb_rowcache_stat_capacity]);
+
+        ni.leveldb_close(db);
+        ni.leveldb_rowcache_destroy(rowcache);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_readoptions_destroy(snapshotoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testBloomFilter() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        for (int i = 0; i < 1000; i++) {
+            ni.leveldb_put(db, writeoptions, ("key" + i).getBytes(), "value".getBytes());
+        }
+
+        long bloom = ni.leveldb_bloom_create(db, readoptions, 10);
+        ni.leveldb_put(db, writeoptions, "added".getBytes(), "value".getBytes());
+        for (int i = 0; i < 1000; i++) {
+            assertTrue(Arrays.equals("value".getBytes(), ni.leveldb_get(db, readoptions, ("key" + i).getBytes())));
+            assertEquals(-1, ni.leveldb_get_into(db, readoptions, ("missing" + i).getBytes(), new byte[8], 0));
+        }
+        assertTrue(Arrays.equals("value".getBytes(), ni.leveldb_get(db, readoptions, "added".getBytes())));
+
+        long[] stats = new long[NativeInterface.leveldb_bloom_stat_count];
+        ni.leveldb_bloom_stats(bloom, stats, true);
+        assertEquals(1001, stats[NativeInterface.leveldb_bloom_stat_keys]);
+        assertTrue(stats[NativeInterface.leveldb_bloom_stat_negatives] > 950);
+
+        ni.leveldb_delete(db, writeoptions, "added".getBytes());
+        ni.leveldb_bloom_rebuild(bloom, readoptions);
+        ni.leveldb_bloom_stats(bloom, stats, false);
+        assertEquals(1000, stats[NativeInterface.leveldb_bloom_stat_keys]);
+        assertEquals(0, stats[NativeInterface.leveldb_bloom_stat_deletes]);
+
+        // a rebuild ignores the snapshot of its options, so it sees later writes
+        long snapshot = ni.leveldb_create_snapshot(db);
+        long snapshotoptions = ni.leveldb_readoptions_create();
+        ni.leveldb_readoptions_set_snapshot(snapshotoptions, snapshot);
+        ni.leveldb_put(db, writeoptions, "late".getBytes(), "value".getBytes());
+        ni.leveldb_bloom_rebuild(bloom, snapshotoptions);
+        assertTrue(Arrays.equals("value".getBytes(), ni.leveldb_get(db, readoptions, "late".getBytes())));
+        ni.leveldb_readoptions_destroy(snapshotoptions);
+        ni.leveldb_release_snapshot(db, snapshot);
+
+        ni.leveldb_bloom_save(bloom, "testfile.bloom");
+        ni.leveldb_bloom_destroy(bloom);
+        bloom = ni.leveldb_bloom_load(db, "testfile.bloom");
+        assertTrue(Arrays.equals("value".getBytes(), ni.leveldb_get(db, readoptions, "key500".getBytes())));
+        // loading consumes the file, so it cannot be loaded again once stale
+        assertFalse(new File("testfile.bloom").exists());
+        ni.leveldb_bloom_destroy(bloom);
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testScanResistantCache() {
+        NativeInterface ni = new NativeInterface();
+
+        long cache = ni.leveldb_cache_create_scan_resistant(256 * 1024, 4);
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        ni.leveldb_options_set_cache(options, cache);
+        ni.leveldb_options_set_block_size(options, 4096);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        byte[] value = new byte[500];
+        for (int i = 0; i < 5000; i++) {
+            value[0] = (byte)i;
+            ni.leveldb_put(db, writeoptions, String.format("key%06d", i).getBytes(), value);
+        }
+        // reopening moves the entries into a table, so reads go through the cache
+        ni.leveldb_close(db);
+        db = ni.leveldb_open(options, "testfile.leveldb");
+
+        // the first 200 keys fill about 25 blocks, well inside the cache
+        long[] stats = new long[NativeInterface.leveldb_cache_stat_count];
+        for (int pass = 0; pass < 3; pass++) {
+            for (int i = 0; i < 200; i++) {
+                byte[] got = ni.leveldb_get(db, readoptions, String.format("key%06d", i).getBytes());
+                assertEquals(500, got.length);
+                assertEquals((byte)i, got[0]);
+            }
+        }
+        ni.leveldb_cache_scan_resistant_stats(cache, stats, true);
+        assertTrue(stats[NativeInterface.leveldb_cache_stat_promotions] > 0);
+
+        // a full scan reads about ten times the capacity
+        long iter = ni.leveldb_create_iterator(db, readoptions);
+        int count = 0;
+        for (ni.leveldb_iter_seek_to_first(iter); ni.leveldb_iter_valid(iter); ni.leveldb_iter_next(iter)) {
+            count++;
+        }
+        ni.leveldb_iter_destroy(iter);
+        assertEquals(5000, count);
+        ni.leveldb_cache_scan_resistant_stats(cache, stats, true);
+        assertTrue(stats[NativeInterface.leveldb_cache_stat_evictions] > 0);
+
+        // and the hot blocks are all still cached
+        for (int i = 0; i < 200; i++) {
+            assertEquals(500, ni.leveldb_get(db, readoptions, String.format("key%06d", i).getBytes()).length);
+        }
+        ni.leveldb_cache_scan_resistant_stats(cache, stats, false);
+        assertEquals(0, stats[NativeInterface.leveldb_cache_stat_misses]);
+        assertEquals(200, stats[NativeInterface.leveldb_cache_stat_hits]);
+        assertTrue(stats[NativeInterface.leveldb_cache_stat_bytes] <= stats[NativeInterface.leveldb_cache_stat_capacity]);
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_cache_destroy(cache);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    public void testParallelMultiget() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+        for (int i = 0; i < 1000; i += 2) {
+            ni.leveldb_put(db, writeoptions, ("key" + i).getBytes(), ("value" + i).getBytes());
+        }
+
+        long pool = ni.leveldb_readpool_create(4);
+        byte[][] keys = new byte[300][];
+        for (int i = 0; i < keys.length; i++) {
+            keys[i] = ("key" + (i * 7) % 600).getBytes();
+        }
+        byte[] expected = ni.leveldb_multiget(db, readoptions, keys);
+        assertTrue(Arrays.equals(expected, ni.leveldb_multiget_parallel(pool, db, readoptions, keys, 0)));
+        assertTrue(Arrays.equals(expected, ni.leveldb_multiget_parallel(pool, db, readoptions, keys, 1)));
+        assertTrue(Arrays.equals(expected, ni.leveldb_multiget_parallel(pool, db, readoptions, keys, 16)));
+        assertEquals(0, ni.leveldb_multiget_parallel(pool, db, readoptions, new byte[0][], 0).length);
+
+        long snapshot = ni.leveldb_create_snapshot(db);
+        long snapshotoptions = ni.leveldb_readoptions_create();
+        ni.leveldb_readoptions_set_snapshot(snapshotoptions, snapshot);
+        ni.leveldb_put(db, writeoptions, "key1".getBytes(), "added".getBytes());
+        byte[][] one = { "key1".getBytes() };
+        assertEquals(0, ni.leveldb_multiget_parallel(pool, db, snapshotoptions, one, 2)[0]);
+        assertEquals(1, ni.leveldb_multiget_parallel(pool, db, readoptions, one, 2)[0]);
+        ni.leveldb_readoptions_destroy(snapshotoptions);
+        ni.leveldb_release_snapshot(db, snapshot);
+
+        ni.leveldb_readpool_destroy(pool);
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
+    private List<String> prefetchKeys(NativeInterface ni, long prefetch, int chunkSize) {
+        List<String> keys = new ArrayList<String>();
+        ByteBuffer buffer = ByteBuffer.allocateDirect(chunkSize);
+        boolean exhausted = false;
+        while (!exhausted) {
+            int count = ni.leveldb_prefetch_next(prefetch, buffer, 0, buffer.capacity());
+            if (count < 0) {
+                count = -count - 1;
+                exhausted = true;
+            }
+            buffer.clear();
+            for (int i = 0; i < count; i++) {
+                byte[] key = new byte[buffer.getInt()];
+                buffer.get(key);
+                int valueLength = buffer.getInt();
+                buffer.position(buffer.position() + valueLength);
+                keys.add(new String(key));
+            }
+        }
+        return keys;
+    }
+
+    public void testPrefetchScan() {
+        NativeInterface ni = new NativeInterface();
+
+        long options = ni.leveldb_options_create();
+        ni.leveldb_options_set_create_if_missing(options, true);
+        long writeoptions = ni.leveldb_writeoptions_create();
+        long readoptions = ni.leveldb_readoptions_create();
+
+        long db = ni.leveldb_open(options, "testfile.leveldb");
+
+        for (int i = 0; i < 1000; i += 2) {
+            byte[] key = String.format("%04d", i).getBytes();
+            ni.leveldb_put(db, writeoptions, key, key);
+        }
+
+        // small chunks and a shallow ring keep the thread waiting on the caller
+        long prefetch = ni.leveldb_prefetch_create(db, readoptions,
+                "0100".getBytes(), "0200".getBytes(), 0, false, 100, 2);
+        List<String> keys = prefetchKeys(ni, prefetch, 100);
+        assertEquals(50, keys.size());
+        assertEquals("0100", keys.get(0));
+        assertEquals("0198", keys.get(49));
+        assertEquals(-1, ni.leveldb_prefetch_next(prefetch, ByteBuffer.allocateDirect(100), 0, 100));
+        long[] stats = new long[NativeInterface.leveldb_prefetch_stat_count];
+        ni.leveldb_prefetch_stats(prefetch, stats, false);
+        assertEquals(50, stats[NativeInterface.leveldb_prefetch_stat_entries]);
+        assertTrue(stats[NativeInterface.leveldb_prefetch_stat_chunks] > 1);
+        ni.leveldb_prefetch_destroy(prefetch);
+
+        prefetch = ni.leveldb_prefetch_create(db, readoptions, null, null, 10, true, 4096, 4);
+        keys = prefetchKeys(ni, prefetch, 4096);
+        assertEquals(10, keys.size());
+        assertEquals("0998", keys.get(0));
+        ni.leveldb_prefetch_destroy(prefetch);
+
+        // a chunk larger than the buffer reports its size and is kept
+        prefetch = ni.leveldb_prefetch_create(db, readoptions, null, null, 0, false, 4096, 2);
+        ByteBuffer small = ByteBuffer.allocateDirect(16);
+        assertEquals(0, ni.leveldb_prefetch_next(prefetch, small, 0, 16));
+        int needed = small.getInt(0);
+        assertEquals(500, prefetchKeys(ni, prefetch, needed).size());
+        ni.leveldb_prefetch_destroy(prefetch);
+
+        // destroying an unfinished scan stops its thread
+        prefetch = ni.leveldb_prefetch_create(db, readoptions, null, null, 0, false, 64, 2);
+        ni.leveldb_prefetch_destroy(prefetch);
+
+        ni.leveldb_close(db);
+        ni.leveldb_destroy_db(options, "testfile.leveldb");
+
+        ni.leveldb_options_destroy(options);
+        ni.leveldb_readoptions_destroy(readoptions);
+        ni.leveldb_writeoptions_destroy(writeoptions);
+    }
+
 }